@@ -0,0 +1,140 @@
+/**
+ * Camada de abstracao de hardware do player
+ *
+ * A logica em lib/player so conversa com o hardware pelas funcoes abaixo.
+ * Cada ambiente do platformio.ini liga a sua implementacao:
+ *  esp32doit-devkit-v1: src/hal_esp32.cpp (SD, Audio, SSD1306 e HardwareSerial)
+ *  native:              src/native/hal_native.cpp (diretorio do host, decoder
+ *                       com relogio falso, framebuffer em memoria e pipes)
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Funcoes chamadas de interrupcao ficam na IRAM da placa
+#ifdef ARDUINO
+#include <esp_attr.h>
+#define HAL_ISR_ATTR IRAM_ATTR
+#else
+#define HAL_ISR_ATTR
+#endif
+
+// Relogio
+uint32_t halMillis(void);
+uint32_t halMicros(void);
+uint32_t halRandom(void);
+// Contador de ciclos para medir trechos curtos (da a volta em segundos)
+uint32_t halCycles(void);
+uint32_t halCyclesPerMicro(void);
+
+// Memoria livre para os relatorios de uso
+uint32_t halFreeHeap(void);
+uint32_t halMaxAllocHeap(void);
+
+// Serial: console de log e o radio HC-12
+void halLogf(const char *format, ...) __attribute__((format(printf, 1, 2)));
+int halRadioAvailable(void);
+int halRadioRead(void);
+size_t halRadioWrite(const uint8_t *data, size_t length);
+void halRadioSetCommandMode(bool command); // Pino SET do HC-12: true = comandos AT
+void halRadioSetBaud(uint32_t baud);
+
+/**
+ * Arquivo ou pasta aberta. O objeto do backend (fs::File na placa) e
+ * construido dentro de storage, entao abrir e percorrer uma pasta nao
+ * aloca nada alem do que o proprio backend aloca.
+ */
+#define HAL_FILE_READ 0
+#define HAL_FILE_WRITE 1
+#define HAL_FILE_UPDATE 2 // Le e grava em qualquer posicao sem truncar; o arquivo precisa existir
+#define HAL_FILE_STORAGE 48
+
+class HalFile {
+  public:
+    HalFile() : opened(false) {}
+    ~HalFile() { close(); }
+    bool open(const char *path, uint8_t mode = HAL_FILE_READ);
+    bool openNext(HalFile &entry); // Proxima entrada da pasta em entry
+    void rewind(void);
+    void close(void);
+    bool isOpen(void) const { return opened; }
+    bool isDirectory(void);
+    const char* name(void); // Nome sem o caminho
+    uint32_t lastWrite(void);
+    uint32_t size(void);
+    bool seek(uint32_t position);
+    size_t read(void *buffer, size_t length);
+    size_t write(const void *buffer, size_t length);
+
+  private:
+    bool opened;
+    alignas(8) uint8_t storage[HAL_FILE_STORAGE];
+    HalFile(const HalFile&);
+    HalFile& operator=(const HalFile&);
+};
+
+/**
+ * Nomes de uma pasta direto do readdir, sem abrir cada entrada como o
+ * openNext() do HalFile faz: barato o bastante para passar por todas as
+ * pastas em todo boot. Pula "." e "..".
+ */
+class HalDir {
+  public:
+    HalDir() : handle(NULL) {}
+    ~HalDir() { close(); }
+    bool open(const char *path);
+    bool next(const char **name, bool *isDirectory, uint32_t *size); // size 0 para pastas
+    void close(void);
+
+  private:
+    void *handle;
+    HalDir(const HalDir&);
+    HalDir& operator=(const HalDir&);
+};
+
+// Pasta usada como raiz "/" (default: a raiz do cartao; no host e obrigatoria)
+void halFsSetRoot(const char *path);
+bool halFsExists(const char *path);
+bool halFsMkdir(const char *path);
+bool halFsRemove(const char *path);
+bool halFsRename(const char *from, const char *to);
+uint32_t halFsClock(void); // Hz do barramento do cartao; 0 quando nao se aplica (host)
+
+/**
+ * Decoder: o backend chama playerAudioFrame() para cada quadro estereo antes do I2S
+ * e playerTrackEnded() quando o arquivo acaba.
+ * Na placa o decoder roda numa tarefa propria de prioridade maxima: as chamadas
+ * abaixo so enfileiram comandos para ela, o tempo e a duracao sao os ultimos
+ * publicados pela tarefa e halDecoderLoop() nao faz nada.
+ */
+bool halDecoderOpen(const char *path);
+// Abre path e le o comeco dele para o proximo halDecoderOpen() do mesmo caminho
+bool halDecoderPrefetch(const char *path);
+void halDecoderLoop(void);
+void halDecoderPauseResume(void);
+void halDecoderSetVolume(uint8_t volume);
+bool halDecoderSeek(uint32_t seconds); // Aplicado assim que a duracao da faixa for conhecida
+uint32_t halDecoderCurrentTime(void);
+uint32_t halDecoderDuration(void);
+uint32_t halDecoderUnderruns(void); // Vezes que o DMA do I2S esvaziou no meio da faixa
+uint32_t halDecoderSampleRate(void); // Hz da faixa aberta; 0 antes do cabecalho
+
+/**
+ * Display SSD1306: o framebuffer tem o formato das paginas do controlador,
+ * um byte por coluna de 8 linhas. halDisplaySend() envia as colunas
+ * start..end de uma pagina e devolve quantos bytes passaram no barramento.
+ */
+#define HAL_DISPLAY_WIDTH 128
+#define HAL_DISPLAY_HEIGHT 64
+#define HAL_GLYPH_WIDTH 5
+
+uint8_t* halDisplayBuffer(void);
+const uint8_t* halDisplayGlyph(uint8_t c); // HAL_GLYPH_WIDTH colunas do caractere
+uint16_t halDisplaySend(uint8_t page, uint8_t start, uint8_t end);
+
+// Acorda quem roda prefetchRun() (a tarefa no PRO core na placa)
+void halWakePrefetch(void);
+// Acorda quem roda metadataStep() para atender um metadataRequest() sem esperar a pausa
+void halWakeTags(void);
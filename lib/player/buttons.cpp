@@ -0,0 +1,103 @@
+#include "buttons.h"
+#include "events.h"
+
+struct Button buttons[BUTTON_COUNT] = {
+  { PLAY_PAUSE_SONG_EVENT, NO_BTN_EVENT, false },
+  { NEXT_SONG_EVENT, NO_BTN_EVENT, false },
+  { PREVIUS_SONG_EVENT, NO_BTN_EVENT, false },
+  { VOLUME_UP_EVENT, NO_BTN_EVENT, true },
+  { VOLUME_DOWN_EVENT, NO_BTN_EVENT, true },
+  { RANDOM_EVENT, MAIN_MENU_EVENT, false }, // Segurar abre o menu
+};
+struct ButtonEdgeQueue buttonEdges;
+
+// Roda na interrupcao do pino: so grava a borda
+void HAL_ISR_ATTR buttonEdge(uint8_t button, bool level, uint32_t time) {
+  if(level) __atomic_fetch_or(&buttonEdges.levels, 1u << button, __ATOMIC_RELAXED);
+  else __atomic_fetch_and(&buttonEdges.levels, ~(1u << button), __ATOMIC_RELAXED);
+
+  uint32_t head = __atomic_load_n(&buttonEdges.head, __ATOMIC_RELAXED);
+  uint32_t tail = __atomic_load_n(&buttonEdges.tail, __ATOMIC_ACQUIRE);
+  if(head - tail >= BUTTON_EDGE_QUEUE_SIZE) {
+    __atomic_store_n(&buttonEdges.overflow, true, __ATOMIC_RELAXED);
+    return;
+  }
+
+  struct ButtonEdge *edge = &buttonEdges.edges[head & (BUTTON_EDGE_QUEUE_SIZE - 1)];
+  edge->button = button;
+  edge->level = level;
+  edge->time = time;
+  __atomic_store_n(&buttonEdges.head, head + 1, __ATOMIC_RELEASE);
+}
+
+bool buttonsIdle() {
+  if(__atomic_load_n(&buttonEdges.head, __ATOMIC_ACQUIRE) != buttonEdges.tail) return false;
+  if(__atomic_load_n(&buttonEdges.overflow, __ATOMIC_RELAXED)) return false;
+  for(uint8_t i = 0; i < BUTTON_COUNT; i++) {
+    if(buttons[i].pressed) return false;
+  }
+  return true;
+}
+
+void buttonsUpdate(uint32_t now) {
+  uint32_t tail = buttonEdges.tail;
+  uint32_t head = __atomic_load_n(&buttonEdges.head, __ATOMIC_ACQUIRE);
+  for(; tail != head; tail++) {
+    struct ButtonEdge *edge = &buttonEdges.edges[tail & (BUTTON_EDGE_QUEUE_SIZE - 1)];
+    buttonLevel(&buttons[edge->button], edge->level, edge->time);
+  }
+  __atomic_store_n(&buttonEdges.tail, tail, __ATOMIC_RELEASE);
+
+  // Bordas perdidas com o anel cheio: vale o ultimo nivel que a interrupcao viu
+  if(__atomic_exchange_n(&buttonEdges.overflow, false, __ATOMIC_RELAXED)) {
+    uint32_t levels = __atomic_load_n(&buttonEdges.levels, __ATOMIC_RELAXED);
+    for(uint8_t i = 0; i < BUTTON_COUNT; i++) buttonLevel(&buttons[i], levels & (1u << i), now);
+  }
+
+  for(uint8_t i = 0; i < BUTTON_COUNT; i++) {
+    struct Button *button = &buttons[i];
+    if(!button->pressed) continue;
+
+    if(button->releasing && now - button->edgeTime >= BUTTON_DEBOUNCE * 1000) {
+      button->pressed = false;
+      button->releasing = false;
+      button->releaseTime = button->edgeTime;
+      if(button->longEvent != NO_BTN_EVENT && !button->longFired) {
+        pushEventAt(EVENT_SOURCE_BUTTON, button->event, button->edgeTime);
+      }
+      continue;
+    }
+    if(button->releasing) continue;
+
+    if(button->longEvent != NO_BTN_EVENT) {
+      if(!button->longFired && now - button->pressTime >= BUTTON_LONG_PRESS * 1000) {
+        button->longFired = true;
+        pushEventAt(EVENT_SOURCE_BUTTON, button->longEvent, button->pressTime + BUTTON_LONG_PRESS * 1000);
+      }
+    }
+    else if(button->autoRepeat) {
+      uint32_t wait = button->repeatTime == button->pressTime ? BUTTON_REPEAT_DELAY : BUTTON_REPEAT_INTERVAL;
+      if(now - button->repeatTime >= wait * 1000) {
+        button->repeatTime += wait * 1000;
+        pushEventAt(EVENT_SOURCE_BUTTON, button->event, button->repeatTime);
+      }
+    }
+  }
+}
+
+void buttonLevel(struct Button *button, bool level, uint32_t time) {
+  if(!button->pressed) {
+    if(!level || time - button->releaseTime < BUTTON_DEBOUNCE * 1000) return;
+    button->pressed = true;
+    button->releasing = false;
+    button->longFired = false;
+    button->pressTime = time;
+    button->repeatTime = time;
+    if(button->longEvent == NO_BTN_EVENT) pushEventAt(EVENT_SOURCE_BUTTON, button->event, time);
+    return;
+  }
+
+  // Subida durante o releasing era so o contato quicando
+  button->releasing = !level;
+  button->edgeTime = time;
+}
@@ -0,0 +1,68 @@
+/**
+ * Botoes fisicos: a interrupcao de cada pino so grava a borda com o
+ * timestamp num anel (buttonEdge) e o loop passa as bordas pela maquina de
+ * estados de cada botao em buttonsUpdate():
+ *  - o toque vale na primeira borda de subida, sem esperar o debounce, se o
+ *    botao estava solto ha pelo menos BUTTON_DEBOUNCE;
+ *  - soltar so vale depois de BUTTON_DEBOUNCE sem bordas no nivel baixo;
+ *  - botoes com longEvent disparam event ao soltar antes de BUTTON_LONG_PRESS
+ *    ou longEvent ao completar BUTTON_LONG_PRESS segurado;
+ *  - botoes com autoRepeat repetem event enquanto seguros.
+ * Com os botoes soltos e sem bordas no anel buttonsIdle() e verdadeiro e o
+ * loop nem olha os pinos.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include "hal.h"
+
+#define BUTTON_PLAY 0
+#define BUTTON_FORWARD 1
+#define BUTTON_BACKWARD 2
+#define BUTTON_VOLUME_UP 3
+#define BUTTON_VOLUME_DOWN 4
+#define BUTTON_REPEAT 5
+#define BUTTON_COUNT 6
+
+#define BUTTON_DEBOUNCE 8 // ms
+#define BUTTON_LONG_PRESS 800 // ms
+#define BUTTON_REPEAT_DELAY 400 // ms ate a primeira repeticao
+#define BUTTON_REPEAT_INTERVAL 150 // ms entre repeticoes
+#define BUTTON_EDGE_QUEUE_SIZE 32 // Potencia de 2
+
+struct Button {
+  uint8_t event;
+  uint8_t longEvent; // NO_BTN_EVENT se o botao nao tem toque longo
+  bool autoRepeat;
+  bool pressed;      // Estado depois do debounce
+  bool releasing;    // Nivel baixo esperando BUTTON_DEBOUNCE para confirmar
+  bool longFired;
+  uint32_t pressTime;
+  uint32_t edgeTime;
+  uint32_t releaseTime;
+  uint32_t repeatTime;
+};
+
+struct ButtonEdge {
+  uint8_t button;
+  bool level;
+  uint32_t time; // halMicros() na interrupcao
+};
+
+// Anel single-producer (interrupcoes) / single-consumer (loop)
+struct ButtonEdgeQueue {
+  struct ButtonEdge edges[BUTTON_EDGE_QUEUE_SIZE];
+  uint32_t head;
+  uint32_t tail;
+  uint32_t levels;   // Ultimo nivel de cada botao, mesmo com o anel cheio
+  bool overflow;
+};
+
+extern struct Button buttons[BUTTON_COUNT];
+extern struct ButtonEdgeQueue buttonEdges;
+
+void buttonEdge(uint8_t button, bool level, uint32_t time);
+bool buttonsIdle(void);
+void buttonsUpdate(uint32_t now);
+void buttonLevel(struct Button *button, bool level, uint32_t time);
@@ -0,0 +1,106 @@
+#include "cardbench.h"
+#include "player.h"
+#include "library.h"
+#include "hal.h"
+#include <stdlib.h>
+#include <string.h>
+
+const uint32_t cardBenchChunks[] = { CARD_BENCH_SECTOR, 4096, CARD_BENCH_MAX_CHUNK };
+#define CARD_BENCH_CHUNK_COUNT (sizeof(cardBenchChunks) / sizeof(cardBenchChunks[0]))
+
+uint32_t cardBenchElapsed(uint32_t start);
+bool cardBenchOpens(uint8_t *buffer, char *largest, uint32_t *largestSize);
+void cardBenchSequential(uint8_t *buffer, const char *path, uint32_t size, uint32_t chunk, uint32_t offset);
+
+void cardBenchRun() {
+  if(libraryFileCounter == 0) return;
+  uint8_t *buffer = (uint8_t*)malloc(CARD_BENCH_MAX_CHUNK);
+  if(buffer == NULL) {
+    halLogf("ERR: Sem memoria para o benchmark do cartao\n");
+    return;
+  }
+
+  char largest[PREFETCH_PATH_SIZE];
+  uint32_t largestSize = 0;
+  if(cardBenchOpens(buffer, largest, &largestSize)) {
+    for(uint8_t i = 0; i < CARD_BENCH_CHUNK_COUNT; i++) cardBenchSequential(buffer, largest, largestSize, cardBenchChunks[i], 0);
+    cardBenchSequential(buffer, largest, largestSize, 4096, 1);
+  }
+  free(buffer);
+}
+
+// Microssegundos pelos ciclos: no host o halMicros() do relogio rapido nao anda durante a leitura
+uint32_t cardBenchElapsed(uint32_t start) {
+  return (halCycles() - start) / halCyclesPerMicro();
+}
+
+// Faixas sorteadas: caminho, abertura e primeira leitura. Guarda a maior para o sequencial
+bool cardBenchOpens(uint8_t *buffer, char *largest, uint32_t *largestSize) {
+  char path[PREFETCH_PATH_SIZE];
+  uint32_t total = 0;
+  uint32_t slowest = 0;
+  uint8_t opened = 0;
+  for(uint8_t i = 0; i < CARD_BENCH_OPENS; i++) {
+    uint32_t track = halRandom() % libraryFileCounter;
+    uint16_t folder = findFolderByTrack(track);
+    uint32_t start = halCycles();
+    if(!buildTrackPath(path, sizeof(path), folder, track - folders[folder].firstFile)) continue;
+    HalFile file;
+    if(!file.open(path)) continue;
+    file.read(buffer, CARD_BENCH_FIRST_READ);
+    uint32_t elapsed = cardBenchElapsed(start);
+    uint32_t size = file.size();
+    file.close();
+
+    total += elapsed;
+    if(elapsed > slowest) slowest = elapsed;
+    opened++;
+    if(size > *largestSize) {
+      *largestSize = size;
+      strcpy(largest, path);
+    }
+  }
+  if(opened == 0) {
+    halLogf("ERR: Benchmark do cartao nao abriu nenhuma faixa\n");
+    return false;
+  }
+
+  if(halFsClock() > 0) halLogf("Cartao: barramento a %lu kHz\n", (unsigned long)(halFsClock() / 1000));
+  halLogf(
+    "Cartao: %u aberturas com %u bytes lidos: media %lu us, max %lu us\n",
+    opened,
+    CARD_BENCH_FIRST_READ,
+    (unsigned long)(total / opened),
+    (unsigned long)slowest
+  );
+  return *largestSize > 0;
+}
+
+void cardBenchSequential(uint8_t *buffer, const char *path, uint32_t size, uint32_t chunk, uint32_t offset) {
+  HalFile file;
+  if(!file.open(path) || !file.seek(offset)) return;
+  uint32_t limit = size - offset < CARD_BENCH_BYTES ? size - offset : CARD_BENCH_BYTES;
+  uint32_t bytes = 0;
+  uint32_t start = halCycles();
+  while(bytes < limit) {
+    uint32_t length = file.read(buffer, limit - bytes < chunk ? limit - bytes : chunk);
+    if(length == 0) break;
+    bytes += length;
+  }
+  uint32_t elapsed = cardBenchElapsed(start);
+  file.close();
+  if(elapsed == 0) elapsed = 1;
+
+  uint64_t rate = (uint64_t)bytes * 1000000 / elapsed; // No host passa de 32 bits
+  uint64_t margin = rate * 10 / CARD_BENCH_WAV_RATE; // Decimos
+  halLogf(
+    "Cartao: sequencial em blocos de %lu bytes%s: %lu KB/s (%lu KB em %lu us), %lu.%lux o WAV 44.1 kHz\n",
+    (unsigned long)chunk,
+    offset % CARD_BENCH_SECTOR ? " desalinhados" : "",
+    (unsigned long)(rate / 1024),
+    (unsigned long)(bytes / 1024),
+    (unsigned long)elapsed,
+    (unsigned long)(margin / 10),
+    (unsigned long)(margin % 10)
+  );
+}
@@ -0,0 +1,26 @@
+/**
+ * Vazao do cartao inserido, pedida pelo comando SD_BENCH no radio
+ *
+ * Aberturas: CARD_BENCH_OPENS faixas sorteadas da biblioteca, cada uma com o
+ * caminho montado, a abertura e a primeira leitura de CARD_BENCH_FIRST_READ
+ * bytes (o que a troca de faixa paga antes do primeiro quadro). Sequencial: a
+ * maior delas lida do inicio ate CARD_BENCH_BYTES em blocos de cada tamanho de
+ * cardBenchChunks[], alinhados ao setor, e uma vez desalinhada para mostrar o
+ * custo de leituras que nao caem em setores inteiros. A margem e a vazao
+ * dividida pela de um WAV 44.1 kHz 16 bits estereo, o formato mais pesado.
+ *
+ * Roda no loop e segura a tela e os botoes enquanto le, uns poucos segundos.
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+#define CARD_BENCH_OPENS 16
+#define CARD_BENCH_FIRST_READ 4096
+#define CARD_BENCH_BYTES (1024 * 1024) // Por tamanho de bloco
+#define CARD_BENCH_MAX_CHUNK 32768
+#define CARD_BENCH_SECTOR 512
+#define CARD_BENCH_WAV_RATE 176400 // B/s do WAV 44.1 kHz, 16 bits, estereo
+
+void cardBenchRun(void);
@@ -0,0 +1,216 @@
+#include "equalizer.h"
+#include "hal.h"
+#include <math.h>
+#include <string.h>
+
+const uint16_t eqFrequencies[EQ_BANDS] = { 60, 150, 400, 1000, 2400, 5000, 9000, 13000 };
+const uint8_t eqBandTypes[EQ_BANDS] = { EQ_LOW_SHELF, EQ_PEAK, EQ_PEAK, EQ_PEAK, EQ_PEAK, EQ_PEAK, EQ_PEAK, EQ_HIGH_SHELF };
+
+// Preamp no tamanho do maior reforco de banda larga, para a saturacao ser excecao
+const struct EqPreset eqPresets[] = {
+  { "Plano", 0, { 0, 0, 0, 0, 0, 0, 0, 0 } },
+  { "Graves", -6, { 6, 4, 1, 0, 0, 0, 0, 0 } },
+  { "Agudos", -5, { 0, 0, 0, 0, 2, 4, 5, 6 } },
+  { "Voz", -3, { -3, -2, 0, 3, 4, 2, 0, -1 } },
+  { "Rock", -4, { 5, 3, -2, -2, 1, 3, 4, 4 } },
+  { "Loudness", -5, { 6, 3, 0, -1, 0, 2, 4, 5 } },
+};
+const uint8_t eqPresetCount = sizeof(eqPresets) / sizeof(eqPresets[0]);
+
+volatile uint8_t eqPreset = 0;
+
+// Bandas com ganho de cada preset, montadas no eqBegin()
+uint8_t eqBandCount[sizeof(eqPresets) / sizeof(eqPresets[0])];
+uint8_t eqBandList[sizeof(eqPresets) / sizeof(eqPresets[0])][EQ_BANDS];
+
+// Duas tabelas: o loop monta a que o decoder nao esta usando e troca o indice
+int32_t eqCoefficients[2][sizeof(eqPresets) / sizeof(eqPresets[0])][EQ_BANDS][EQ_COEFFICIENTS];
+volatile uint8_t eqTable = 0;
+volatile uint8_t eqTableInUse = 0; // Confirmacao do decoder: a tabela da chamada atual de eqProcess()
+uint32_t eqRate = 0;
+
+// Daqui para baixo so a tarefa do decoder mexe
+struct EqSlot {
+  uint8_t preset;
+  int32_t state[EQ_BANDS][2][4]; // Por banda e canal: x1, x2, y1, y2
+};
+struct EqSlot eqSlots[2];
+uint8_t eqActive = 0;
+uint32_t eqFadeLeft = 0;
+
+void eqCascade(struct EqSlot *slot, const int32_t (*coefficients)[EQ_COEFFICIENTS], int32_t *left, int32_t *right);
+int16_t eqOutput(int32_t value);
+
+// No playerBegin(), antes do estado gravado escolher o preset
+void eqBegin() {
+  for(uint8_t preset = 0; preset < eqPresetCount; preset++) {
+    eqBandCount[preset] = 0;
+    for(uint8_t band = 0; band < EQ_BANDS; band++) {
+      if(eqPresets[preset].gain[band] != 0) eqBandList[preset][eqBandCount[preset]++] = band;
+    }
+  }
+  eqSetRate(EQ_DEFAULT_RATE);
+}
+
+// Do loop; o decoder passa para o preset novo com crossfade
+void eqSelect(uint8_t preset) {
+  if(preset >= eqPresetCount || preset == eqPreset) return;
+  eqPreset = preset;
+}
+
+// Comando EQ do controle
+void eqNext() {
+  eqSelect((eqPreset + 1) % eqPresetCount);
+  halLogf("EQ: %s\n", eqPresets[eqPreset].name);
+}
+
+// No WATCH do loop: a taxa so muda na abertura de uma faixa
+void eqWatch() {
+  eqSetRate(halDecoderSampleRate());
+}
+
+/**
+ * Recalcula todos os presets para a taxa; devolve false se nao mudou nada.
+ * So mexe na outra tabela depois que o decoder confirmou a troca anterior:
+ * ate la ele pode estar no meio de um eqProcess() com ela, e o eqWatch()
+ * tenta de novo na proxima volta do loop.
+ */
+bool eqSetRate(uint32_t rate) {
+  if(rate == 0 || rate == eqRate) return false;
+  if(__atomic_load_n(&eqTableInUse, __ATOMIC_ACQUIRE) != eqTable) return false;
+  uint8_t table = eqTable ^ 1;
+  for(uint8_t preset = 0; preset < eqPresetCount; preset++) {
+    for(uint8_t band = 0; band < EQ_BANDS; band++) {
+      double coefficients[EQ_COEFFICIENTS];
+      eqDesign(preset, band, rate, coefficients);
+      for(uint8_t i = 0; i < EQ_COEFFICIENTS; i++) {
+        eqCoefficients[table][preset][band][i] = (int32_t)llround(coefficients[i] * (1 << EQ_COEF_SHIFT));
+      }
+    }
+  }
+  __atomic_store_n(&eqTable, table, __ATOMIC_RELEASE);
+  eqRate = rate;
+  return true;
+}
+
+/**
+ * Coeficientes normalizados por a0 (RBJ Audio EQ Cookbook, prateleiras com
+ * S = 1). O preamp do preset vai nos b da primeira banda com ganho, entao o
+ * Plano e as bandas zeradas continuam identidade exata.
+ */
+void eqDesign(uint8_t preset, uint8_t band, uint32_t rate, double *coefficients) {
+  double b0 = 1, b1 = 0, b2 = 0, a0 = 1, a1 = 0, a2 = 0;
+  int8_t gain = eqPresets[preset].gain[band];
+  if(gain != 0 && eqFrequencies[band] < EQ_MAX_BAND * rate) {
+    double A = pow(10.0, gain / 40.0);
+    double w0 = 2.0 * M_PI * eqFrequencies[band] / rate;
+    double cosW0 = cos(w0);
+    double alpha = eqBandTypes[band] == EQ_PEAK ? sin(w0) / (2.0 * EQ_Q) : sin(w0) / 2.0 * sqrt(2.0);
+    double shelf = 2.0 * sqrt(A) * alpha;
+    switch(eqBandTypes[band]) {
+      case EQ_PEAK: {
+        b0 = 1 + alpha * A; b1 = -2 * cosW0; b2 = 1 - alpha * A;
+        a0 = 1 + alpha / A; a1 = -2 * cosW0; a2 = 1 - alpha / A;
+        break;
+      }
+      case EQ_LOW_SHELF: {
+        b0 = A * ((A + 1) - (A - 1) * cosW0 + shelf);
+        b1 = 2 * A * ((A - 1) - (A + 1) * cosW0);
+        b2 = A * ((A + 1) - (A - 1) * cosW0 - shelf);
+        a0 = (A + 1) + (A - 1) * cosW0 + shelf;
+        a1 = -2 * ((A - 1) + (A + 1) * cosW0);
+        a2 = (A + 1) + (A - 1) * cosW0 - shelf;
+        break;
+      }
+      case EQ_HIGH_SHELF: {
+        b0 = A * ((A + 1) + (A - 1) * cosW0 + shelf);
+        b1 = -2 * A * ((A - 1) + (A + 1) * cosW0);
+        b2 = A * ((A + 1) + (A - 1) * cosW0 - shelf);
+        a0 = (A + 1) - (A - 1) * cosW0 + shelf;
+        a1 = 2 * ((A - 1) - (A + 1) * cosW0);
+        a2 = (A + 1) - (A - 1) * cosW0 - shelf;
+        break;
+      }
+    }
+  }
+  double preamp = eqBandCount[preset] > 0 && eqBandList[preset][0] == band ? pow(10.0, eqPresets[preset].preamp / 20.0) : 1.0;
+  coefficients[0] = b0 / a0 * preamp;
+  coefficients[1] = b1 / a0 * preamp;
+  coefficients[2] = b2 / a0 * preamp;
+  coefficients[3] = a1 / a0;
+  coefficients[4] = a2 / a0;
+}
+
+/**
+ * Na tarefa do decoder: frames quadros estereo intercalados, processados no
+ * lugar; o gancho da Audio passa um quadro por chamada. O preset pedido so
+ * entra fora de um crossfade; um pedido no meio de outro espera ele terminar.
+ */
+void eqProcess(int16_t *samples, uint32_t frames) {
+  uint8_t table = __atomic_load_n(&eqTable, __ATOMIC_ACQUIRE);
+  __atomic_store_n(&eqTableInUse, table, __ATOMIC_RELEASE);
+  const int32_t (*coefficients)[EQ_BANDS][EQ_COEFFICIENTS] = eqCoefficients[table];
+  struct EqSlot *current = &eqSlots[eqActive];
+  struct EqSlot *next = &eqSlots[eqActive ^ 1];
+  if(eqFadeLeft == 0) {
+    uint8_t preset = eqPreset;
+    if(preset != current->preset) {
+      memset(next, 0, sizeof(*next));
+      next->preset = preset;
+      eqFadeLeft = EQ_CROSSFADE_FRAMES;
+    }
+    else if(eqBandCount[preset] == 0) return;
+  }
+
+  for(uint32_t i = 0; i < frames; i++, samples += 2) {
+    int32_t left = samples[0] * (1 << EQ_SIGNAL_SHIFT);
+    int32_t right = samples[1] * (1 << EQ_SIGNAL_SHIFT);
+    if(eqFadeLeft > 0) {
+      int32_t nextLeft = left;
+      int32_t nextRight = right;
+      eqCascade(current, coefficients[current->preset], &left, &right);
+      eqCascade(next, coefficients[next->preset], &nextLeft, &nextRight);
+      int32_t weight = (EQ_CROSSFADE_FRAMES - eqFadeLeft) << (15 - EQ_CROSSFADE_BITS); // Q15 do preset novo
+      left = ((int64_t)left * (32768 - weight) + (int64_t)nextLeft * weight) >> 15;
+      right = ((int64_t)right * (32768 - weight) + (int64_t)nextRight * weight) >> 15;
+      if(--eqFadeLeft == 0) {
+        eqActive ^= 1;
+        current = next;
+        next = &eqSlots[eqActive ^ 1];
+      }
+    }
+    else eqCascade(current, coefficients[current->preset], &left, &right);
+    samples[0] = eqOutput(left);
+    samples[1] = eqOutput(right);
+  }
+}
+
+// Forma direta I; os dois canais passam por cada banda com os coeficientes ja carregados
+void eqCascade(struct EqSlot *slot, const int32_t (*coefficients)[EQ_COEFFICIENTS], int32_t *left, int32_t *right) {
+  int32_t l = *left;
+  int32_t r = *right;
+  uint8_t count = eqBandCount[slot->preset];
+  const uint8_t *bands = eqBandList[slot->preset];
+  for(uint8_t i = 0; i < count; i++) {
+    const int32_t *c = coefficients[bands[i]];
+    int32_t b0 = c[0], b1 = c[1], b2 = c[2], a1 = c[3], a2 = c[4];
+    int32_t *sl = slot->state[i][0];
+    int32_t *sr = slot->state[i][1];
+
+    int64_t accL = (int64_t)b0 * l + (int64_t)b1 * sl[0] + (int64_t)b2 * sl[1] - (int64_t)a1 * sl[2] - (int64_t)a2 * sl[3];
+    int64_t accR = (int64_t)b0 * r + (int64_t)b1 * sr[0] + (int64_t)b2 * sr[1] - (int64_t)a1 * sr[2] - (int64_t)a2 * sr[3];
+    sl[1] = sl[0]; sl[0] = l;
+    sr[1] = sr[0]; sr[0] = r;
+    l = (int32_t)((accL + (1 << (EQ_COEF_SHIFT - 1))) >> EQ_COEF_SHIFT);
+    r = (int32_t)((accR + (1 << (EQ_COEF_SHIFT - 1))) >> EQ_COEF_SHIFT);
+    sl[3] = sl[2]; sl[2] = l;
+    sr[3] = sr[2]; sr[2] = r;
+  }
+  *left = l;
+  *right = r;
+}
+
+int16_t eqOutput(int32_t value) {
+  int32_t sample = (value + (1 << (EQ_SIGNAL_SHIFT - 1))) >> EQ_SIGNAL_SHIFT;
+  return sample > INT16_MAX ? INT16_MAX : sample < INT16_MIN ? INT16_MIN : sample;
+}
@@ -0,0 +1,58 @@
+/**
+ * Equalizador parametrico no caminho do PCM, depois do ReplayGain
+ *
+ * EQ_BANDS biquads em cascata (prateleira nos extremos, pico no meio) com os
+ * ganhos de cada preset de eqPresets[]. Os coeficientes de todos os presets
+ * saem das formulas do RBJ no loop, quando a taxa da faixa muda, e vao para a
+ * tabela que o decoder nao esta usando (a que ele ja confirmou ter largado);
+ * a troca e so o indice. O decoder nunca calcula coeficiente.
+ *
+ * eqProcess() roda no gancho do PCM sobre quadros estereo intercalados, no
+ * lugar: amostras Q15 entram como int32 deslocadas EQ_SIGNAL_SHIFT bits (24 dB
+ * de folga para os reforcos), coeficientes Q28, forma direta I com acumulador
+ * de 64 bits, e L e R passam juntos por cada banda com os coeficientes ja
+ * carregados. So as bandas com ganho do preset entram na cascata; o Plano nao
+ * custa nada. O preamp do preset vai dobrado no b da primeira banda.
+ *
+ * A troca de preset (comando EQ do controle) vale na proxima chamada: o preset
+ * novo comeca com estado zerado num segundo slot e os dois tocam juntos por
+ * EQ_CROSSFADE_FRAMES, com a saida indo de um para o outro, sem estalo.
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+#define EQ_BANDS 8
+#define EQ_COEFFICIENTS 5 // b0, b1, b2, a1, a2
+#define EQ_COEF_SHIFT 28
+#define EQ_SIGNAL_SHIFT 12
+#define EQ_Q 1.0 // Das bandas de pico, uma oitava e meia entre os centros
+#define EQ_MAX_BAND 0.45 // Banda acima disso da taxa fica de fora
+#define EQ_CROSSFADE_BITS 10
+#define EQ_CROSSFADE_FRAMES (1 << EQ_CROSSFADE_BITS) // 23 ms a 44.1 kHz
+#define EQ_DEFAULT_RATE 44100
+#define EQ_NAME_SIZE 12
+
+#define EQ_LOW_SHELF 0
+#define EQ_PEAK 1
+#define EQ_HIGH_SHELF 2
+
+struct EqPreset {
+  char name[EQ_NAME_SIZE];
+  int8_t preamp; // dB
+  int8_t gain[EQ_BANDS]; // dB por banda
+};
+
+extern const uint16_t eqFrequencies[EQ_BANDS];
+extern const struct EqPreset eqPresets[];
+extern const uint8_t eqPresetCount;
+extern volatile uint8_t eqPreset; // Pedido pelo loop; o decoder troca na proxima chamada
+
+void eqBegin(void);
+void eqSelect(uint8_t preset);
+void eqNext(void);
+void eqWatch(void);
+bool eqSetRate(uint32_t rate);
+void eqProcess(int16_t *samples, uint32_t frames);
+void eqDesign(uint8_t preset, uint8_t band, uint32_t rate, double *coefficients);
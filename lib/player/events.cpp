@@ -0,0 +1,36 @@
+#include "events.h"
+#include "hal.h"
+
+struct EventQueue eventQueues[EVENT_SOURCE_COUNT];
+
+bool pushEvent(uint8_t source, uint8_t type) {
+  return pushEventAt(source, type, halMicros());
+}
+
+// time e quando a acao aconteceu de fato (a borda do botao), para a latencia medir o caminho todo
+bool pushEventAt(uint8_t source, uint8_t type, uint32_t time) {
+  struct EventQueue *queue = &eventQueues[source];
+  uint32_t head = __atomic_load_n(&queue->head, __ATOMIC_RELAXED);
+  uint32_t tail = __atomic_load_n(&queue->tail, __ATOMIC_ACQUIRE);
+  if(head - tail >= EVENT_QUEUE_SIZE) {
+    __atomic_fetch_add(&queue->dropped, 1, __ATOMIC_RELAXED);
+    return false;
+  }
+
+  struct InputEvent *event = &queue->events[head & (EVENT_QUEUE_SIZE - 1)];
+  event->type = type;
+  event->source = source;
+  event->time = time;
+  __atomic_store_n(&queue->head, head + 1, __ATOMIC_RELEASE);
+  return true;
+}
+
+bool popEvent(struct EventQueue *queue, struct InputEvent *event) {
+  uint32_t tail = __atomic_load_n(&queue->tail, __ATOMIC_RELAXED);
+  uint32_t head = __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE);
+  if(tail == head) return false;
+
+  *event = queue->events[tail & (EVENT_QUEUE_SIZE - 1)];
+  __atomic_store_n(&queue->tail, tail + 1, __ATOMIC_RELEASE);
+  return true;
+}
@@ -0,0 +1,52 @@
+/**
+ * Fila de eventos de entrada: um anel single-producer/single-consumer por
+ * fonte (o radio no PRO core, os botoes no loop), todos consumidos pelo
+ * dispatchEvents() no loop principal em ordem de timestamp. Produtor so
+ * escreve head e consumidor so escreve tail, entao nao precisa de lock.
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+#define NO_BTN_EVENT 0
+#define PLAY_PAUSE_SONG_EVENT 1
+#define NEXT_SONG_EVENT 2
+#define PREVIUS_SONG_EVENT 3
+// #define ROOT_SONG_EVENT 4
+// #define LAST_SONG_EVENT 5
+// #define NEXT_FOLDER_EVENT 6
+// #define PREVIUS_FOLDER_EVENT 7
+#define VOLUME_UP_EVENT 8
+#define VOLUME_DOWN_EVENT 9
+#define RANDOM_EVENT 10
+#define MAIN_MENU_EVENT 11
+#define PROFILE_DUMP_EVENT 12
+#define RADIO_SCAN_EVENT 13
+#define RADIO_BENCH_EVENT 14
+#define CARD_BENCH_EVENT 15
+#define SPECTRUM_EVENT 16
+#define EQ_EVENT 17
+#define MAX_EVENT EQ_EVENT // Maior tipo aceito nos quadros binarios
+
+#define EVENT_QUEUE_SIZE 16 // Potencia de 2
+#define EVENT_SOURCE_RADIO 0
+#define EVENT_SOURCE_BUTTON 1
+#define EVENT_SOURCE_COUNT 2
+
+struct InputEvent {
+  uint8_t type;
+  uint8_t source;
+  uint32_t time; // halMicros() de quando aconteceu (entrada na fila ou borda do botao)
+};
+struct EventQueue {
+  struct InputEvent events[EVENT_QUEUE_SIZE];
+  uint32_t head;
+  uint32_t tail;
+  uint32_t dropped;
+};
+extern struct EventQueue eventQueues[EVENT_SOURCE_COUNT];
+
+bool pushEvent(uint8_t source, uint8_t type);
+bool pushEventAt(uint8_t source, uint8_t type, uint32_t time);
+bool popEvent(struct EventQueue *queue, struct InputEvent *event);
@@ -0,0 +1,77 @@
+#include "format.h"
+#include "library.h"
+#include <string.h>
+
+constexpr struct FileTypeExtension fileTypeExtensions[] = {
+  { "mp3", FILE_TYPE_MP3 },
+  { "wav", FILE_TYPE_WAV },
+  { "aac", FILE_TYPE_AAC },
+  { "m4a", FILE_TYPE_M4A },
+};
+#define FILE_TYPE_EXTENSION_COUNT (sizeof(fileTypeExtensions) / sizeof(fileTypeExtensions[0]))
+
+bool isMp3Sync(const uint8_t *header);
+bool isAdtsSync(const uint8_t *header);
+
+// "musica.v2.mp3" e mp3: so vale o que vem depois do ultimo ponto
+uint8_t fileTypeFromName(const char *name) {
+  const char *dot = strrchr(name, '.');
+  if(dot == NULL) return FILE_TYPE_UNKNOWN;
+  const char *extension = dot + 1;
+
+  for(uint8_t i = 0; i < FILE_TYPE_EXTENSION_COUNT; i++) {
+    const char *expected = fileTypeExtensions[i].extension;
+    uint8_t j = 0;
+    for(; expected[j] != '\0'; j++) {
+      char c = extension[j];
+      if(c >= 'A' && c <= 'Z') c = c - 'A' + 'a';
+      if(c != expected[j]) break;
+    }
+    if(expected[j] == '\0' && extension[j] == '\0') return fileTypeExtensions[i].type;
+  }
+  return FILE_TYPE_UNKNOWN;
+}
+
+// Le o comeco de um arquivo ja aberto (a entrada do openNext da varredura)
+uint8_t probeFileType(HalFile &file, uint8_t expected) {
+  uint8_t header[FORMAT_PROBE_SIZE];
+  uint32_t length = file.read(header, sizeof(header));
+  return probeHeader(header, length, expected);
+}
+
+/**
+ * Devolve o tipo que o cabecalho indica. ID3 serve para mp3 e aac, e o mp3
+ * ainda aceita lixo antes do primeiro quadro dentro dos bytes lidos, como a
+ * Audio faz ao procurar o sync.
+ */
+uint8_t probeHeader(const uint8_t *header, uint32_t length, uint8_t expected) {
+  if(length < 12) return FILE_TYPE_UNKNOWN;
+
+  if(memcmp(header, "ID3", 3) == 0) return expected == FILE_TYPE_AAC ? FILE_TYPE_AAC : FILE_TYPE_MP3;
+  if(memcmp(header, "RIFF", 4) == 0 && memcmp(header + 8, "WAVE", 4) == 0) return FILE_TYPE_WAV;
+  if(memcmp(header + 4, "ftyp", 4) == 0) return FILE_TYPE_M4A;
+  if(memcmp(header, "ADIF", 4) == 0 || isAdtsSync(header)) return FILE_TYPE_AAC;
+  if(isMp3Sync(header)) return FILE_TYPE_MP3;
+
+  if(expected == FILE_TYPE_MP3) {
+    for(uint32_t i = 1; i + 4 <= length; i++) {
+      if(isMp3Sync(header + i)) return FILE_TYPE_MP3;
+    }
+  }
+  return FILE_TYPE_UNKNOWN;
+}
+
+// 11 bits de sync, versao e layer validos, bitrate e sample rate fora dos reservados
+bool isMp3Sync(const uint8_t *header) {
+  return header[0] == 0xFF &&
+    (header[1] & 0xE0) == 0xE0 &&
+    (header[1] & 0x18) != 0x08 &&
+    (header[1] & 0x06) != 0x00 &&
+    (header[2] & 0xF0) != 0xF0 &&
+    (header[2] & 0x0C) != 0x0C;
+}
+
+// 12 bits de sync e layer 0
+bool isAdtsSync(const uint8_t *header) {
+  return header[0] == 0xFF && (header[1] & 0xF6) == 0xF0;
+}
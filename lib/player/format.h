@@ -0,0 +1,27 @@
+/**
+ * Classificacao dos arquivos de audio durante a varredura da biblioteca
+ *
+ * O tipo sai da extensao (depois do ultimo '.', sem diferenca de maiusculas)
+ * e e confirmado pelos primeiros FORMAT_PROBE_SIZE bytes: ID3 ou sync de
+ * quadro MP3, RIFF/WAVE, ADTS/ADIF e o atom ftyp do MP4. O decoder escolhe o
+ * codec pela extensao, entao arquivo cujo cabecalho nao bate com ela nao toca
+ * e fica fora da biblioteca. O veredito fica no indice junto com o tipo e so
+ * e refeito quando a pasta muda.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include "hal.h"
+
+#define FORMAT_PROBE_SIZE 32
+#define FORMAT_EXTENSION_SIZE 5
+
+struct FileTypeExtension {
+  char extension[FORMAT_EXTENSION_SIZE];
+  uint8_t type;
+};
+
+uint8_t fileTypeFromName(const char *name);
+uint8_t probeFileType(HalFile &file, uint8_t expected);
+uint8_t probeHeader(const uint8_t *header, uint32_t length, uint8_t expected);
@@ -0,0 +1,457 @@
+#include "hc12.h"
+#include "telemetry.h"
+#include "state.h"
+#include "library.h"
+#include "hal.h"
+#include <string.h>
+#include <stdio.h>
+#include <stddef.h>
+
+#define HC12_STATE_IDLE 0
+#define HC12_STATE_ENTER 1
+#define HC12_STATE_PROBE 2
+#define HC12_STATE_QUERY 3
+#define HC12_STATE_SET_FU 4
+#define HC12_STATE_SET_BAUD 5
+#define HC12_STATE_VERIFY 6
+#define HC12_STATE_BENCH 7
+#define HC12_STATE_EXIT 8
+#define HC12_STATE_LINK 9
+
+#define HC12_WAITING 0
+#define HC12_OK 1
+#define HC12_FAILED 2
+
+#define HC12_PING_SEQ 0xE0 // Faixa de seq dos quadros de teste, longe do comeco da telemetria
+
+// Da mais rapida para a mais lenta. FU2 so aceita ate 4800 e FU4 so 1200
+const struct RadioSetting hc12Candidates[] = {
+  { 115200, 3 }, { 57600, 3 }, { 38400, 3 }, { 19200, 3 }, { 9600, 3 }, { 4800, 3 }, { 4800, 2 }, { 1200, 4 },
+};
+#define HC12_CANDIDATE_COUNT (sizeof(hc12Candidates) / sizeof(hc12Candidates[0]))
+
+const uint32_t hc12Bauds[] = { 9600, 115200, 57600, 38400, 19200, 4800, 2400, 1200 };
+#define HC12_BAUD_COUNT (sizeof(hc12Bauds) / sizeof(hc12Bauds[0]))
+
+struct RadioSetting hc12Stored = { HC12_DEFAULT_BAUD, HC12_DEFAULT_FU };
+struct RadioSetting hc12Target;
+volatile uint8_t hc12Requested = HC12_JOB_NONE;
+volatile bool hc12SavePending = false;
+
+// Daqui para baixo so a tarefa do radio mexe
+uint8_t hc12Job = HC12_JOB_NONE;
+uint8_t hc12State = HC12_STATE_IDLE;
+uint32_t hc12StateTime = 0;
+bool hc12CommandMode = false;
+uint32_t hc12UartBaud = HC12_DEFAULT_BAUD;
+uint32_t hc12ProbeFirst = 0;
+uint8_t hc12ProbeIndex = 0;
+uint8_t hc12Candidate = 0;
+uint8_t hc12ModuleFu = 0;
+bool hc12FuWritten = false;
+
+char hc12Line[HC12_LINE_SIZE];
+uint8_t hc12LineLength = 0;
+const char *hc12Expected = NULL;
+uint8_t hc12Result = HC12_WAITING;
+uint32_t hc12SentAt = 0; // halMicros() do ultimo comando
+uint32_t hc12Timeout = HC12_COMMAND_TIMEOUT;
+uint32_t hc12Latency = 0;
+
+uint32_t hc12Latencies[HC12_BENCH_ROUNDS];
+uint8_t hc12Rounds = 0;
+uint8_t hc12Answered = 0;
+uint8_t hc12PingSeq = HC12_PING_SEQ;
+uint8_t hc12PingTries = 0;
+uint32_t hc12LinkTime = 0;
+
+void hc12StartJob(uint8_t job);
+void hc12Enter(void);
+bool hc12Probe(void);
+void hc12Command(uint8_t state, const char *command, const char *expected);
+void hc12ReadLines(void);
+uint8_t hc12TakeResult(uint32_t now);
+void hc12Configured(void);
+void hc12Exit(void);
+void hc12SendPing(void);
+void hc12LinkDone(bool link);
+void hc12CandidateFailed(void);
+void hc12NextCandidate(void);
+void hc12Finish(const char *outcome);
+void hc12SetUartBaud(uint32_t baud);
+void hc12ReportBench(bool link);
+uint32_t hc12Percentile(uint8_t percent);
+
+/**
+ * No playerBegin(): reaplica a configuracao gravada ou, sem ela, o padrao de
+ * fabrica. A busca nunca roda sozinha no boot: ela regrava a flash do modulo
+ * em cada candidata e tira o radio da taxa do controle por varios segundos,
+ * entao so o comando RADIO_SCAN pede uma.
+ */
+void hc12Begin() {
+  struct RadioConfig config;
+  HalFile file;
+  bool valid = file.open(HC12_CONFIG_PATH) &&
+    file.read(&config, sizeof(config)) == sizeof(config) &&
+    config.magic == HC12_CONFIG_MAGIC &&
+    config.crc == crc32((const uint8_t*)&config, offsetof(struct RadioConfig, crc));
+  file.close();
+
+  if(valid) {
+    hc12Stored.baud = config.baud;
+    hc12Stored.fu = config.fu;
+  }
+  hc12SetUartBaud(hc12Stored.baud);
+  hc12Request(HC12_JOB_APPLY);
+}
+
+// Do loop: o trabalho comeca na proxima volta da tarefa do radio
+void hc12Request(uint8_t job) {
+  hc12Requested = job;
+}
+
+bool hc12Busy() {
+  return hc12Job != HC12_JOB_NONE || hc12Requested != HC12_JOB_NONE;
+}
+
+/**
+ * Uma volta do trabalho atual. Devolve true enquanto os bytes da UART sao do
+ * trabalho; no teste do enlace o parser volta a ler, porque a confirmacao do
+ * controle chega por ele.
+ */
+bool hc12Step() {
+  if(hc12Job == HC12_JOB_NONE) {
+    uint8_t job = hc12Requested;
+    if(job == HC12_JOB_NONE) return false;
+    hc12Requested = HC12_JOB_NONE;
+    hc12StartJob(job);
+  }
+
+  uint32_t now = halMillis();
+  if(hc12CommandMode) hc12ReadLines();
+  uint8_t result = hc12TakeResult(now);
+
+  switch(hc12State) {
+    case HC12_STATE_ENTER: {
+      if(now - hc12StateTime < HC12_ENTER_DELAY) break;
+      hc12ProbeFirst = hc12UartBaud;
+      hc12ProbeIndex = 0;
+      if(!hc12Probe()) hc12Finish("modulo nao responde");
+      break;
+    }
+    case HC12_STATE_PROBE: {
+      if(result == HC12_OK) hc12Command(HC12_STATE_QUERY, "AT+RX", "OK+FU");
+      else if(result == HC12_FAILED && !hc12Probe()) {
+        hc12Target = hc12Stored;
+        hc12SetUartBaud(hc12Stored.baud);
+        hc12Finish("modulo nao responde");
+      }
+      break;
+    }
+    case HC12_STATE_QUERY: {
+      if(result == HC12_WAITING) break;
+      char command[16];
+      if(result == HC12_FAILED || hc12ModuleFu != hc12Target.fu) {
+        if(hc12FuWritten) {
+          hc12CandidateFailed();
+          break;
+        }
+        snprintf(command, sizeof(command), "AT+FU%u", hc12Target.fu);
+        hc12Command(HC12_STATE_SET_FU, command, "OK+FU");
+      }
+      else if(hc12UartBaud != hc12Target.baud) {
+        snprintf(command, sizeof(command), "AT+B%lu", (unsigned long)hc12Target.baud);
+        hc12Command(HC12_STATE_SET_BAUD, command, "OK+B");
+      }
+      // Ja esta como deveria: nada de regravar a flash do modulo
+      else hc12Configured();
+      break;
+    }
+    case HC12_STATE_SET_FU: {
+      if(result == HC12_WAITING) break;
+      if(result == HC12_FAILED) {
+        hc12CandidateFailed();
+        break;
+      }
+      // FU2 e FU4 limitam o baud e o modulo pode ter mudado sozinho: procura de novo
+      hc12FuWritten = true;
+      hc12ProbeFirst = hc12UartBaud;
+      hc12ProbeIndex = 0;
+      if(!hc12Probe()) hc12CandidateFailed();
+      break;
+    }
+    case HC12_STATE_SET_BAUD: {
+      if(result == HC12_WAITING) break;
+      if(result == HC12_FAILED) {
+        hc12CandidateFailed();
+        break;
+      }
+      // A resposta ainda vem no baud antigo; o proximo comando ja vai no novo
+      hc12SetUartBaud(hc12Target.baud);
+      hc12Command(HC12_STATE_VERIFY, "AT", "OK");
+      break;
+    }
+    case HC12_STATE_VERIFY: {
+      if(result == HC12_OK) hc12Configured();
+      else if(result == HC12_FAILED) hc12CandidateFailed();
+      break;
+    }
+    case HC12_STATE_BENCH: {
+      if(result == HC12_WAITING) break;
+      if(result == HC12_OK) hc12Latencies[hc12Answered++] = hc12Latency;
+      if(++hc12Rounds < HC12_BENCH_ROUNDS) hc12Command(HC12_STATE_BENCH, "AT", "OK");
+      else hc12Exit();
+      break;
+    }
+    case HC12_STATE_EXIT: {
+      if(now - hc12StateTime < HC12_EXIT_DELAY) break;
+      if(hc12Job == HC12_JOB_APPLY) {
+        hc12Finish("configurado");
+        break;
+      }
+      hc12PingTries = 0;
+      hc12SendPing();
+      break;
+    }
+    case HC12_STATE_LINK: {
+      if(telemetryTakeAck(hc12PingSeq)) {
+        hc12LinkTime = now - hc12StateTime;
+        hc12LinkDone(true);
+      }
+      else if(now - hc12StateTime >= hc12Timeout) {
+        if(++hc12PingTries < HC12_LINK_TRIES) hc12SendPing();
+        else hc12LinkDone(false);
+      }
+      break;
+    }
+  }
+  return hc12Job != HC12_JOB_NONE && hc12State != HC12_STATE_LINK;
+}
+
+// Na volta do loop: gravar no cartao fica fora da tarefa do radio
+void hc12Watch() {
+  if(!hc12SavePending) return;
+  hc12SavePending = false;
+
+  struct RadioConfig config;
+  memset(&config, 0, sizeof(config));
+  config.magic = HC12_CONFIG_MAGIC;
+  config.baud = hc12Stored.baud;
+  config.fu = hc12Stored.fu;
+  config.crc = crc32((const uint8_t*)&config, offsetof(struct RadioConfig, crc));
+
+  if(!halFsExists(LIBRARY_INDEX_DIR)) halFsMkdir(LIBRARY_INDEX_DIR);
+  HalFile file;
+  bool written = file.open(HC12_CONFIG_PATH, HAL_FILE_WRITE) && file.write(&config, sizeof(config)) == sizeof(config);
+  file.close();
+  if(!written) halLogf("ERR: Nao foi possivel gravar a configuracao do radio\n");
+}
+
+void hc12StartJob(uint8_t job) {
+  hc12Job = job;
+  hc12Candidate = 0;
+  hc12Target = job == HC12_JOB_APPLY ? hc12Stored : hc12Candidates[0];
+  hc12Enter();
+}
+
+void hc12Enter() {
+  hc12FuWritten = false;
+  if(hc12CommandMode) {
+    hc12ProbeFirst = hc12UartBaud;
+    hc12ProbeIndex = 0;
+    if(!hc12Probe()) hc12Finish("modulo nao responde");
+    return;
+  }
+  halRadioSetCommandMode(true);
+  hc12CommandMode = true;
+  hc12LineLength = 0;
+  hc12State = HC12_STATE_ENTER;
+  hc12StateTime = halMillis();
+}
+
+// "AT" no proximo baud da lista, comecando pelo atual da UART
+bool hc12Probe() {
+  for(; hc12ProbeIndex <= HC12_BAUD_COUNT; hc12ProbeIndex++) {
+    uint32_t baud = hc12ProbeIndex == 0 ? hc12ProbeFirst : hc12Bauds[hc12ProbeIndex - 1];
+    if(hc12ProbeIndex > 0 && baud == hc12ProbeFirst) continue;
+    hc12ProbeIndex++;
+    hc12SetUartBaud(baud);
+    hc12Command(HC12_STATE_PROBE, "AT", "OK");
+    return true;
+  }
+  return false;
+}
+
+void hc12Command(uint8_t state, const char *command, const char *expected) {
+  while(halRadioAvailable() > 0) halRadioRead(); // Resto de uma resposta atrasada
+  hc12LineLength = 0;
+  hc12Expected = expected;
+  hc12Result = HC12_WAITING;
+  hc12State = state;
+  hc12StateTime = halMillis();
+  hc12SentAt = halMicros();
+  // A 1200 baud so as linhas do AT+RX levam mais de 400 ms para chegar
+  hc12Timeout = HC12_COMMAND_TIMEOUT + HC12_RESPONSE_BYTES * 10000 / hc12UartBaud;
+  halRadioWrite((const uint8_t*)command, strlen(command));
+}
+
+// Respostas terminam em "\r\n"; o AT+RX manda uma linha por parametro
+void hc12ReadLines() {
+  while(halRadioAvailable() > 0) {
+    char c = halRadioRead();
+    if(c == '\r') continue;
+    if(c != '\n') {
+      if(hc12LineLength < HC12_LINE_SIZE - 1) hc12Line[hc12LineLength++] = c;
+      continue;
+    }
+    hc12Line[hc12LineLength] = '\0';
+    hc12LineLength = 0;
+    if(hc12Result != HC12_WAITING || hc12Expected == NULL) continue;
+
+    if(strncmp(hc12Line, "OK+FU", 5) == 0) hc12ModuleFu = hc12Line[5] - '0';
+    if(strncmp(hc12Line, hc12Expected, strlen(hc12Expected)) == 0) {
+      hc12Latency = halMicros() - hc12SentAt;
+      hc12Result = HC12_OK;
+    }
+    else if(strncmp(hc12Line, "ERROR", 5) == 0) hc12Result = HC12_FAILED;
+  }
+}
+
+// O resultado do comando atual, uma vez so; sem resposta no prazo e falha
+uint8_t hc12TakeResult(uint32_t now) {
+  if(hc12Expected == NULL) return HC12_WAITING;
+  if(hc12Result == HC12_WAITING && now - hc12StateTime < hc12Timeout) return HC12_WAITING;
+  uint8_t result = hc12Result == HC12_OK ? HC12_OK : HC12_FAILED;
+  hc12Expected = NULL;
+  return result;
+}
+
+// Modulo na configuracao alvo: mede os comandos (bench) ou sai para testar o enlace
+void hc12Configured() {
+  if(hc12Job != HC12_JOB_BENCH) {
+    hc12Exit();
+    return;
+  }
+  hc12Rounds = 0;
+  hc12Answered = 0;
+  hc12Command(HC12_STATE_BENCH, "AT", "OK");
+}
+
+void hc12Exit() {
+  halRadioSetCommandMode(false);
+  hc12CommandMode = false;
+  hc12State = HC12_STATE_EXIT;
+  hc12StateTime = halMillis();
+}
+
+// Um quadro completo de telemetria: o controle confirma como qualquer outro
+void hc12SendPing() {
+  uint8_t frame[TELEMETRY_FRAME_MAX];
+  hc12PingSeq = hc12PingSeq == 0xFF ? HC12_PING_SEQ : hc12PingSeq + 1;
+  telemetryTakeAck(hc12PingSeq); // Descarta confirmacao velha
+  uint8_t length = telemetryKeyframe(frame, hc12PingSeq);
+  halRadioWrite(frame, length);
+  // Quadro e confirmacao no ar; a FU4 transmite a menos da metade do baud da UART
+  hc12Timeout = HC12_LINK_TIMEOUT + (length + 4) * 20000 / hc12UartBaud;
+  hc12State = HC12_STATE_LINK;
+  hc12StateTime = halMillis();
+}
+
+void hc12LinkDone(bool link) {
+  if(hc12Job == HC12_JOB_BENCH) {
+    hc12ReportBench(link);
+    hc12NextCandidate();
+  }
+  else if(link) {
+    hc12Stored = hc12Target;
+    hc12SavePending = true;
+    hc12Finish("controle respondeu");
+  }
+  else hc12NextCandidate();
+}
+
+void hc12CandidateFailed() {
+  if(hc12Job == HC12_JOB_APPLY) {
+    hc12Exit();
+    hc12Finish("modulo recusou a configuracao");
+    return;
+  }
+  if(hc12Job == HC12_JOB_BENCH) {
+    hc12Rounds = 0;
+    hc12Answered = 0;
+    hc12ReportBench(false);
+  }
+  hc12NextCandidate();
+}
+
+/**
+ * Proxima candidata. Acabando a busca sem resposta vai para o padrao de
+ * fabrica e grava ele, para o proximo boot so reaplicar; acabando o bench
+ * volta para a configuracao gravada.
+ */
+void hc12NextCandidate() {
+  if(++hc12Candidate < HC12_CANDIDATE_COUNT) {
+    hc12Target = hc12Candidates[hc12Candidate];
+    hc12Enter();
+    return;
+  }
+  if(hc12Job == HC12_JOB_SCAN) {
+    halLogf("Radio: o controle nao respondeu em nenhuma configuracao\n");
+    hc12Stored.baud = HC12_DEFAULT_BAUD;
+    hc12Stored.fu = HC12_DEFAULT_FU;
+    hc12SavePending = true;
+  }
+  hc12Job = HC12_JOB_APPLY;
+  hc12Target = hc12Stored;
+  hc12Enter();
+}
+
+void hc12Finish(const char *outcome) {
+  if(hc12CommandMode) {
+    halRadioSetCommandMode(false);
+    hc12CommandMode = false;
+  }
+  halLogf("Radio: FU%u %lu baud, %s\n", hc12Target.fu, (unsigned long)hc12Target.baud, outcome);
+  hc12Job = HC12_JOB_NONE;
+  hc12State = HC12_STATE_IDLE;
+  hc12Expected = NULL;
+}
+
+void hc12SetUartBaud(uint32_t baud) {
+  if(baud == hc12UartBaud) return;
+  halRadioSetBaud(baud);
+  hc12UartBaud = baud;
+}
+
+void hc12ReportBench(bool link) {
+  // Insercao: sao no maximo HC12_BENCH_ROUNDS valores
+  for(uint8_t i = 1; i < hc12Answered; i++) {
+    uint32_t value = hc12Latencies[i];
+    uint8_t j = i;
+    for(; j > 0 && hc12Latencies[j - 1] > value; j--) hc12Latencies[j] = hc12Latencies[j - 1];
+    hc12Latencies[j] = value;
+  }
+
+  char linkText[24];
+  if(link) snprintf(linkText, sizeof(linkText), "%lu ms", (unsigned long)hc12LinkTime);
+  else snprintf(linkText, sizeof(linkText), "sem resposta");
+  halLogf(
+    "Radio bench: FU%u %lu baud, AT %u/%u, p50 %lu us, p90 %lu us, p99 %lu us, max %lu us, controle %s\n",
+    hc12Target.fu,
+    (unsigned long)hc12Target.baud,
+    hc12Answered,
+    hc12Rounds,
+    (unsigned long)hc12Percentile(50),
+    (unsigned long)hc12Percentile(90),
+    (unsigned long)hc12Percentile(99),
+    (unsigned long)hc12Percentile(100),
+    linkText
+  );
+}
+
+// Nearest-rank sobre hc12Latencies ja ordenado
+uint32_t hc12Percentile(uint8_t percent) {
+  if(hc12Answered == 0) return 0;
+  uint32_t rank = (hc12Answered * percent + 99) / 100;
+  return hc12Latencies[rank > 0 ? rank - 1 : 0];
+}
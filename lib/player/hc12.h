@@ -0,0 +1,66 @@
+/**
+ * Configuracao do HC-12 por comandos AT, sem bloquear
+ *
+ * hc12Step() roda na tarefa do radio no lugar do radioPoll() enquanto ha um
+ * trabalho: cada chamada olha o que chegou e o relogio e avanca no maximo um
+ * passo, e todo comando tem HC12_COMMAND_TIMEOUT alem do tempo da resposta na
+ * UART. Com o SET baixo os bytes da UART sao respostas AT, entao o parser dos
+ * comandos do controle fica parado e a telemetria nao transmite ate o trabalho
+ * acabar.
+ *
+ *  HC12_JOB_APPLY  boot: acha o baud atual do modulo (o da UART primeiro) e,
+ *                  se o AT+RX mostrar outra configuracao que a gravada (ou o
+ *                  padrao de fabrica, sem HC12_CONFIG_PATH), grava FU e baud
+ *  HC12_JOB_SCAN   so pelo comando RADIO_SCAN: tenta hc12Candidates[] da mais
+ *                  rapida para a mais lenta e fica com a primeira em que o
+ *                  controle confirma um quadro de telemetria; o resultado,
+ *                  ou o padrao de fabrica sem resposta, vai para HC12_CONFIG_PATH
+ *  HC12_JOB_BENCH  em cada candidata mede HC12_BENCH_ROUNDS voltas de "AT"
+ *                  (p50/p90/p99/max) e a volta do quadro ate o controle, e no
+ *                  fim volta para a configuracao gravada
+ *
+ * Os dois lados precisam da mesma FU e da mesma taxa no ar para se ouvir, entao
+ * a busca acha a configuracao em que o controle esta. Sem nenhuma resposta o
+ * modulo volta para o padrao de fabrica (FU3, 9600), o dos controles novos.
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+#define HC12_CONFIG_PATH "/.player/radio.cfg"
+#define HC12_CONFIG_MAGIC 0x32314348 // "HC12"
+#define HC12_DEFAULT_FU 3
+#define HC12_DEFAULT_BAUD 9600
+#define HC12_ENTER_DELAY 50 // ms com o SET baixo antes do primeiro comando (o modulo pede 40)
+#define HC12_EXIT_DELAY 80 // ms ate o modulo voltar ao modo transparente
+#define HC12_COMMAND_TIMEOUT 200 // ms alem do tempo dos bytes da resposta
+#define HC12_RESPONSE_BYTES 64 // Maior resposta (AT+RX)
+#define HC12_LINK_TIMEOUT 400 // ms esperando o controle confirmar o quadro de teste, mais o tempo no ar
+#define HC12_LINK_TRIES 3
+#define HC12_BENCH_ROUNDS 32
+#define HC12_LINE_SIZE 24
+
+#define HC12_JOB_NONE 0
+#define HC12_JOB_APPLY 1
+#define HC12_JOB_SCAN 2
+#define HC12_JOB_BENCH 3
+
+struct RadioSetting {
+  uint32_t baud;
+  uint8_t fu;
+};
+
+struct RadioConfig {
+  uint32_t magic;
+  uint32_t baud;
+  uint8_t fu;
+  uint8_t reserved[3];
+  uint32_t crc; // CRC-32 dos campos acima
+};
+
+void hc12Begin(void);
+void hc12Request(uint8_t job);
+bool hc12Step(void);
+bool hc12Busy(void);
+void hc12Watch(void);
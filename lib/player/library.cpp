@@ -0,0 +1,519 @@
+#include "library.h"
+#include "search.h"
+#include "format.h"
+#include <string.h>
+#include <stdlib.h>
+
+const char* fileTypeNames[FILE_TYPE_COUNT] = { "mp3", "wav", "aac", "m4a" };
+
+uint8_t *libraryArena = NULL;
+uint32_t libraryArenaSize = 0;
+struct Folder *folders;
+uint32_t *libraryFiles;
+uint8_t *libraryFileTypes;
+char *libraryNames;
+uint32_t libraryFileCounter = 0;
+uint32_t libraryNamesSize = 0;
+uint16_t folderCounter = 0;
+uint32_t libraryIndexFlags = 0;
+
+// Pasta encontrada durante a contagem, antes de a arena existir
+struct FolderScan {
+  const char *path;
+  int32_t source; // Pasta equivalente na biblioteca anterior, -1 se nova
+  uint32_t nameHash;
+  uint32_t entryCounter;
+  uint16_t fileCounter;
+  uint32_t nameBytes;
+  bool rescan;
+};
+
+uint32_t rejectedFiles = 0; // Arquivos com extensao de audio e cabecalho de outra coisa
+
+struct FolderScan* scanFolderList(char **pathBlob, uint16_t *scanCounter);
+void countFolderFiles(HalFile &dir, struct FolderScan *scan);
+uint16_t fillFolderFiles(HalFile &dir, uint32_t *files, uint8_t *fileTypes, char *names, uint32_t *namePos, struct FolderScan *scan);
+int compareScanPaths(const void *a, const void *b);
+int compareFileNames(const void *a, const void *b);
+void sortFolderNames(uint32_t *files, uint16_t count, char *names, uint32_t start);
+void reverseBytes(char *first, char *last);
+
+const char *sortNames; // Nomes da arena que o compareFileNames() usa
+
+void mountSdStruct() {
+  uint32_t startTime = halMillis();
+  rejectedFiles = 0;
+  bool fromIndex = loadLibraryIndex();
+  bool listChanged = !fromIndex;
+
+  // A impressao da raiz tambem cobre os nomes das pastas
+  uint32_t rootHash = 0;
+  uint32_t rootEntries = 0;
+  folderFingerprint("/", &rootHash, &rootEntries);
+  if(fromIndex) listChanged = folders[SD_ROOT].nameHash != rootHash || folders[SD_ROOT].entryCounter != rootEntries;
+
+  // Passo de contagem: descobre quantas faixas e quantos bytes de nome cada pasta tem
+  char *pathBlob = NULL;
+  uint16_t scanCounter = 0;
+  struct FolderScan *scan;
+  if(listChanged) scan = scanFolderList(&pathBlob, &scanCounter);
+  else {
+    scanCounter = folderCounter;
+    scan = (struct FolderScan*)malloc(sizeof(struct FolderScan) * scanCounter);
+    for(uint16_t i = 0; i < scanCounter; i++) {
+      scan[i].path = getFolderName(i);
+      scan[i].source = i;
+    }
+  }
+
+  uint16_t rescanned = 0;
+  uint32_t fileCounter = 0;
+  uint32_t namesSize = 0;
+  for(uint16_t i = 0; i < scanCounter; i++) {
+    if(i == SD_ROOT) {
+      scan[i].nameHash = rootHash;
+      scan[i].entryCounter = rootEntries;
+    }
+    else folderFingerprint(scan[i].path, &scan[i].nameHash, &scan[i].entryCounter);
+    scan[i].rescan = scan[i].source < 0 ||
+      folders[scan[i].source].nameHash != scan[i].nameHash ||
+      folders[scan[i].source].entryCounter != scan[i].entryCounter;
+
+    HalFile dir;
+    if(scan[i].rescan) {
+      dir.open(scan[i].path);
+      countFolderFiles(dir, &scan[i]);
+      rescanned++;
+    }
+    else {
+      struct Folder *source = &folders[scan[i].source];
+      scan[i].fileCounter = source->fileCounter;
+      scan[i].nameBytes = 0;
+      for(uint16_t j = 0; j < source->fileCounter; j++) {
+        scan[i].nameBytes += strlen(libraryNames + libraryFiles[source->firstFile + j]) + 1;
+      }
+    }
+    dir.close();
+
+    fileCounter += scan[i].fileCounter;
+    namesSize += strlen(scan[i].path) + 1 + scan[i].nameBytes;
+  }
+
+  // Passo de preenchimento: aloca a arena com o tamanho exato e copia os nomes
+  if(listChanged || rescanned) {
+    uint32_t arenaSize = libraryArenaBytes(scanCounter, fileCounter, namesSize);
+    uint8_t *arena = (uint8_t*)malloc(arenaSize);
+    if(arena == NULL) {
+      halLogf("ERR: Sem memoria para a biblioteca (%lu bytes)\n", (unsigned long)arenaSize);
+      free(scan);
+      free(pathBlob);
+      return;
+    }
+
+    struct Folder *newFolders = (struct Folder*)arena;
+    uint32_t *newFiles = (uint32_t*)(arena + sizeof(struct Folder) * scanCounter);
+    uint8_t *newFileTypes = (uint8_t*)(newFiles + fileCounter + scanCounter + fileCounter);
+    char *newNames = (char*)(arena + arenaSize - namesSize);
+    uint32_t file = 0;
+    uint32_t namePos = 0;
+
+    for(uint16_t i = 0; i < scanCounter; i++) {
+      struct Folder *folder = &newFolders[i];
+      folder->name = namePos;
+      strcpy(newNames + namePos, scan[i].path);
+      namePos += strlen(scan[i].path) + 1;
+      folder->firstFile = file;
+      folder->nameHash = scan[i].nameHash;
+      folder->entryCounter = scan[i].entryCounter;
+      folder->reserved = 0;
+
+      if(scan[i].rescan) {
+        HalFile dir;
+        dir.open(scan[i].path);
+        folder->fileCounter = fillFolderFiles(dir, newFiles + file, newFileTypes + file, newNames, &namePos, &scan[i]);
+        dir.close();
+      }
+      else {
+        struct Folder *source = &folders[scan[i].source];
+        for(uint16_t j = 0; j < source->fileCounter; j++) {
+          const char *name = libraryNames + libraryFiles[source->firstFile + j];
+          newFiles[file + j] = namePos;
+          newFileTypes[file + j] = libraryFileTypes[source->firstFile + j];
+          strcpy(newNames + namePos, name);
+          namePos += strlen(name) + 1;
+        }
+        folder->fileCounter = source->fileCounter;
+      }
+      file += folder->fileCounter;
+    }
+
+    // Alguma pasta mudou entre as passadas: junta os tipos e nomes no espaco contado
+    if(file != fileCounter || namePos != namesSize) {
+      uint32_t compactSize = libraryArenaBytes(scanCounter, file, namePos);
+      memmove(newFiles + file + scanCounter + file, newFileTypes, file);
+      memmove(arena + compactSize - namePos, newNames, namePos);
+      arena = (uint8_t*)realloc(arena, compactSize);
+    }
+
+    free(libraryArena);
+    setLibraryArena(arena, scanCounter, file, namePos);
+    buildSearchIndex();
+    saveLibraryIndex();
+  }
+
+  free(scan);
+  free(pathBlob);
+
+  halLogf(
+    "Biblioteca: %s em %lu ms (%u pastas, %lu faixas, %u pastas varridas, %lu arquivos ignorados)\n",
+    fromIndex ? "indice carregado" : "varredura completa",
+    (unsigned long)(halMillis() - startTime),
+    folderCounter,
+    (unsigned long)libraryFileCounter,
+    rescanned,
+    (unsigned long)rejectedFiles
+  );
+  halLogf(
+    "Biblioteca: %lu bytes na arena, %lu bytes/faixa, heap livre %lu, maior bloco %lu\n",
+    (unsigned long)libraryArenaSize,
+    (unsigned long)(libraryFileCounter ? libraryArenaSize / libraryFileCounter : 0),
+    (unsigned long)halFreeHeap(),
+    (unsigned long)halMaxAllocHeap()
+  );
+}
+
+// Esquece a biblioteca da memoria; o proximo mountSdStruct() nao reaproveita nada
+void clearLibrary() {
+  free(libraryArena);
+  libraryArena = NULL;
+  libraryArenaSize = 0;
+  folderCounter = 0;
+  libraryFileCounter = 0;
+  libraryNamesSize = 0;
+  libraryIndexFlags = 0;
+  searchIndex = NULL;
+  searchCounter = 0;
+}
+
+/**
+ * Le a lista de pastas da raiz em duas passadas: a primeira conta as pastas e
+ * o tamanho dos nomes, a segunda copia os caminhos para um unico bloco.
+ * Pastas que ja existiam na biblioteca apontam para ela em source. A ordem e a
+ * do strcmp() dos nomes, nao a do diretorio: o FAT devolve na ordem de
+ * criacao e o host na dele, e o indice tem que sair igual nos dois.
+ */
+struct FolderScan* scanFolderList(char **pathBlob, uint16_t *scanCounter) {
+  uint16_t count = 1;
+  uint32_t pathBytes = 2;
+
+  HalFile root;
+  HalFile file;
+  root.open("/");
+  while(root.openNext(file)) {
+    if(file.isDirectory() && file.name()[0] != '.') {
+      count++;
+      pathBytes += strlen(file.name()) + 2;
+    }
+  }
+
+  struct FolderScan *scan = (struct FolderScan*)malloc(sizeof(struct FolderScan) * count);
+  char *paths = (char*)malloc(pathBytes);
+  uint32_t pathPos = 0;
+
+  strcpy(paths, "/");
+  scan[SD_ROOT].path = paths;
+  scan[SD_ROOT].source = folderCounter > 0 ? SD_ROOT : -1;
+  pathPos += 2;
+
+  uint16_t i = 1;
+  root.rewind();
+  while(i < count && root.openNext(file)) {
+    if(file.isDirectory() && file.name()[0] != '.') {
+      char *path = paths + pathPos;
+      path[0] = '/';
+      strcpy(path + 1, file.name());
+      pathPos += strlen(path) + 1;
+
+      scan[i].path = path;
+      scan[i].source = -1;
+      for(uint16_t j = 1; j < folderCounter; j++) {
+        if(strcmp(getFolderName(j), path) == 0) {
+          scan[i].source = j;
+          break;
+        }
+      }
+      i++;
+    }
+  }
+  file.close();
+  root.close();
+  qsort(scan + 1, i - 1, sizeof(struct FolderScan), compareScanPaths);
+
+  *pathBlob = paths;
+  *scanCounter = i;
+  return scan;
+}
+
+void countFolderFiles(HalFile &dir, struct FolderScan *scan) {
+  scan->fileCounter = 0;
+  scan->nameBytes = 0;
+  if(!dir.isOpen()) return;
+
+  HalFile file;
+  while(dir.openNext(file)) {
+    const char *name = file.name();
+    if(!file.isDirectory() && name[0] != '.') {
+      if(fileTypeFromName(name) != FILE_TYPE_UNKNOWN) {
+        scan->fileCounter++;
+        scan->nameBytes += strlen(name) + 1;
+      }
+    }
+  }
+}
+
+/**
+ * Copia as faixas de dir para a arena nova, com os nomes a partir de *namePos.
+ * Nunca passa do que foi contado em countFolderFiles, caso a pasta mude entre as passadas.
+ * So aqui o cabecalho e lido: a contagem confia na extensao e os arquivos
+ * recusados sobram como espaco que mountSdStruct() compacta. As faixas saem
+ * em ordem de strcmp() do nome, como as pastas.
+ */
+uint16_t fillFolderFiles(HalFile &dir, uint32_t *files, uint8_t *fileTypes, char *names, uint32_t *namePos, struct FolderScan *scan) {
+  uint16_t filled = 0;
+  uint32_t nameBytes = 0;
+  uint32_t start = *namePos;
+  if(!dir.isOpen()) return 0;
+
+  HalFile entry;
+  while(filled < scan->fileCounter && dir.openNext(entry)) {
+    const char *name = entry.name();
+    uint32_t nameSize = strlen(name) + 1;
+    if(!entry.isDirectory() && name[0] != '.') {
+      uint8_t type = fileTypeFromName(name);
+      if(type != FILE_TYPE_UNKNOWN && probeFileType(entry, type) != type) {
+        halLogf("Biblioteca: ignorando %s/%s, cabecalho nao e %s\n", scan->path[1] ? scan->path : "", name, fileTypeNames[type]);
+        rejectedFiles++;
+        type = FILE_TYPE_UNKNOWN;
+      }
+      if(type != FILE_TYPE_UNKNOWN) {
+        if(nameBytes + nameSize > scan->nameBytes) break;
+        files[filled] = *namePos;
+        fileTypes[filled] = type;
+        memcpy(names + *namePos, name, nameSize);
+        *namePos += nameSize;
+        nameBytes += nameSize;
+        filled++;
+      }
+    }
+  }
+
+  // Tipos recusados ja sairam, entao o tipo de cada faixa e o da extensao
+  sortFolderNames(files, filled, names, start);
+  for(uint16_t i = 0; i < filled; i++) fileTypes[i] = fileTypeFromName(names + files[i]);
+  return filled;
+}
+
+/**
+ * Ordena as faixas da pasta e os nomes delas na arena, que comecam em start:
+ * cada nome e girado para o lugar dele, sem memoria extra, para o indice nao
+ * depender da ordem em que o diretorio devolveu os arquivos.
+ */
+void sortFolderNames(uint32_t *files, uint16_t count, char *names, uint32_t start) {
+  sortNames = names;
+  qsort(files, count, sizeof(uint32_t), compareFileNames);
+
+  uint32_t pos = start;
+  for(uint16_t i = 0; i < count; i++) {
+    uint32_t from = files[i];
+    uint32_t size = strlen(names + from) + 1;
+    if(from != pos) {
+      reverseBytes(names + pos, names + from);
+      reverseBytes(names + from, names + from + size);
+      reverseBytes(names + pos, names + from + size);
+      for(uint16_t j = i + 1; j < count; j++) {
+        if(files[j] < from) files[j] += size;
+      }
+      files[i] = pos;
+    }
+    pos += size;
+  }
+}
+
+void reverseBytes(char *first, char *last) {
+  while(first < --last) {
+    char c = *first;
+    *first++ = *last;
+    *last = c;
+  }
+}
+
+int compareScanPaths(const void *a, const void *b) {
+  return strcmp(((const struct FolderScan*)a)->path, ((const struct FolderScan*)b)->path);
+}
+
+int compareFileNames(const void *a, const void *b) {
+  return strcmp(sortNames + *(const uint32_t*)a, sortNames + *(const uint32_t*)b);
+}
+
+uint32_t libraryArenaBytes(uint16_t _folderCounter, uint32_t _fileCounter, uint32_t _namesSize) {
+  uint32_t typesSize = (_fileCounter + 3) & ~3;
+  uint32_t searchSize = sizeof(uint32_t) * (_folderCounter + _fileCounter);
+  return sizeof(struct Folder) * _folderCounter + sizeof(uint32_t) * _fileCounter + searchSize + typesSize + _namesSize;
+}
+
+void setLibraryArena(uint8_t *arena, uint16_t _folderCounter, uint32_t _fileCounter, uint32_t _namesSize) {
+  libraryArena = arena;
+  libraryArenaSize = libraryArenaBytes(_folderCounter, _fileCounter, _namesSize);
+  folderCounter = _folderCounter;
+  libraryFileCounter = _fileCounter;
+  libraryNamesSize = _namesSize;
+  folders = (struct Folder*)arena;
+  libraryFiles = (uint32_t*)(arena + sizeof(struct Folder) * _folderCounter);
+  searchIndex = libraryFiles + _fileCounter;
+  searchCounter = searchEntryCount();
+  libraryFileTypes = (uint8_t*)(searchIndex + _folderCounter + _fileCounter);
+  libraryNames = (char*)(arena + libraryArenaSize - _namesSize);
+  // Alinhamento depois dos tipos: zerado para o indice sair igual byte a byte
+  memset(libraryFileTypes + _fileCounter, 0, (uint8_t*)libraryNames - libraryFileTypes - _fileCounter);
+}
+
+const char* getFolderName(uint16_t folder) {
+  return libraryNames + folders[folder].name;
+}
+
+const char* getFileName(uint16_t folder, uint16_t file) {
+  return libraryNames + libraryFiles[folders[folder].firstFile + file];
+}
+
+uint8_t getFileType(uint16_t folder, uint16_t file) {
+  return libraryFileTypes[folders[folder].firstFile + file];
+}
+
+bool loadLibraryIndex() {
+  HalFile idx;
+  if(!idx.open(LIBRARY_INDEX_PATH)) return false;
+
+  struct LibraryIndexHeader header = {}; // Leitura curta fica com magic 0 e cai no invalido
+  uint32_t arenaSize = 0;
+  if(idx.read(&header, sizeof(header)) == sizeof(header)) {
+    arenaSize = libraryArenaBytes(header.folderCounter, header.fileCounter, header.namesSize);
+  }
+  if(
+    header.magic != LIBRARY_INDEX_MAGIC ||
+    header.version != LIBRARY_INDEX_VERSION ||
+    header.folderCounter == 0 ||
+    header.namesSize == 0 ||
+    arenaSize != idx.size() - sizeof(header)
+  ) {
+    halLogf("Indice da biblioteca invalido, refazendo varredura\n");
+    idx.close();
+    return false;
+  }
+
+  uint8_t *arena = (uint8_t*)malloc(arenaSize);
+  if(arena == NULL || idx.read(arena, arenaSize) != arenaSize) {
+    free(arena);
+    idx.close();
+    return false;
+  }
+  idx.close();
+
+  // Confere os offsets antes de confiar no indice
+  struct Folder *indexFolders = (struct Folder*)arena;
+  uint32_t *indexFiles = (uint32_t*)(arena + sizeof(struct Folder) * header.folderCounter);
+  uint32_t *indexSearch = indexFiles + header.fileCounter;
+  uint32_t searchEntries = header.folderCounter + header.fileCounter;
+  uint8_t *indexFileTypes = (uint8_t*)(indexSearch + searchEntries);
+  char *indexNames = (char*)(arena + arenaSize - header.namesSize);
+  bool valid = indexNames[header.namesSize - 1] == '\0';
+  uint32_t file = 0;
+  for(uint16_t i = 0; valid && i < header.folderCounter; i++) {
+    valid = indexFolders[i].name < header.namesSize && indexFolders[i].firstFile == file;
+    file += indexFolders[i].fileCounter;
+  }
+  valid = valid && file == header.fileCounter;
+  for(uint32_t i = 0; valid && i < header.fileCounter; i++) {
+    valid = indexFiles[i] < header.namesSize && indexFileTypes[i] < FILE_TYPE_COUNT;
+  }
+  for(uint32_t i = 0; valid && i < searchEntries; i++) {
+    valid = indexSearch[i] < searchEntries;
+  }
+  if(!valid) {
+    halLogf("Indice da biblioteca corrompido, refazendo varredura\n");
+    free(arena);
+    return false;
+  }
+
+  free(libraryArena);
+  setLibraryArena(arena, header.folderCounter, header.fileCounter, header.namesSize);
+  libraryIndexFlags = header.flags;
+  return true;
+}
+
+/**
+ * Entradas visiveis da pasta e a soma do FNV-1a de cada nome (com o tipo e o
+ * tamanho do arquivo): a soma nao depende da ordem em que o readdir devolve os
+ * nomes, entao o host e a placa chegam ao mesmo valor. O tamanho pega o
+ * arquivo trocado por outro de mesmo nome. Pasta que nao abre fica com 0 e 0.
+ */
+bool folderFingerprint(const char *path, uint32_t *nameHash, uint32_t *entryCounter) {
+  *nameHash = 0;
+  *entryCounter = 0;
+  HalDir dir;
+  if(!dir.open(path)) return false;
+
+  const char *name;
+  bool isDirectory;
+  uint32_t size;
+  while(dir.next(&name, &isDirectory, &size)) {
+    if(name[0] == '.') continue;
+    uint32_t hash = (LIBRARY_HASH_SEED ^ (isDirectory ? 1 : 0)) * LIBRARY_HASH_PRIME;
+    for(const char *c = name; *c != '\0'; c++) hash = (hash ^ (uint8_t)*c) * LIBRARY_HASH_PRIME;
+    for(uint8_t shift = 0; shift < 32; shift += 8) hash = (hash ^ (uint8_t)(size >> shift)) * LIBRARY_HASH_PRIME;
+    *nameHash += hash;
+    (*entryCounter)++;
+  }
+  dir.close();
+  return true;
+}
+
+bool saveLibraryIndex() {
+  struct LibraryIndexHeader header;
+  header.magic = LIBRARY_INDEX_MAGIC;
+  header.version = LIBRARY_INDEX_VERSION;
+  header.folderCounter = folderCounter;
+  header.fileCounter = libraryFileCounter;
+  header.namesSize = libraryNamesSize;
+  header.flags = libraryIndexFlags;
+
+  if(!halFsExists(LIBRARY_INDEX_DIR)) halFsMkdir(LIBRARY_INDEX_DIR);
+  HalFile idx;
+  if(!idx.open(LIBRARY_INDEX_TMP_PATH, HAL_FILE_WRITE)) {
+    halLogf("ERR: Nao foi possivel gravar o indice da biblioteca\n");
+    return false;
+  }
+
+  size_t written = idx.write(&header, sizeof(header));
+  written += idx.write(libraryArena, libraryArenaSize);
+  idx.close();
+
+  if(written != sizeof(header) + libraryArenaSize) {
+    halLogf("ERR: Indice da biblioteca gravado incompleto\n");
+    halFsRemove(LIBRARY_INDEX_TMP_PATH);
+    return false;
+  }
+
+  halFsRemove(LIBRARY_INDEX_PATH);
+  return halFsRename(LIBRARY_INDEX_TMP_PATH, LIBRARY_INDEX_PATH);
+}
+
+uint16_t findFolderByTrack(uint32_t track) {
+  uint16_t low = 0;
+  uint16_t high = folderCounter - 1;
+  while(low < high) {
+    uint16_t mid = (low + high + 1) / 2;
+    if(folders[mid].firstFile <= track) low = mid;
+    else high = mid - 1;
+  }
+  return low;
+}
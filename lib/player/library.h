@@ -0,0 +1,93 @@
+/**
+ * Biblioteca de pastas e faixas do cartao, com indice gravado no proprio cartao
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include "hal.h"
+
+#define SD_ROOT 0
+#define FILE_ROOT 0
+#define maxFileNameSize 128
+
+// Indice da biblioteca gravado no cartao para evitar a varredura completa no boot
+// Fica numa pasta oculta para que gravar o indice nao altere a data da raiz
+#define LIBRARY_INDEX_DIR "/.player"
+#define LIBRARY_INDEX_PATH "/.player/library.idx"
+#define LIBRARY_INDEX_TMP_PATH "/.player/library.tmp"
+#define LIBRARY_INDEX_MAGIC 0x49334D50 // "PM3I"
+#define LIBRARY_INDEX_VERSION 7
+// Indice gerado no host (src/cardtool); a impressao das pastas sai igual a da placa
+#define LIBRARY_INDEX_OFFLINE 0x1
+#define LIBRARY_HASH_SEED 2166136261u // FNV-1a dos nomes na impressao das pastas
+#define LIBRARY_HASH_PRIME 16777619u
+
+#define FILE_TYPE_MP3 0
+#define FILE_TYPE_WAV 1
+#define FILE_TYPE_AAC 2
+#define FILE_TYPE_M4A 3
+#define FILE_TYPE_COUNT 4
+#define FILE_TYPE_UNKNOWN 0xFF
+
+/**
+ * A biblioteca inteira fica numa unica alocacao (libraryArena):
+ *  folders[folderCounter] | libraryFiles[libraryFileCounter] |
+ *  searchIndex[folderCounter + libraryFileCounter] | libraryFileTypes[libraryFileCounter] | libraryNames
+ * Os nomes ficam todos em libraryNames, separados por '\0', e pastas e faixas
+ * guardam apenas o offset do nome. As faixas de uma pasta sao contiguas a
+ * partir de firstFile, entao firstFile + fileIndex e o id global da faixa.
+ * A ordem de busca (search.h) tambem fica na arena, entao vem pronta do indice.
+ */
+/**
+ * Mudanca numa pasta e vista pela impressao (folderFingerprint), tirada so com
+ * readdir e o tamanho de cada arquivo: o FAT do IDF devolve data e tamanho 0
+ * para a raiz, pastas no FAT tem tamanho 0 e nem o FatFs nem o Windows mudam a
+ * data de uma pasta quando um arquivo entra nela.
+ */
+struct Folder {
+  uint32_t name;
+  uint32_t firstFile;
+  uint32_t nameHash; // Impressao da pasta na varredura: soma do hash de cada nome
+  uint32_t entryCounter; // e quantas entradas visiveis ela tinha
+  uint16_t fileCounter;
+  uint16_t reserved;
+};
+
+/**
+ * O arquivo LIBRARY_INDEX_PATH e o LibraryIndexHeader seguido da libraryArena
+ * exatamente como fica na memoria, entao carregar e uma unica leitura.
+ */
+struct LibraryIndexHeader {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t folderCounter;
+  uint32_t fileCounter;
+  uint32_t namesSize;
+  uint32_t flags;
+};
+
+extern const char* fileTypeNames[FILE_TYPE_COUNT];
+extern uint8_t *libraryArena;
+extern uint32_t libraryArenaSize;
+extern struct Folder *folders;
+extern uint32_t *libraryFiles;
+extern uint8_t *libraryFileTypes;
+extern char *libraryNames;
+extern uint32_t libraryFileCounter;
+extern uint32_t libraryNamesSize;
+extern uint16_t folderCounter;
+extern uint32_t libraryIndexFlags;
+
+void mountSdStruct(void);
+void clearLibrary(void);
+bool loadLibraryIndex(void);
+bool saveLibraryIndex(void);
+bool folderFingerprint(const char *path, uint32_t *nameHash, uint32_t *entryCounter);
+uint32_t libraryArenaBytes(uint16_t _folderCounter, uint32_t _fileCounter, uint32_t _namesSize);
+void setLibraryArena(uint8_t *arena, uint16_t _folderCounter, uint32_t _fileCounter, uint32_t _namesSize);
+const char* getFolderName(uint16_t folder);
+const char* getFileName(uint16_t folder, uint16_t file);
+uint8_t getFileType(uint16_t folder, uint16_t file);
+uint16_t findFolderByTrack(uint32_t track);
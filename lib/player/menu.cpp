@@ -0,0 +1,89 @@
+#include "menu.h"
+#include "player.h"
+#include "events.h"
+#include <string.h>
+
+struct Menu menu;
+
+void menuOpen() {
+  menu.active = true;
+  menu.length = 0;
+  menu.prefix[0] = '\0';
+  menu.letter = searchNextLetter(menu.prefix, 0, 0, 1);
+  menuUpdateResults();
+}
+
+void menuClose() {
+  menu.active = false;
+  menu.version++;
+}
+
+// Devolve false para os eventos que o menu nao usa, que seguem o caminho normal
+bool menuHandleEvent(uint8_t type) {
+  switch (type)
+  {
+    case VOLUME_UP_EVENT:
+    case VOLUME_DOWN_EVENT: {
+      int8_t direction = type == VOLUME_UP_EVENT ? 1 : -1;
+      char letter = searchNextLetter(menu.prefix, menu.length, menu.letter, direction);
+      // No fim do alfabeto volta para a primeira (ou ultima) letra
+      if(letter == 0) letter = searchNextLetter(menu.prefix, menu.length, 0, direction);
+      menu.letter = letter;
+      break;
+    }
+    case NEXT_SONG_EVENT: {
+      if(menu.letter == 0) break;
+      menu.prefix[menu.length++] = menu.letter;
+      menu.prefix[menu.length] = '\0';
+      menu.letter = searchNextLetter(menu.prefix, menu.length, 0, 1);
+      menuUpdateResults();
+      break;
+    }
+    case PREVIUS_SONG_EVENT: {
+      if(menu.length == 0) {
+        menuClose();
+        return true;
+      }
+      menu.letter = menu.prefix[--menu.length];
+      menu.prefix[menu.length] = '\0';
+      menuUpdateResults();
+      break;
+    }
+    case RANDOM_EVENT: {
+      if(menu.count > 0) menu.selected = (menu.selected + 1) % menu.count;
+      break;
+    }
+    case PLAY_PAUSE_SONG_EVENT: {
+      menuPlaySelected();
+      return true;
+    }
+    case MAIN_MENU_EVENT: {
+      menuClose();
+      return true;
+    }
+    default: return false;
+  }
+  menu.version++;
+  return true;
+}
+
+void menuUpdateResults() {
+  menu.first = searchLowerBound(menu.prefix, menu.length);
+  menu.count = searchUpperBound(menu.prefix, menu.length) - menu.first;
+  menu.selected = 0;
+  menu.version++;
+}
+
+void menuPlaySelected() {
+  if(menu.count == 0) return;
+
+  uint32_t entry = searchIndex[menu.first + menu.selected];
+  menuClose();
+  if(searchIsFolder(entry)) {
+    loadSD(FILE_ROOT, entry);
+    return;
+  }
+  uint32_t track = entry - folderCounter;
+  uint16_t folder = findFolderByTrack(track);
+  loadSD(track - folders[folder].firstFile, folder);
+}
@@ -0,0 +1,36 @@
+/**
+ * Menu de busca aberto pelo MAIN_MENU (segurar o botao de repeat ou o comando
+ * do controle). Com o menu aberto os mesmos eventos mudam de funcao:
+ *  - VOLUME_UP / VOLUME_DOWN: proxima / anterior letra que existe depois do prefixo
+ *  - NEXT_SONG: acrescenta a letra ao prefixo
+ *  - PREVIUS_SONG: apaga a ultima letra; com o prefixo vazio fecha o menu
+ *  - RANDOM: passa para o proximo resultado
+ *  - PLAY_PAUSE: toca o resultado escolhido (pasta toca a primeira faixa) e fecha
+ *  - MAIN_MENU: fecha sem tocar nada
+ * Cada passo e uma ou duas buscas binarias em searchIndex.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include "search.h"
+
+#define MENU_RESULT_LINES 5 // Resultados que cabem na tela abaixo do prefixo
+
+struct Menu {
+  bool active;
+  char prefix[SEARCH_PREFIX_SIZE];
+  uint8_t length;
+  char letter;       // Letra candidata, 0 se nenhum nome continua o prefixo
+  uint32_t first;    // Posicao do primeiro resultado em searchIndex
+  uint32_t count;
+  uint32_t selected; // Resultado escolhido, de 0 a count - 1
+  uint32_t version;  // Muda a cada passo para a tela saber que precisa redesenhar
+};
+extern struct Menu menu;
+
+void menuOpen(void);
+void menuClose(void);
+bool menuHandleEvent(uint8_t type);
+void menuUpdateResults(void);
+void menuPlaySelected(void);
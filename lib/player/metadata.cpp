@@ -0,0 +1,782 @@
+#include "metadata.h"
+#include "library.h"
+#include "player.h"
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#define TAGS_HASH_SEED 2166136261u
+#define TAGS_HASH_PRIME 16777619u
+#define TAGS_ZERO_BLOCK 8 // Registros vazios gravados por vez ao crescer o cache
+
+#define ID3_ENCODING_LATIN1 0
+#define ID3_ENCODING_UTF16 1
+#define ID3_ENCODING_UTF16BE 2
+#define ID3_ENCODING_UTF8 3
+
+// Latin-1 0xC0..0xFF sem acento; a fonte do display nao tem esses caracteres
+const char latin1Fold[] = "AAAAAAACEEEEIIIIDNOOOOOxOUUUUYPsaaaaaaaceeeeiiiidnooooo/ouuuuypy";
+
+HalFile tagsFile;
+bool tagsOpen = false;
+bool tagsFailed = false;
+struct TagsHeader tagsHeader;
+uint32_t tagsRecords = 0; // Registros que existem no arquivo
+uint32_t tagsBase = 0; // Onde comeca o registro da faixa 0: cabecalho e tabela de pastas
+uint32_t tagsSinceCursor = 0;
+uint32_t tagsScanStart = 0;
+
+// Pedido do loop e resposta da tarefa das tags
+volatile uint32_t tagsWanted = TAGS_NO_TRACK;
+volatile uint32_t tagsReadyTrack = TAGS_NO_TRACK;
+struct TrackTags tagsReady;
+
+bool openTagsCache(void);
+void fillTagsFolder(uint16_t folder, struct TagsFolder *entry);
+bool tagsFoldersMatch(void);
+bool rebuildTagsCache(void);
+bool readTagsRecord(uint32_t track, struct TrackTags *tags);
+bool writeTagsRecord(uint32_t track, struct TrackTags *tags);
+bool writeTagsHeader(void);
+void loadTrackTags(uint32_t track, struct TrackTags *tags);
+bool findAtom(HalFile &file, uint32_t start, uint32_t end, const char *type, uint32_t *content, uint32_t *contentEnd, uint8_t *budget);
+uint32_t readMp3Duration(HalFile &file);
+uint32_t readWavDuration(HalFile &file);
+bool findWavData(HalFile &file, uint8_t *format, uint32_t *data, uint32_t *dataSize);
+bool readReplayGainText(const uint8_t *text, uint32_t length, uint8_t encoding, int16_t *gain);
+uint32_t readMp4Duration(HalFile &file);
+uint32_t readBigEndian(const uint8_t *data, uint8_t length);
+uint32_t readLittleEndian(const uint8_t *data, uint8_t length);
+uint32_t readSyncsafe(const uint8_t *data);
+char foldCodepoint(uint32_t codepoint);
+
+/**
+ * Uma faixa por chamada: primeiro a pedida pelo loop, depois a proxima do
+ * cursor. Devolve false quando nao ha mais nada a fazer.
+ */
+bool metadataStep() {
+  if(tagsFailed || libraryFileCounter == 0) return false;
+  if(!tagsOpen && !openTagsCache()) {
+    tagsFailed = true;
+    halLogf("ERR: Nao foi possivel abrir o cache de tags\n");
+    return false;
+  }
+
+  uint32_t wanted = tagsWanted;
+  if(wanted != TAGS_NO_TRACK && wanted != tagsReadyTrack && wanted < libraryFileCounter) {
+    struct TrackTags tags;
+    loadTrackTags(wanted, &tags);
+    // Invalida antes de copiar, para metadataTake() nunca ler um registro pela metade
+    __atomic_store_n(&tagsReadyTrack, TAGS_NO_TRACK, __ATOMIC_RELEASE);
+    tagsReady = tags;
+    __atomic_store_n(&tagsReadyTrack, wanted, __ATOMIC_RELEASE);
+    return true;
+  }
+
+  if(tagsHeader.nextTrack >= tagsHeader.trackCount) return false;
+  struct TrackTags tags;
+  loadTrackTags(tagsHeader.nextTrack, &tags);
+  tagsHeader.nextTrack++;
+
+  bool done = tagsHeader.nextTrack == tagsHeader.trackCount;
+  if(++tagsSinceCursor >= TAGS_CURSOR_EVERY || done) {
+    tagsSinceCursor = 0;
+    writeTagsHeader();
+  }
+  if(done) {
+    halLogf(
+      "Tags: %lu faixas lidas em %lu ms\n",
+      (unsigned long)tagsHeader.trackCount,
+      (unsigned long)(halMillis() - tagsScanStart)
+    );
+  }
+  return true;
+}
+
+/**
+ * Registro gravado da faixa, sem ler o arquivo de audio; o cardtool usa junto
+ * com metadataStoreGain() para completar o ganho que so o host sabe medir.
+ */
+bool metadataRecord(uint32_t track, struct TrackTags *tags) {
+  if(!tagsOpen || track >= libraryFileCounter) return false;
+  return readTagsRecord(track, tags) && tags->status != TAG_NOT_SCANNED;
+}
+
+bool metadataStoreGain(uint32_t track, int16_t gain) {
+  struct TrackTags tags;
+  if(!metadataRecord(track, &tags)) return false;
+  tags.gain = gain;
+  return writeTagsRecord(track, &tags);
+}
+
+void metadataRequest(uint32_t track) {
+  tagsWanted = track;
+  halWakeTags();
+}
+
+// Fecha o cache; a proxima chamada de metadataStep() abre de novo (usado pelo cardtool)
+void metadataClose() {
+  if(tagsOpen) writeTagsHeader();
+  tagsFile.close();
+  tagsOpen = false;
+  tagsFailed = false;
+  tagsSinceCursor = 0;
+  tagsWanted = TAGS_NO_TRACK;
+  tagsReadyTrack = TAGS_NO_TRACK;
+}
+
+bool metadataTake(uint32_t track, struct TrackTags *tags) {
+  if(__atomic_load_n(&tagsReadyTrack, __ATOMIC_ACQUIRE) != track) return false;
+  *tags = tagsReady;
+  return __atomic_load_n(&tagsReadyTrack, __ATOMIC_ACQUIRE) == track;
+}
+
+/**
+ * Abre o cache se a tabela de pastas dele for a desta biblioteca; senao monta
+ * um novo com rebuildTagsCache().
+ */
+bool openTagsCache() {
+  tagsScanStart = halMillis();
+  tagsBase = sizeof(tagsHeader) + folderCounter * sizeof(struct TagsFolder);
+
+  if(tagsFile.open(TAGS_PATH, HAL_FILE_UPDATE)) {
+    bool valid = tagsFile.read(&tagsHeader, sizeof(tagsHeader)) == sizeof(tagsHeader) &&
+      tagsHeader.magic == TAGS_MAGIC &&
+      tagsHeader.version == TAGS_VERSION &&
+      tagsHeader.recordSize == sizeof(struct TrackTags) &&
+      tagsHeader.folderCount == folderCounter &&
+      tagsHeader.trackCount == libraryFileCounter &&
+      tagsHeader.nextTrack <= tagsHeader.trackCount &&
+      tagsFoldersMatch();
+    if(valid) {
+      uint32_t size = tagsFile.size();
+      tagsRecords = size > tagsBase ? (size - tagsBase) / sizeof(struct TrackTags) : 0;
+      tagsOpen = true;
+      if(tagsHeader.nextTrack < tagsHeader.trackCount) {
+        halLogf(
+          "Tags: continuando da faixa %lu de %lu\n",
+          (unsigned long)tagsHeader.nextTrack,
+          (unsigned long)tagsHeader.trackCount
+        );
+      }
+      return true;
+    }
+    tagsFile.close();
+  }
+
+  if(!rebuildTagsCache()) return false;
+  if(!tagsFile.open(TAGS_PATH, HAL_FILE_UPDATE)) return false;
+  tagsOpen = true;
+  return true;
+}
+
+void fillTagsFolder(uint16_t folder, struct TagsFolder *entry) {
+  uint32_t hash = TAGS_HASH_SEED;
+  for(const char *c = getFolderName(folder); *c != '\0'; c++) hash = (hash ^ (uint8_t)*c) * TAGS_HASH_PRIME;
+  entry->pathHash = hash;
+  entry->nameHash = folders[folder].nameHash;
+  entry->entryCounter = folders[folder].entryCounter;
+  entry->firstFile = folders[folder].firstFile;
+  entry->fileCounter = folders[folder].fileCounter;
+  entry->reserved = 0;
+}
+
+// A tabela do arquivo aberto (logo depois do cabecalho) confere pasta a pasta
+bool tagsFoldersMatch() {
+  struct TagsFolder stored[TAGS_ZERO_BLOCK];
+  for(uint16_t i = 0; i < folderCounter; i += TAGS_ZERO_BLOCK) {
+    uint16_t count = folderCounter - i < TAGS_ZERO_BLOCK ? folderCounter - i : TAGS_ZERO_BLOCK;
+    if(tagsFile.read(stored, count * sizeof(struct TagsFolder)) != count * sizeof(struct TagsFolder)) return false;
+    for(uint16_t j = 0; j < count; j++) {
+      struct TagsFolder entry;
+      fillTagsFolder(i + j, &entry);
+      if(memcmp(&entry, &stored[j], sizeof(entry)) != 0) return false;
+    }
+  }
+  return true;
+}
+
+/**
+ * Cache novo com a tabela desta biblioteca. Os registros de uma pasta com o
+ * mesmo nome e a mesma impressao no cache anterior sao copiados de la (a ordem
+ * das faixas dentro da pasta so depende dos nomes), entao mudar uma pasta so
+ * faz reler as faixas dela. nextTrack volta a 0: o cursor passa pelos registros
+ * copiados sem abrir os arquivos.
+ */
+bool rebuildTagsCache() {
+  struct TagsHeader old;
+  struct TagsFolder *oldFolders = NULL;
+  uint32_t oldBase = 0;
+  uint32_t oldRecords = 0;
+  HalFile oldFile;
+  if(
+    oldFile.open(TAGS_PATH) &&
+    oldFile.read(&old, sizeof(old)) == sizeof(old) &&
+    old.magic == TAGS_MAGIC &&
+    old.version == TAGS_VERSION &&
+    old.recordSize == sizeof(struct TrackTags) &&
+    old.folderCount > 0
+  ) {
+    oldFolders = (struct TagsFolder*)malloc(old.folderCount * sizeof(struct TagsFolder));
+    if(oldFolders != NULL && oldFile.read(oldFolders, old.folderCount * sizeof(struct TagsFolder)) != old.folderCount * sizeof(struct TagsFolder)) {
+      free(oldFolders);
+      oldFolders = NULL;
+    }
+    oldBase = sizeof(old) + old.folderCount * sizeof(struct TagsFolder);
+    oldRecords = oldFile.size() > oldBase ? (oldFile.size() - oldBase) / sizeof(struct TrackTags) : 0;
+  }
+
+  halFsMkdir(LIBRARY_INDEX_DIR);
+  tagsHeader.magic = TAGS_MAGIC;
+  tagsHeader.version = TAGS_VERSION;
+  tagsHeader.recordSize = sizeof(struct TrackTags);
+  tagsHeader.folderCount = folderCounter;
+  tagsHeader.trackCount = libraryFileCounter;
+  tagsHeader.nextTrack = 0;
+
+  HalFile out;
+  bool written = out.open(TAGS_TMP_PATH, HAL_FILE_WRITE) && out.write(&tagsHeader, sizeof(tagsHeader)) == sizeof(tagsHeader);
+  for(uint16_t i = 0; written && i < folderCounter; i++) {
+    struct TagsFolder entry;
+    fillTagsFolder(i, &entry);
+    written = out.write(&entry, sizeof(entry)) == sizeof(entry);
+  }
+
+  // Sem cache anterior os registros so passam a existir conforme sao gravados
+  uint32_t kept = 0;
+  tagsRecords = 0;
+  for(uint16_t i = 0; written && oldFolders != NULL && i < folderCounter; i++) {
+    struct TagsFolder entry;
+    fillTagsFolder(i, &entry);
+    const struct TagsFolder *match = NULL;
+    for(uint16_t j = 0; j < old.folderCount && match == NULL; j++) {
+      const struct TagsFolder *candidate = &oldFolders[j];
+      if(
+        candidate->pathHash == entry.pathHash &&
+        candidate->nameHash == entry.nameHash &&
+        candidate->entryCounter == entry.entryCounter &&
+        candidate->fileCounter == entry.fileCounter
+      ) match = candidate;
+    }
+
+    struct TrackTags records[TAGS_ZERO_BLOCK];
+    for(uint16_t file = 0; written && file < entry.fileCounter; file += TAGS_ZERO_BLOCK) {
+      uint16_t count = entry.fileCounter - file < TAGS_ZERO_BLOCK ? entry.fileCounter - file : TAGS_ZERO_BLOCK;
+      memset(records, 0, sizeof(records));
+      if(match != NULL && match->firstFile + file < oldRecords) {
+        uint32_t available = oldRecords - match->firstFile - file;
+        uint16_t copy = available < count ? available : count;
+        if(oldFile.seek(oldBase + (match->firstFile + file) * sizeof(struct TrackTags))) {
+          oldFile.read(records, copy * sizeof(struct TrackTags));
+        }
+        kept += copy;
+      }
+      written = out.write(records, count * sizeof(struct TrackTags)) == count * sizeof(struct TrackTags);
+    }
+    tagsRecords += entry.fileCounter;
+  }
+  out.close();
+  oldFile.close();
+  free(oldFolders);
+
+  if(!written) {
+    halFsRemove(TAGS_TMP_PATH);
+    return false;
+  }
+  halFsRemove(TAGS_PATH);
+  if(!halFsRename(TAGS_TMP_PATH, TAGS_PATH)) return false;
+  if(oldFolders != NULL) {
+    halLogf(
+      "Tags: biblioteca mudou, %lu de %lu faixas aproveitadas do cache\n",
+      (unsigned long)kept,
+      (unsigned long)libraryFileCounter
+    );
+  }
+  return true;
+}
+
+bool readTagsRecord(uint32_t track, struct TrackTags *tags) {
+  memset(tags, 0, sizeof(struct TrackTags));
+  if(track >= tagsRecords) return true;
+  if(!tagsFile.seek(tagsBase + track * sizeof(struct TrackTags))) return false;
+  return tagsFile.read(tags, sizeof(struct TrackTags)) == sizeof(struct TrackTags);
+}
+
+// Completa com registros vazios ate track: no FAT, crescer com seek deixaria lixo no meio
+bool writeTagsRecord(uint32_t track, struct TrackTags *tags) {
+  if(track > tagsRecords) {
+    struct TrackTags empty[TAGS_ZERO_BLOCK];
+    memset(empty, 0, sizeof(empty));
+    if(!tagsFile.seek(tagsBase + tagsRecords * sizeof(struct TrackTags))) return false;
+    while(tagsRecords < track) {
+      uint32_t count = track - tagsRecords;
+      if(count > TAGS_ZERO_BLOCK) count = TAGS_ZERO_BLOCK;
+      if(tagsFile.write(empty, count * sizeof(struct TrackTags)) != count * sizeof(struct TrackTags)) return false;
+      tagsRecords += count;
+    }
+  }
+
+  if(!tagsFile.seek(tagsBase + track * sizeof(struct TrackTags))) return false;
+  if(tagsFile.write(tags, sizeof(struct TrackTags)) != sizeof(struct TrackTags)) return false;
+  if(track == tagsRecords) tagsRecords++;
+  return true;
+}
+
+bool writeTagsHeader() {
+  return tagsFile.seek(0) && tagsFile.write(&tagsHeader, sizeof(tagsHeader)) == sizeof(tagsHeader);
+}
+
+void loadTrackTags(uint32_t track, struct TrackTags *tags) {
+  if(readTagsRecord(track, tags) && tags->status != TAG_NOT_SCANNED) return;
+
+  memset(tags, 0, sizeof(struct TrackTags));
+  uint16_t folder = findFolderByTrack(track);
+  uint16_t file = track - folders[folder].firstFile;
+  char path[PREFETCH_PATH_SIZE];
+  HalFile audio;
+  bool found = false;
+  if(buildTrackPath(path, sizeof(path), folder, file) && audio.open(path)) {
+    found = readTrackTags(audio, getFileType(folder, file), tags);
+    tags->duration = readTrackDuration(audio, getFileType(folder, file));
+    if(getFileType(folder, file) == FILE_TYPE_WAV) tags->gain = measureWavGain(audio);
+  }
+  audio.close();
+
+  tags->status = found ? TAG_FOUND : TAG_NONE;
+  writeTagsRecord(track, tags);
+}
+
+bool readTrackTags(HalFile &file, uint8_t fileType, struct TrackTags *tags) {
+  if(fileType == FILE_TYPE_M4A) return readMp4Tags(file, tags);
+  if(fileType == FILE_TYPE_AAC && readMp4Tags(file, tags)) return true;
+
+  bool found = readId3v2(file, tags);
+  if(tags->title[0] == '\0' || tags->artist[0] == '\0' || tags->album[0] == '\0') {
+    found = readId3v1(file, tags) || found;
+  }
+  return found;
+}
+
+// ID3v2.2 a v2.4: le so os quadros de titulo, artista e album
+bool readId3v2(HalFile &file, struct TrackTags *tags) {
+  uint8_t header[10];
+  if(!file.seek(0) || file.read(header, sizeof(header)) != sizeof(header)) return false;
+  if(memcmp(header, "ID3", 3) != 0 || header[3] < 2 || header[3] > 4) return false;
+
+  uint8_t version = header[3];
+  uint32_t tagEnd = readSyncsafe(header + 6) + sizeof(header);
+  uint32_t position = sizeof(header);
+  uint8_t frameHeaderSize = version == 2 ? 6 : 10;
+
+  if(version >= 3 && (header[5] & 0x40)) {
+    uint8_t extended[4];
+    if(file.read(extended, sizeof(extended)) != sizeof(extended)) return false;
+    position += version == 3 ? 4 + readBigEndian(extended, 4) : readSyncsafe(extended);
+  }
+
+  bool found = false;
+  uint8_t buffer[TAGS_READ_SIZE];
+  for(uint8_t frames = 0; frames < TAGS_MAX_FRAMES && position + frameHeaderSize <= tagEnd; frames++) {
+    uint8_t frame[10];
+    if(!file.seek(position) || file.read(frame, frameHeaderSize) != frameHeaderSize) break;
+    if(frame[0] == 0) break; // Padding
+
+    uint32_t size = version == 2 ? readBigEndian(frame + 3, 3) : version == 3 ? readBigEndian(frame + 4, 4) : readSyncsafe(frame + 4);
+    char *target = NULL;
+    uint8_t targetSize = 0;
+    if(memcmp(frame, version == 2 ? "TT2" : "TIT2", version == 2 ? 3 : 4) == 0) { target = tags->title; targetSize = TAG_TITLE_SIZE; }
+    else if(memcmp(frame, version == 2 ? "TP1" : "TPE1", version == 2 ? 3 : 4) == 0) { target = tags->artist; targetSize = TAG_ARTIST_SIZE; }
+    else if(memcmp(frame, version == 2 ? "TAL" : "TALB", version == 2 ? 3 : 4) == 0) { target = tags->album; targetSize = TAG_ALBUM_SIZE; }
+
+    if(target != NULL && size > 1) {
+      uint32_t length = size < sizeof(buffer) ? size : sizeof(buffer);
+      length = file.read(buffer, length);
+      if(length > 1) {
+        copyTagText(target, targetSize, buffer + 1, length - 1, buffer[0]);
+        found = found || target[0] != '\0';
+      }
+    }
+    else if(memcmp(frame, version == 2 ? "TXX" : "TXXX", version == 2 ? 3 : 4) == 0 && size > 1) {
+      uint32_t length = file.read(buffer, size < sizeof(buffer) ? size : sizeof(buffer));
+      if(length > 1) readReplayGainText(buffer + 1, length - 1, buffer[0], &tags->gain);
+    }
+    position += frameHeaderSize + size;
+  }
+  return found;
+}
+
+// ID3v1 nos ultimos 128 bytes; so preenche o que o ID3v2 nao trouxe
+bool readId3v1(HalFile &file, struct TrackTags *tags) {
+  uint8_t tag[128];
+  uint32_t size = file.size();
+  if(size < sizeof(tag) || !file.seek(size - sizeof(tag))) return false;
+  if(file.read(tag, sizeof(tag)) != sizeof(tag) || memcmp(tag, "TAG", 3) != 0) return false;
+
+  if(tags->title[0] == '\0') copyTagText(tags->title, TAG_TITLE_SIZE, tag + 3, 30, ID3_ENCODING_LATIN1);
+  if(tags->artist[0] == '\0') copyTagText(tags->artist, TAG_ARTIST_SIZE, tag + 33, 30, ID3_ENCODING_LATIN1);
+  if(tags->album[0] == '\0') copyTagText(tags->album, TAG_ALBUM_SIZE, tag + 63, 30, ID3_ENCODING_LATIN1);
+  return tags->title[0] != '\0' || tags->artist[0] != '\0' || tags->album[0] != '\0';
+}
+
+// MP4/M4A: moov/udta/meta/ilst e os itens ©nam, ©ART e ©alb, cada um com um atom data
+bool readMp4Tags(HalFile &file, struct TrackTags *tags) {
+  uint8_t budget = TAGS_MAX_FRAMES;
+  uint32_t start = 0;
+  uint32_t end = file.size();
+  uint8_t type[8];
+  if(!file.seek(0) || file.read(type, sizeof(type)) != sizeof(type) || memcmp(type + 4, "ftyp", 4) != 0) return false;
+
+  if(!findAtom(file, start, end, "moov", &start, &end, &budget)) return false;
+  if(!findAtom(file, start, end, "udta", &start, &end, &budget)) return false;
+  if(!findAtom(file, start, end, "meta", &start, &end, &budget)) return false;
+  start += 4; // meta e um full box: versao e flags antes dos filhos
+  if(!findAtom(file, start, end, "ilst", &start, &end, &budget)) return false;
+
+  bool found = false;
+  uint8_t buffer[TAGS_READ_SIZE];
+  uint32_t position = start;
+  while(position + 8 <= end && budget > 0) {
+    budget--;
+    uint8_t item[8];
+    if(!file.seek(position) || file.read(item, sizeof(item)) != sizeof(item)) break;
+    uint32_t size = readBigEndian(item, 4);
+    if(size < 8 || position + size > end) break;
+
+    char *target = NULL;
+    uint8_t targetSize = 0;
+    if(memcmp(item + 4, "\xA9nam", 4) == 0) { target = tags->title; targetSize = TAG_TITLE_SIZE; }
+    else if(memcmp(item + 4, "\xA9" "ART", 4) == 0) { target = tags->artist; targetSize = TAG_ARTIST_SIZE; }
+    else if(memcmp(item + 4, "\xA9" "alb", 4) == 0) { target = tags->album; targetSize = TAG_ALBUM_SIZE; }
+
+    uint32_t data = 0;
+    uint32_t dataEnd = 0;
+    if(memcmp(item + 4, "----", 4) == 0) {
+      // Item livre: name (full box) com a chave e data com o valor em texto
+      uint32_t length = 0;
+      if(findAtom(file, position + 8, position + size, "name", &data, &dataEnd, &budget) && dataEnd > data + 4 && file.seek(data + 4)) {
+        length = dataEnd - data - 4;
+        length = file.read(buffer, length < sizeof(buffer) - 1 ? length : sizeof(buffer) - 1);
+      }
+      buffer[length] = '\0';
+      if(strcasecmp((const char*)buffer, "replaygain_track_gain") == 0 &&
+        findAtom(file, position + 8, position + size, "data", &data, &dataEnd, &budget) && dataEnd > data + 8 && file.seek(data + 8)) {
+        length = dataEnd - data - 8;
+        length = file.read(buffer, length < sizeof(buffer) - 1 ? length : sizeof(buffer) - 1);
+        buffer[length] = '\0';
+        parseReplayGain((const char*)buffer, &tags->gain);
+      }
+    }
+    else if(target != NULL && findAtom(file, position + 8, position + size, "data", &data, &dataEnd, &budget) && dataEnd > data + 8) {
+      // data: tipo (4) e locale (4) antes do texto em UTF-8
+      uint32_t length = dataEnd - data - 8;
+      if(length > sizeof(buffer)) length = sizeof(buffer);
+      if(file.seek(data + 8)) {
+        length = file.read(buffer, length);
+        copyTagText(target, targetSize, buffer, length, ID3_ENCODING_UTF8);
+        found = found || target[0] != '\0';
+      }
+    }
+    position += size;
+  }
+  return found;
+}
+
+// Segundos inteiros, limitados ao que cabe no registro
+uint16_t readTrackDuration(HalFile &file, uint8_t fileType) {
+  uint32_t seconds = 0;
+  if(fileType == FILE_TYPE_MP3) seconds = readMp3Duration(file);
+  else if(fileType == FILE_TYPE_WAV) seconds = readWavDuration(file);
+  else if(fileType == FILE_TYPE_M4A) seconds = readMp4Duration(file);
+  return seconds > 0xFFFF ? 0xFFFF : seconds;
+}
+
+/**
+ * Primeiro quadro depois do ID3v2: o cabecalho Xing/Info ou VBRI traz o numero
+ * de quadros; sem ele o arquivo e tratado como CBR pelo bitrate desse quadro.
+ */
+uint32_t readMp3Duration(HalFile &file) {
+  static const uint16_t bitratesV1[] = { 0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320 };
+  static const uint16_t bitratesV2[] = { 0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160 };
+  static const uint16_t sampleRates[] = { 44100, 48000, 32000 };
+
+  uint8_t buffer[TAGS_READ_SIZE];
+  uint32_t start = 0;
+  if(!file.seek(0) || file.read(buffer, 10) != 10) return 0;
+  if(memcmp(buffer, "ID3", 3) == 0) start = readSyncsafe(buffer + 6) + 10 + (buffer[5] & 0x10 ? 10 : 0);
+  if(!file.seek(start)) return 0;
+  uint32_t length = file.read(buffer, sizeof(buffer));
+
+  // So o Layer III; o quadro Xing/VBRI tem no maximo 54 bytes a partir do sync
+  uint32_t frame = 0;
+  while(frame + 54 <= length && !(buffer[frame] == 0xFF && (buffer[frame + 1] & 0xE6) == 0xE2)) frame++;
+  if(frame + 54 > length) return 0;
+  const uint8_t *header = buffer + frame;
+
+  uint8_t version = (header[1] >> 3) & 0x03; // 3 = MPEG1, 2 = MPEG2, 0 = MPEG2.5
+  uint8_t bitrateIndex = header[2] >> 4;
+  uint8_t sampleRateIndex = (header[2] >> 2) & 0x03;
+  if(version == 1 || bitrateIndex == 0 || bitrateIndex == 15 || sampleRateIndex == 3) return 0;
+
+  bool mono = (header[3] >> 6) == 3;
+  uint32_t sampleRate = sampleRates[sampleRateIndex] >> (version == 3 ? 0 : version == 2 ? 1 : 2);
+  uint32_t samplesPerFrame = version == 3 ? 1152 : 576;
+  uint32_t bitrate = (version == 3 ? bitratesV1 : bitratesV2)[bitrateIndex];
+
+  uint8_t sideInfo = version == 3 ? (mono ? 17 : 32) : (mono ? 9 : 17);
+  const uint8_t *xing = header + 4 + sideInfo;
+  uint32_t frames = 0;
+  if((memcmp(xing, "Xing", 4) == 0 || memcmp(xing, "Info", 4) == 0) && (xing[7] & 0x01)) frames = readBigEndian(xing + 8, 4);
+  else if(memcmp(header + 36, "VBRI", 4) == 0) frames = readBigEndian(header + 36 + 14, 4);
+  if(frames > 0) return (uint64_t)frames * samplesPerFrame / sampleRate;
+
+  uint32_t end = file.size();
+  uint8_t tag[3];
+  if(end >= 128 && file.seek(end - 128) && file.read(tag, sizeof(tag)) == sizeof(tag) && memcmp(tag, "TAG", 3) == 0) end -= 128;
+  uint32_t audioStart = start + frame;
+  if(end <= audioStart) return 0;
+  return (uint64_t)(end - audioStart) * 8 / (bitrate * 1000);
+}
+
+uint32_t readWavDuration(HalFile &file) {
+  uint8_t format[16];
+  uint32_t data, dataSize;
+  if(!findWavData(file, format, &data, &dataSize)) return 0;
+  uint32_t byteRate = readLittleEndian(format + 8, 4);
+  return byteRate ? dataSize / byteRate : 0;
+}
+
+/**
+ * Chunks do RIFF: copia os 16 bytes do fmt e devolve onde o data comeca. O fmt
+ * precisa vir antes do data, como todo gravador faz.
+ */
+bool findWavData(HalFile &file, uint8_t *format, uint32_t *data, uint32_t *dataSize) {
+  bool formatFound = false;
+  uint32_t position = 12;
+  uint32_t end = file.size();
+  for(uint8_t chunks = 0; chunks < TAGS_MAX_FRAMES && position + 8 <= end; chunks++) {
+    uint8_t chunk[8];
+    if(!file.seek(position) || file.read(chunk, 8) != 8) return false;
+    uint32_t size = readLittleEndian(chunk + 4, 4);
+    if(memcmp(chunk, "fmt ", 4) == 0) {
+      if(size < 16 || file.read(format, 16) != 16) return false;
+      formatFound = true;
+    }
+    else if(memcmp(chunk, "data", 4) == 0) {
+      *data = position + 8;
+      *dataSize = size > end - position - 8 ? end - position - 8 : size; // Gravacao cortada
+      return formatFound;
+    }
+    position += 8 + size + (size & 1);
+  }
+  return false;
+}
+
+/**
+ * Ganho que leva o RMS do wav (PCM de 16 bits) para REPLAYGAIN_TARGET. Le uma
+ * janela de TAGS_READ_SIZE bytes em cada 1/REPLAYGAIN_WINDOWS do audio, sem
+ * ponderacao de frequencia: o suficiente para nivelar faixas muito diferentes.
+ */
+int16_t measureWavGain(HalFile &file) {
+  uint8_t format[16];
+  uint32_t data, dataSize;
+  if(!findWavData(file, format, &data, &dataSize)) return 0;
+  uint16_t blockAlign = readLittleEndian(format + 12, 2);
+  if(readLittleEndian(format, 2) != 1 || readLittleEndian(format + 14, 2) != 16 || blockAlign == 0) return 0;
+
+  uint8_t buffer[TAGS_READ_SIZE];
+  uint64_t sum = 0;
+  uint32_t samples = 0;
+  for(uint8_t window = 0; window < REPLAYGAIN_WINDOWS; window++) {
+    uint32_t offset = (uint64_t)dataSize * window / REPLAYGAIN_WINDOWS;
+    offset -= offset % blockAlign;
+    uint32_t length = dataSize - offset < sizeof(buffer) ? dataSize - offset : sizeof(buffer);
+    if(!file.seek(data + offset)) break;
+    length = file.read(buffer, length) & ~1u;
+    for(uint32_t i = 0; i < length; i += 2) {
+      int32_t sample = (int16_t)readLittleEndian(buffer + i, 2);
+      sum += sample * sample;
+    }
+    samples += length / 2;
+  }
+  return replayGainFromPower(sum, samples);
+}
+
+// Ganho para REPLAYGAIN_TARGET a partir da soma dos quadrados de samples de 16 bits
+int16_t replayGainFromPower(uint64_t sum, uint64_t samples) {
+  if(samples == 0 || sum < samples) return 0; // Silencio nao ganha reforco
+
+  // 10 * log10(media / 32768^2) em centesimos de dB: 301.03 por oitava de log2
+  int64_t level = ((int64_t)fixedLog2(sum / samples) - (30 << 16)) * 30103 / 6553600;
+  int32_t gain = REPLAYGAIN_TARGET - level;
+  return gain > REPLAYGAIN_MAX_BOOST ? REPLAYGAIN_MAX_BOOST : gain < REPLAYGAIN_MAX_CUT ? REPLAYGAIN_MAX_CUT : gain;
+}
+
+// TXXX: descricao terminada em zero e o valor, na codificacao do quadro
+bool readReplayGainText(const uint8_t *text, uint32_t length, uint8_t encoding, int16_t *gain) {
+  uint8_t width = encoding == ID3_ENCODING_UTF16 || encoding == ID3_ENCODING_UTF16BE ? 2 : 1;
+  uint32_t end = 0;
+  while(end + width <= length && (text[end] != 0 || text[end + width - 1] != 0)) end += width;
+  if(end + width > length) return false;
+
+  char description[24];
+  char value[16];
+  copyTagText(description, sizeof(description), text, end, encoding);
+  copyTagText(value, sizeof(value), text + end + width, length - end - width, encoding);
+  return strcasecmp(description, "REPLAYGAIN_TRACK_GAIN") == 0 && parseReplayGain(value, gain);
+}
+
+// "-6.48 dB" vira -648; sem float para o resultado nao depender da libc
+bool parseReplayGain(const char *text, int16_t *gain) {
+  while(*text == ' ') text++;
+  bool negative = *text == '-';
+  if(*text == '-' || *text == '+') text++;
+  if(*text < '0' || *text > '9') return false;
+
+  int32_t value = 0;
+  for(; *text >= '0' && *text <= '9' && value < 100000; text++) value = value * 10 + (*text - '0');
+  value *= 100;
+  if(*text == '.') {
+    text++;
+    for(int32_t scale = 10; scale > 0 && *text >= '0' && *text <= '9'; scale /= 10, text++) value += (*text - '0') * scale;
+  }
+  if(negative) value = -value;
+  *gain = value > REPLAYGAIN_MAX_BOOST ? REPLAYGAIN_MAX_BOOST : value < REPLAYGAIN_MAX_CUT ? REPLAYGAIN_MAX_CUT : value;
+  return true;
+}
+
+// log2 em Q16 so com inteiros: normaliza para [1, 2) e eleva ao quadrado bit a bit
+uint32_t fixedLog2(uint64_t value) {
+  uint32_t integer = 63 - __builtin_clzll(value);
+  uint64_t x = integer >= 31 ? value >> (integer - 31) : value << (31 - integer);
+  uint32_t fraction = 0;
+  for(uint8_t bit = 0; bit < 16; bit++) {
+    x = (x * x) >> 31;
+    if(x >= (2ull << 31)) {
+      x >>= 1;
+      fraction |= 1u << (15 - bit);
+    }
+  }
+  return (integer << 16) | fraction;
+}
+
+// moov/mvhd: timescale e duracao, com campos de 32 (versao 0) ou 64 bits (versao 1)
+uint32_t readMp4Duration(HalFile &file) {
+  uint8_t budget = TAGS_MAX_FRAMES;
+  uint32_t start = 0;
+  uint32_t end = file.size();
+  if(!findAtom(file, start, end, "moov", &start, &end, &budget)) return 0;
+  if(!findAtom(file, start, end, "mvhd", &start, &end, &budget)) return 0;
+
+  uint8_t mvhd[32];
+  if(!file.seek(start) || file.read(mvhd, sizeof(mvhd)) != sizeof(mvhd)) return 0;
+  uint32_t timescale;
+  uint64_t duration;
+  if(mvhd[0] == 1) {
+    timescale = readBigEndian(mvhd + 20, 4);
+    duration = ((uint64_t)readBigEndian(mvhd + 24, 4) << 32) | readBigEndian(mvhd + 28, 4);
+  }
+  else {
+    timescale = readBigEndian(mvhd + 12, 4);
+    duration = readBigEndian(mvhd + 16, 4);
+  }
+  return timescale ? duration / timescale : 0;
+}
+
+/**
+ * Procura um atom filho em [start, end) e devolve o intervalo do conteudo.
+ * Atoms com tamanho de 64 bits so sao pulados se couberem em 32 bits.
+ */
+bool findAtom(HalFile &file, uint32_t start, uint32_t end, const char *type, uint32_t *content, uint32_t *contentEnd, uint8_t *budget) {
+  uint32_t position = start;
+  while(position + 8 <= end && *budget > 0) {
+    (*budget)--;
+    uint8_t header[16];
+    if(!file.seek(position) || file.read(header, 8) != 8) return false;
+
+    uint64_t size = readBigEndian(header, 4);
+    uint8_t headerSize = 8;
+    if(size == 1) {
+      if(file.read(header + 8, 8) != 8) return false;
+      size = ((uint64_t)readBigEndian(header + 8, 4) << 32) | readBigEndian(header + 12, 4);
+      headerSize = 16;
+    }
+    else if(size == 0) size = end - position;
+    if(size < headerSize || size > end - position) return false;
+
+    if(memcmp(header + 4, type, 4) == 0) {
+      *content = position + headerSize;
+      *contentEnd = position + size;
+      return true;
+    }
+    position += size;
+  }
+  return false;
+}
+
+/**
+ * Converte um campo de texto para ASCII: so a primeira string, sem espacos no
+ * fim, acentos do Latin-1 sem o acento e o resto como '?'.
+ */
+void copyTagText(char *out, uint8_t size, const uint8_t *text, uint32_t length, uint8_t encoding) {
+  uint8_t used = 0;
+  uint32_t i = 0;
+  bool bigEndian = encoding == ID3_ENCODING_UTF16BE;
+  if(encoding == ID3_ENCODING_UTF16 && length >= 2) {
+    bigEndian = text[0] == 0xFE && text[1] == 0xFF;
+    if((text[0] == 0xFE && text[1] == 0xFF) || (text[0] == 0xFF && text[1] == 0xFE)) i = 2;
+  }
+
+  while(i < length && used + 1 < size) {
+    uint32_t codepoint;
+    if(encoding == ID3_ENCODING_UTF16 || encoding == ID3_ENCODING_UTF16BE) {
+      if(i + 1 >= length) break;
+      codepoint = bigEndian ? (text[i] << 8) | text[i + 1] : text[i] | (text[i + 1] << 8);
+      i += 2;
+    }
+    else if(encoding == ID3_ENCODING_UTF8 && text[i] >= 0x80) {
+      uint8_t extra = text[i] >= 0xF0 ? 3 : text[i] >= 0xE0 ? 2 : text[i] >= 0xC0 ? 1 : 0;
+      codepoint = text[i] & (0x3F >> extra);
+      i++;
+      for(uint8_t k = 0; k < extra && i < length; k++, i++) codepoint = (codepoint << 6) | (text[i] & 0x3F);
+      if(extra == 0) codepoint = '?';
+    }
+    else codepoint = text[i++];
+
+    if(codepoint == 0) break;
+    out[used++] = foldCodepoint(codepoint);
+  }
+  while(used > 0 && out[used - 1] == ' ') used--;
+  out[used] = '\0';
+}
+
+char foldCodepoint(uint32_t codepoint) {
+  if(codepoint < 0x20) return ' ';
+  if(codepoint < 0x7F) return (char)codepoint;
+  if(codepoint >= 0xC0 && codepoint <= 0xFF) return latin1Fold[codepoint - 0xC0];
+  if(codepoint == 0xA0) return ' ';
+  if(codepoint == 0x2018 || codepoint == 0x2019) return '\'';
+  if(codepoint == 0x201C || codepoint == 0x201D) return '"';
+  if(codepoint == 0x2013 || codepoint == 0x2014) return '-';
+  return '?';
+}
+
+/**
+ * FNV-1a da estrutura da biblioteca: pastas, faixas, tipos e nomes. A impressao
+ * das pastas fica de fora: um arquivo que nao e faixa muda a impressao sem
+ * mudar nenhuma faixa.
+ */
+uint32_t readBigEndian(const uint8_t *data, uint8_t length) {
+  uint32_t value = 0;
+  for(uint8_t i = 0; i < length; i++) value = (value << 8) | data[i];
+  return value;
+}
+
+uint32_t readLittleEndian(const uint8_t *data, uint8_t length) {
+  uint32_t value = 0;
+  for(uint8_t i = length; i > 0; i--) value = (value << 8) | data[i - 1];
+  return value;
+}
+
+uint32_t readSyncsafe(const uint8_t *data) {
+  return ((uint32_t)(data[0] & 0x7F) << 21) | ((data[1] & 0x7F) << 14) | ((data[2] & 0x7F) << 7) | (data[3] & 0x7F);
+}
@@ -0,0 +1,101 @@
+/**
+ * Tags das faixas (titulo, artista, album, duracao e ganho) lidas em segundo plano
+ *
+ * metadataStep() roda na tarefa de menor prioridade (no host, uma vez por volta
+ * do loop) e le uma faixa por chamada: o cabecalho ID3v2 ou o ID3v1 do fim do
+ * arquivo, ou os atoms moov/udta/meta/ilst do MP4, sempre com leituras de no
+ * maximo TAGS_READ_SIZE bytes e no maximo TAGS_MAX_FRAMES quadros/atoms. A
+ * duracao vem do quadro Xing/Info ou VBRI do mp3 (senao do bitrate do primeiro
+ * quadro), do chunk fmt/data do wav ou do mvhd do MP4; aac puro fica com 0.
+ *
+ * O ganho e o REPLAYGAIN_TRACK_GAIN gravado por quem preparou os arquivos (TXXX
+ * no ID3v2, item ---- no MP4). O wav nao tem onde guardar tags, entao o nivel
+ * RMS e medido em REPLAYGAIN_WINDOWS janelas espalhadas pelo chunk data, so com
+ * inteiros para o cardtool e a placa chegarem no mesmo valor. A placa nao tem
+ * como decodificar mp3/aac fora do decoder; para essas faixas sem tag o
+ * cardtool mede o nivel no host e grava com metadataStoreGain().
+ *
+ * O resultado vai para TAGS_PATH: TagsHeader, um TagsFolder por pasta e um
+ * TrackTags por faixa na ordem global (folders[].firstFile + file). Quando a
+ * biblioteca muda, so as pastas com outro nome ou outra impressao voltam a ser
+ * lidas; os registros das outras vem do cache anterior. nextTrack e gravado a
+ * cada TAGS_CURSOR_EVERY faixas, entao depois de um reboot a leitura continua
+ * dali.
+ *
+ * So a tarefa das tags abre os arquivos e o cache. O loop pede a faixa atual com
+ * metadataRequest(), que passa na frente da fila, e pega o registro pronto com
+ * metadataTake().
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include "hal.h"
+
+#define TAGS_PATH "/.player/tags.dat"
+#define TAGS_MAGIC 0x53474154 // "TAGS"
+#define TAGS_TMP_PATH "/.player/tags.tmp"
+#define TAGS_VERSION 4
+#define TAGS_CURSOR_EVERY 16
+#define TAGS_READ_SIZE 128 // Maior leitura de um campo
+#define TAGS_MAX_FRAMES 64 // Quadros ID3v2 ou atoms MP4 olhados por arquivo
+#define TAGS_NO_TRACK 0xFFFFFFFF
+
+#define TAG_NOT_SCANNED 0
+#define TAG_FOUND 1
+#define TAG_NONE 2 // Arquivo lido sem tags: a tela fica com o nome do arquivo
+
+#define TAG_TITLE_SIZE 40
+#define TAG_ARTIST_SIZE 28
+#define TAG_ALBUM_SIZE 23
+
+#define REPLAYGAIN_TARGET -1800 // Nivel RMS de referencia do wav medido, em centesimos de dBFS
+#define REPLAYGAIN_MAX_BOOST 1200
+#define REPLAYGAIN_MAX_CUT -2400
+#define REPLAYGAIN_WINDOWS 64
+
+// Texto ja em ASCII (acentos do Latin-1 sem o acento) para a fonte do display
+struct TrackTags {
+  uint8_t status;
+  char title[TAG_TITLE_SIZE];
+  char artist[TAG_ARTIST_SIZE];
+  char album[TAG_ALBUM_SIZE];
+  uint16_t duration; // Segundos; 0 quando nao deu para saber
+  int16_t gain; // ReplayGain da faixa em centesimos de dB; 0 sem ganho
+};
+
+struct TagsHeader {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t recordSize;
+  uint32_t folderCount;
+  uint32_t trackCount;
+  uint32_t nextTrack;
+};
+
+// Uma por pasta, na ordem de folders[]: diz de que pasta vem cada faixa dos registros
+struct TagsFolder {
+  uint32_t pathHash; // FNV-1a do nome da pasta
+  uint32_t nameHash; // Impressao da pasta (Folder.nameHash e entryCounter)
+  uint32_t entryCounter;
+  uint32_t firstFile;
+  uint16_t fileCounter;
+  uint16_t reserved;
+};
+
+bool metadataStep(void);
+void metadataRequest(uint32_t track);
+void metadataClose(void);
+bool metadataRecord(uint32_t track, struct TrackTags *tags);
+bool metadataStoreGain(uint32_t track, int16_t gain);
+bool metadataTake(uint32_t track, struct TrackTags *tags);
+bool readTrackTags(HalFile &file, uint8_t fileType, struct TrackTags *tags);
+bool readId3v2(HalFile &file, struct TrackTags *tags);
+bool readId3v1(HalFile &file, struct TrackTags *tags);
+bool readMp4Tags(HalFile &file, struct TrackTags *tags);
+uint16_t readTrackDuration(HalFile &file, uint8_t fileType);
+int16_t measureWavGain(HalFile &file);
+int16_t replayGainFromPower(uint64_t sum, uint64_t samples);
+bool parseReplayGain(const char *text, int16_t *gain);
+uint32_t fixedLog2(uint64_t value); // log2 em Q16; value > 0
+void copyTagText(char *out, uint8_t size, const uint8_t *text, uint32_t length, uint8_t encoding);
@@ -0,0 +1,476 @@
+#include "player.h"
+#include "shuffle.h"
+#include "screen.h"
+#include "profiler.h"
+#include "metadata.h"
+#include "menu.h"
+#include "state.h"
+#include "telemetry.h"
+#include "hc12.h"
+#include "cardbench.h"
+#include "spectrum.h"
+#include "equalizer.h"
+#include "hal.h"
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+
+int16_t folderIndex = SD_ROOT;
+uint16_t fileIndex = FILE_ROOT;
+bool pauseResumeStatus = 0; // 1 -> Play; 0 -> Pause
+uint8_t volume = 2;
+uint8_t randomMode = RANDOM_NORMAL;
+uint8_t button_event = NO_BTN_EVENT;
+
+volatile uint32_t prefetchRequestId = 0;
+volatile int16_t prefetchRequestFolder = SD_ROOT;
+volatile uint16_t prefetchRequestFile = FILE_ROOT;
+volatile uint32_t prefetchReadyId = 0;
+volatile int16_t prefetchFolder = -1;
+volatile uint16_t prefetchFile = FILE_ROOT;
+char prefetchPath[PREFETCH_PATH_SIZE];
+
+// Latencia entre pedir a troca de faixa e o primeiro sample chegar no I2S
+volatile bool firstAudioPending = false;
+volatile uint32_t firstAudioTime = 0;
+uint32_t skipStartTime = 0;
+bool skipPrefetched = false;
+uint32_t skipCount[2] = { 0, 0 }; // [0] sem prefetch, [1] com prefetch
+uint32_t skipTotalTime[2] = { 0, 0 };
+uint32_t skipMaxTime[2] = { 0, 0 };
+
+// Fim de faixa avisado pelo backend e intervalo ate o primeiro sample da seguinte
+volatile bool trackEnded = false;
+volatile uint32_t trackEndTime = 0;
+volatile uint32_t audioFrames = 0;
+bool trackGapPending = false;
+uint32_t trackGapStart = 0;
+uint32_t trackGapCount = 0;
+uint32_t trackGapTotal = 0;
+uint32_t trackGapMax = 0;
+
+volatile int32_t trackGain = REPLAYGAIN_UNITY; // Fator Q14 lido pela tarefa do decoder
+int32_t appliedGain = REPLAYGAIN_UNITY; // Fator do ultimo quadro; so a tarefa do decoder mexe
+uint32_t gainTrack = TAGS_NO_TRACK; // Faixa global cujo ganho esta em trackGain
+
+uint32_t stallFrames = 0;
+uint32_t stallSince = 0;
+uint8_t stallRetries = 0;
+uint32_t stallPosition = 0; // Segundo da faixa onde parou pela ultima vez
+int16_t stallFolder = -1;
+uint16_t stallFile = 0;
+
+uint32_t eventHandledCount = 0;
+uint32_t eventTotalLatency = 0;
+uint32_t eventMaxLatency = 0;
+uint32_t eventReportedCount = 0;
+uint32_t audioReportedUnderruns = 0;
+
+/**
+ * Monta a biblioteca e comeca a tocar; o backend ja deve estar pronto. Com um
+ * estado gravado a faixa ja esta tocando enquanto a biblioteca e montada.
+ */
+void playerBegin() {
+  halDecoderSetVolume(volume); // default 0...21
+  eqBegin();
+  bool resumed = resumePlaybackState();
+  mountSdStruct();
+  reseedShuffle(halRandom());
+  if(!resumed || !locateResumedTrack()) loadSD(SD_ROOT, FILE_ROOT);
+  hc12Begin();
+  spectrumBegin();
+  profileReset();
+}
+
+void playerLoop() {
+  PROFILE_BEGIN(PROFILE_STAGE_EVENTS);
+  dispatchEvents();
+  PROFILE_END(PROFILE_STAGE_EVENTS);
+
+  PROFILE_BEGIN(PROFILE_STAGE_DISPLAY);
+  updateDisplay();
+  PROFILE_END(PROFILE_STAGE_DISPLAY);
+
+  PROFILE_BEGIN(PROFILE_STAGE_WATCH);
+  watchTrackPlaying();
+  watchTrackGain();
+  eqWatch();
+  watchPlaybackState();
+  telemetryStep();
+  hc12Watch();
+  PROFILE_END(PROFILE_STAGE_WATCH);
+
+  halDecoderLoop();
+  PROFILE_LOOP_END();
+}
+
+// Chamado pelo backend do decoder para cada quadro estereo antes do I2S
+void playerAudioFrame(int16_t *frame) {
+  // Antes do primeiro quadro da faixa vale direto; depois vai em rampa, sem degrau
+  int32_t target = trackGain;
+  if(firstAudioPending) appliedGain = target;
+  else if(appliedGain < target) appliedGain = target - appliedGain > REPLAYGAIN_RAMP_STEP ? appliedGain + REPLAYGAIN_RAMP_STEP : target;
+  else if(appliedGain > target) appliedGain = appliedGain - target > REPLAYGAIN_RAMP_STEP ? appliedGain - REPLAYGAIN_RAMP_STEP : target;
+  int32_t gain = appliedGain;
+  if(gain != REPLAYGAIN_UNITY) {
+    for(uint8_t channel = 0; channel < 2; channel++) {
+      int32_t sample = (frame[channel] * gain) >> REPLAYGAIN_SHIFT;
+      frame[channel] = sample > INT16_MAX ? INT16_MAX : sample < INT16_MIN ? INT16_MIN : sample;
+    }
+  }
+  eqProcess(frame, 1); // A Audio entrega um quadro por chamada
+  spectrumFeed(frame); // Depois do ganho e do EQ: o que vai para o I2S
+
+  audioFrames++;
+  if(firstAudioPending) {
+    firstAudioTime = halMicros();
+    firstAudioPending = false;
+  }
+}
+
+// Chamado pelo backend (na tarefa do decoder, na placa) no fim do arquivo
+void playerTrackEnded() {
+  trackEndTime = halMicros();
+  trackEnded = true;
+}
+
+void loadSD(int16_t _fileIndex, int16_t _folderIndex) {
+  if(
+    _folderIndex > folderCounter - 1 ||
+    _folderIndex < 0
+  ){
+    halLogf("Tentando acessar pasta que não existe");
+    return;
+  }
+
+  PROFILE_BEGIN(PROFILE_STAGE_LOAD);
+  skipStartTime = halMicros();
+  folderIndex = _folderIndex;
+  fileIndex = _fileIndex;
+
+  skipPrefetched = prefetchReadyId == prefetchRequestId &&
+    prefetchFolder == folderIndex &&
+    prefetchFile == fileIndex;
+
+  // Antes de abrir: o decoder pode entregar o primeiro quadro antes de halDecoderOpen() voltar
+  firstAudioPending = true;
+  trackGain = REPLAYGAIN_UNITY;
+  gainTrack = TAGS_NO_TRACK;
+  metadataRequest(folders[folderIndex].firstFile + fileIndex);
+  if(skipPrefetched) {
+    halDecoderOpen((const char*)prefetchPath);
+  }
+  else {
+    const char* folder = getFolderName(folderIndex);
+    const char* file = getFileName(folderIndex, fileIndex);
+    char* path = (char*)malloc(strlen(folder) + strlen(file) + 2);
+    buildTrackPath(path, strlen(folder) + strlen(file) + 2, folderIndex, fileIndex);
+    halDecoderOpen((const char*)path);
+    free(path);
+    path = NULL;
+  }
+
+  pauseResumeStatus = 1;
+  button_event = NO_BTN_EVENT;
+
+  requestPrefetch();
+  PROFILE_END(PROFILE_STAGE_LOAD);
+}
+
+bool buildTrackPath(char *path, size_t size, int16_t folder, uint16_t file) {
+  const char* folderName = getFolderName(folder);
+  const char* fileName = getFileName(folder, file);
+  if(strlen(folderName) + strlen(fileName) + 2 > size) return false;
+
+  strcpy(path, folderName);
+  if(folder != SD_ROOT) strcat(path, "/");
+  strcat(path, fileName);
+  return true;
+}
+
+// Pede para prefetchRun() a faixa que tocaria depois da atual
+void requestPrefetch() {
+  int16_t folder = folderIndex;
+  uint16_t file = fileIndex;
+  uint32_t pass = shufflePass;
+  resolveSong(1, &folder, &file, &pass);
+
+  prefetchRequestFolder = folder;
+  prefetchRequestFile = file;
+  prefetchRequestId++;
+  halWakePrefetch();
+}
+
+void prefetchRun() {
+  uint32_t id = prefetchRequestId;
+  int16_t folder = prefetchRequestFolder;
+  uint16_t file = prefetchRequestFile;
+  if(id == prefetchReadyId) return;
+
+  // So mexe no caminho depois de invalidar o prefetch anterior
+  prefetchReadyId = id - 1;
+  prefetchFolder = -1;
+  if(!buildTrackPath(prefetchPath, PREFETCH_PATH_SIZE, folder, file)) return;
+
+  if(!halDecoderPrefetch(prefetchPath)) {
+    halLogf("Prefetch: nao abriu %s\n", prefetchPath);
+    return;
+  }
+
+  prefetchFolder = folder;
+  prefetchFile = file;
+  prefetchReadyId = id;
+}
+
+void reportSkipLatency() {
+  if(skipStartTime == 0 || firstAudioPending) return;
+
+  uint32_t latency = (firstAudioTime - skipStartTime) / 1000;
+  skipStartTime = 0;
+  skipCount[skipPrefetched]++;
+  skipTotalTime[skipPrefetched] += latency;
+  if(latency > skipMaxTime[skipPrefetched]) skipMaxTime[skipPrefetched] = latency;
+
+  halLogf(
+    "Troca de faixa: %lu ms (%s) | com prefetch: media %lu ms, max %lu ms, %lux | sem: media %lu ms, max %lu ms, %lux\n",
+    (unsigned long)latency,
+    skipPrefetched ? "prefetch" : "sem prefetch",
+    (unsigned long)(skipCount[1] ? skipTotalTime[1] / skipCount[1] : 0),
+    (unsigned long)skipMaxTime[1],
+    (unsigned long)skipCount[1],
+    (unsigned long)(skipCount[0] ? skipTotalTime[0] / skipCount[0] : 0),
+    (unsigned long)skipMaxTime[0],
+    (unsigned long)skipCount[0]
+  );
+}
+
+/**
+ * Calcula a faixa seguinte (direction = 1) ou anterior (direction = -1) no modo
+ * atual, sem tocar nada. Usado para navegar e pelo prefetch.
+ */
+void resolveSong(int8_t direction, int16_t *folder, uint16_t *file, uint32_t *pass) {
+  if(libraryFileCounter == 0 || randomMode == REPEAT_SONG) return;
+
+  if(randomMode == RANDOM_NORMAL) {
+    int32_t f = *folder;
+    int32_t i = *file + direction;
+    while(i < 0 || i >= folders[f].fileCounter) {
+      f = (f + direction + folderCounter) % folderCounter;
+      i = direction > 0 ? 0 : folders[f].fileCounter - 1;
+    }
+    *folder = f;
+    *file = i;
+  }
+  else if(randomMode == RANDOM_IN_FOLDER) {
+    uint16_t salt = *folder + 1;
+    *file = nextShuffleTrack(*file, folders[*folder].fileCounter, salt, direction, pass);
+  }
+  else if(randomMode == RANDOM_ALL_SONGS) {
+    uint32_t track = folders[*folder].firstFile + *file;
+    track = nextShuffleTrack(track, libraryFileCounter, SHUFFLE_SALT_ALL_SONGS, direction, pass);
+    *folder = findFolderByTrack(track);
+    *file = track - folders[*folder].firstFile;
+  }
+}
+
+void nextSong() {
+  button_event = NEXT_SONG_EVENT;
+  int16_t folder = folderIndex;
+  uint16_t file = fileIndex;
+  resolveSong(1, &folder, &file, &shufflePass);
+  loadSD(file, folder);
+}
+
+void previusSong() {
+  button_event = PREVIUS_SONG_EVENT;
+  int16_t folder = folderIndex;
+  uint16_t file = fileIndex;
+  resolveSong(-1, &folder, &file, &shufflePass);
+  loadSD(file, folder);
+}
+
+void playResume() { button_event = PLAY_PAUSE_SONG_EVENT; halDecoderPauseResume(); pauseResumeStatus = !pauseResumeStatus; }
+
+void volumeUp() {
+  button_event = VOLUME_UP_EVENT;
+  if(volume >= 21) return;
+  volume++;
+  halDecoderSetVolume(volume);
+}
+
+void volumeDown() {
+  button_event = VOLUME_DOWN_EVENT;
+  if(volume == 0) return;
+  volume--;
+  halDecoderSetVolume(volume);
+}
+
+void changeRandomMode() {
+  button_event = RANDOM_EVENT;
+  switch (randomMode) {
+    case RANDOM_NORMAL: { randomMode = RANDOM_IN_FOLDER; break;}
+    case RANDOM_IN_FOLDER: { randomMode = RANDOM_ALL_SONGS; break;}
+    case RANDOM_ALL_SONGS: { randomMode = REPEAT_SONG; break;}
+    case REPEAT_SONG: { randomMode = RANDOM_NORMAL; break;}
+    default: break;
+  }
+  requestPrefetch();
+}
+
+// Esvazia as filas de todas as fontes, sempre pelo evento mais antigo
+void dispatchEvents() {
+  struct InputEvent pending[EVENT_SOURCE_COUNT];
+  bool hasPending[EVENT_SOURCE_COUNT];
+  for(uint8_t i = 0; i < EVENT_SOURCE_COUNT; i++) {
+    hasPending[i] = popEvent(&eventQueues[i], &pending[i]);
+  }
+
+  for(;;) {
+    int8_t oldest = -1;
+    for(uint8_t i = 0; i < EVENT_SOURCE_COUNT; i++) {
+      if(!hasPending[i]) continue;
+      if(oldest < 0 || (int32_t)(pending[i].time - pending[oldest].time) < 0) oldest = i;
+    }
+    if(oldest < 0) break;
+
+    handleEvent(&pending[oldest]);
+    hasPending[oldest] = popEvent(&eventQueues[oldest], &pending[oldest]);
+  }
+}
+
+void handleEvent(struct InputEvent *event) {
+  // Com o menu aberto os botoes navegam na busca em vez de controlar a faixa
+  bool handled = menu.active && menuHandleEvent(event->type);
+  if(!handled) switch (event->type)
+  {
+    case NEXT_SONG_EVENT: { nextSong(); break; }
+    case PREVIUS_SONG_EVENT: { previusSong(); break; }
+    case VOLUME_UP_EVENT: { volumeUp(); break; }
+    case VOLUME_DOWN_EVENT: { volumeDown(); break; }
+    case RANDOM_EVENT: { changeRandomMode(); break; }
+    case PLAY_PAUSE_SONG_EVENT: { playResume(); break; }
+    case MAIN_MENU_EVENT: { menuOpen(); break; }
+    case PROFILE_DUMP_EVENT: { profileDump(true); break; }
+    case RADIO_SCAN_EVENT: { hc12Request(HC12_JOB_SCAN); break; }
+    case RADIO_BENCH_EVENT: { hc12Request(HC12_JOB_BENCH); break; }
+    case CARD_BENCH_EVENT: { cardBenchRun(); break; }
+    case SPECTRUM_EVENT: { spectrumToggle(); screen.valid = false; break; }
+    case EQ_EVENT: { eqNext(); break; }
+  }
+
+  uint32_t latency = halMicros() - event->time;
+  eventHandledCount++;
+  eventTotalLatency += latency;
+  if(latency > eventMaxLatency) eventMaxLatency = latency;
+}
+
+void reportEventStats() {
+  if(eventHandledCount == eventReportedCount) return;
+  eventReportedCount = eventHandledCount;
+
+  uint32_t dropped = 0;
+  for(uint8_t i = 0; i < EVENT_SOURCE_COUNT; i++) dropped += eventQueues[i].dropped;
+  halLogf(
+    "Eventos: %lu tratados, latencia media %lu us, max %lu us, %lu descartados\n",
+    (unsigned long)eventHandledCount,
+    (unsigned long)(eventTotalLatency / eventHandledCount),
+    (unsigned long)eventMaxLatency,
+    (unsigned long)dropped
+  );
+}
+
+// So fala quando o DMA do I2S esvaziou desde o ultimo relatorio
+void reportAudioStats() {
+  uint32_t underruns = halDecoderUnderruns();
+  if(underruns == audioReportedUnderruns) return;
+  halLogf(
+    "ERR: I2S sem dados %lu vezes (+%lu)\n",
+    (unsigned long)underruns,
+    (unsigned long)(underruns - audioReportedUnderruns)
+  );
+  audioReportedUnderruns = underruns;
+}
+
+// Troca o fator quando o registro de tags da faixa atual fica pronto
+void watchTrackGain() {
+  if(libraryFileCounter == 0) return;
+  uint32_t track = folders[folderIndex].firstFile + fileIndex;
+  if(track == gainTrack) return;
+
+  struct TrackTags tags;
+  if(!metadataTake(track, &tags)) return;
+  gainTrack = track;
+  trackGain = tags.gain == 0 ? REPLAYGAIN_UNITY : (int32_t)(powf(10.0f, tags.gain / 2000.0f) * REPLAYGAIN_UNITY + 0.5f);
+}
+
+/**
+ * Fim de arquivo troca de faixa na hora. Sem fim de arquivo, quadros parados
+ * por TRACK_STALL_TIMEOUT com a faixa tocando sao falta de dados, nao o fim:
+ * reabre a faixa onde parou e so pula depois de TRACK_STALL_RETRIES tentativas.
+ */
+void watchTrackPlaying() {
+  uint32_t now = halMillis();
+  if(trackEnded) {
+    trackEnded = false;
+    trackGapStart = trackEndTime;
+    trackGapPending = true;
+    stallRetries = 0;
+    nextSong();
+    stallSince = now;
+    return;
+  }
+
+  // As tentativas so zeram quando a faixa passa do ponto onde parou ou muda
+  uint32_t frames = audioFrames;
+  if(frames != stallFrames) {
+    stallFrames = frames;
+    stallSince = now;
+    if(
+      folderIndex != stallFolder || fileIndex != stallFile ||
+      halDecoderCurrentTime() > stallPosition
+    ) stallRetries = 0;
+    return;
+  }
+  if(!pauseResumeStatus) {
+    stallSince = now;
+    return;
+  }
+  if(now - stallSince < TRACK_STALL_TIMEOUT) return;
+
+  stallSince = now;
+  if(stallRetries < TRACK_STALL_RETRIES) {
+    uint32_t position = halDecoderCurrentTime();
+    stallRetries++;
+    stallPosition = position;
+    stallFolder = folderIndex;
+    stallFile = fileIndex;
+    halLogf(
+      "Faixa parada sem dados ha %u ms em %lu s, reabrindo (%u/%u)\n",
+      TRACK_STALL_TIMEOUT, (unsigned long)position, stallRetries, TRACK_STALL_RETRIES
+    );
+    loadSD(fileIndex, folderIndex);
+    if(position > 0) halDecoderSeek(position);
+  }
+  else {
+    halLogf("Faixa parada sem dados, pulando\n");
+    stallRetries = 0;
+    nextSong();
+  }
+}
+
+void reportTrackGap() {
+  if(!trackGapPending || firstAudioPending) return;
+  trackGapPending = false;
+
+  uint32_t gap = (firstAudioTime - trackGapStart) / 1000;
+  trackGapCount++;
+  trackGapTotal += gap;
+  if(gap > trackGapMax) trackGapMax = gap;
+  halLogf(
+    "Entre faixas: %lu ms | media %lu ms, max %lu ms, %lux\n",
+    (unsigned long)gap,
+    (unsigned long)(trackGapTotal / trackGapCount),
+    (unsigned long)trackGapMax,
+    (unsigned long)trackGapCount
+  );
+}
@@ -0,0 +1,80 @@
+/**
+ * Estado de reproducao e navegacao entre faixas
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include "library.h"
+#include "events.h"
+
+#define RANDOM_NORMAL 0
+#define RANDOM_IN_FOLDER 1
+#define RANDOM_ALL_SONGS 2
+#define REPEAT_SONG 3
+
+/**
+ * Fim de faixa: o backend avisa o fim do arquivo por playerTrackEnded() e o
+ * loop ja carrega a proxima. Separado disso, o watchdog olha se os quadros
+ * pararam de chegar com a faixa tocando (cartao lento, erro de leitura):
+ * reabre a faixa na mesma posicao TRACK_STALL_RETRIES vezes antes de pular.
+ */
+#define TRACK_STALL_TIMEOUT 2000 // ms sem quadros com a faixa tocando
+#define TRACK_STALL_RETRIES 2
+
+/**
+ * Prefetch da proxima faixa: o loop principal pede a faixa que viria depois da
+ * atual e prefetchRun() (a tarefa no PRO core na placa) monta o caminho e
+ * chama halDecoderPrefetch(), que abre o arquivo e le o primeiro buffer. Na
+ * troca, halDecoderOpen() do mesmo caminho entrega ao decoder o arquivo ja
+ * aberto e esse buffer, sem busca no diretorio nem espera pela primeira
+ * leitura do cartao. prefetchRequestId/prefetchReadyId evitam usar o caminho
+ * enquanto prefetchRun() o reescreve para um pedido mais novo.
+ */
+#define PREFETCH_PATH_SIZE (maxFileNameSize * 2 + 2)
+
+/**
+ * ReplayGain: o ganho da faixa vem do cache de tags (metadata.h) e e aplicado
+ * em playerAudioFrame() como uma multiplicacao Q14 com saturacao por sample.
+ * O loadSD() volta o fator para a unidade e pede as tags antes de abrir o
+ * arquivo; o pedido acorda a tarefa das tags, que le o registro enquanto o
+ * decoder abre. Se o registro chega antes do primeiro quadro, a faixa ja
+ * comeca com o ganho; senao os primeiros quadros saem na unidade e o fator
+ * anda REPLAYGAIN_RAMP_STEP por quadro ate o novo ganho (de +12 dB a -24 dB
+ * em menos de 0,1 s a 44,1 kHz), sem o degrau audivel de uma troca direta.
+ */
+#define REPLAYGAIN_SHIFT 14
+#define REPLAYGAIN_UNITY (1 << REPLAYGAIN_SHIFT)
+#define REPLAYGAIN_RAMP_STEP 16 // Passo Q14 por quadro
+
+extern int16_t folderIndex;
+extern uint16_t fileIndex;
+extern bool pauseResumeStatus; // 1 -> Play; 0 -> Pause
+extern uint8_t volume;
+extern uint8_t randomMode;
+extern uint8_t button_event;
+
+void playerBegin(void);
+void playerLoop(void);
+void playerAudioFrame(int16_t *frame);
+void playerTrackEnded(void);
+void loadSD(int16_t _fileIndex, int16_t _folderIndex);
+bool buildTrackPath(char *path, size_t size, int16_t folder, uint16_t file);
+void watchTrackPlaying(void);
+void watchTrackGain(void);
+void resolveSong(int8_t direction, int16_t *folder, uint16_t *file, uint32_t *pass);
+void nextSong(void);
+void previusSong(void);
+void playResume(void);
+void volumeUp(void);
+void volumeDown(void);
+void changeRandomMode(void);
+void requestPrefetch(void);
+void prefetchRun(void);
+void reportSkipLatency(void);
+void dispatchEvents(void);
+void handleEvent(struct InputEvent *event);
+void reportEventStats(void);
+void reportAudioStats(void);
+void reportTrackGap(void);
@@ -0,0 +1,173 @@
+#include "profiler.h"
+#include <stdio.h>
+#include <string.h>
+
+#define PROFILE_LINE_SIZE 192
+
+#ifdef PLAYER_PROFILE
+
+const char* profileStageNames[PROFILE_STAGE_COUNT] = {
+  "botoes", "eventos", "display", "verificacao", "decoder", "loadSD", "intervalo"
+};
+
+struct ProfileStage profileStages[PROFILE_STAGE_COUNT];
+struct ProfileSample profileRing[PROFILE_RING_SIZE];
+struct ProfileSample profileCurrent;
+uint32_t profileRingHead = 0; // Total de voltas gravadas no anel
+uint32_t profileCyclesPerMicro = 0;
+uint32_t profileLastDecoderCall = 0; // Estas duas so a tarefa do decoder usa
+bool profileHasDecoderCall = false;
+uint32_t profileWindowStart = 0;
+uint32_t profileLoops = 0;
+
+// Escritos so pela tarefa do decoder: [0] decoder, [1] intervalo
+struct ProfileStage profileDecoderStages[2];
+volatile uint32_t profileDecoderSequence = 0; // Impar enquanto a tarefa do decoder escreve
+volatile uint32_t profileDecoderResetWanted = 0; // O loop incrementa para pedir zerar
+volatile uint32_t profileDecoderResetDone = 0;
+
+bool isDecoderStage(uint8_t stage) {
+  return stage == PROFILE_STAGE_DECODER || stage == PROFILE_STAGE_DECODER_GAP;
+}
+
+void addToStage(struct ProfileStage *s, uint32_t us) {
+  s->count++;
+  s->totalUs += us;
+  if(us > s->maxUs) s->maxUs = us;
+
+  uint8_t bucket = 0;
+  while(bucket < PROFILE_BUCKETS - 1 && (us >> (bucket + PROFILE_FIRST_BUCKET_BITS)) != 0) bucket++;
+  s->buckets[bucket]++;
+}
+
+void profileRecord(uint8_t stage, uint32_t cycles) {
+  if(profileCyclesPerMicro == 0) profileCyclesPerMicro = halCyclesPerMicro();
+  uint32_t us = cycles / profileCyclesPerMicro;
+
+  if(isDecoderStage(stage)) {
+    __atomic_fetch_add(&profileDecoderSequence, 1, __ATOMIC_SEQ_CST);
+    uint32_t wanted = __atomic_load_n(&profileDecoderResetWanted, __ATOMIC_ACQUIRE);
+    if(wanted != profileDecoderResetDone) {
+      memset(profileDecoderStages, 0, sizeof(profileDecoderStages));
+      __atomic_store_n(&profileDecoderResetDone, wanted, __ATOMIC_RELEASE);
+    }
+    addToStage(&profileDecoderStages[stage == PROFILE_STAGE_DECODER ? 0 : 1], us);
+    __atomic_fetch_add(&profileDecoderSequence, 1, __ATOMIC_SEQ_CST);
+    return;
+  }
+
+  addToStage(&profileStages[stage], us);
+  uint32_t total = profileCurrent.us[stage] + us;
+  profileCurrent.us[stage] = total > 0xFFFF ? 0xFFFF : total;
+}
+
+// Copia consistente dos acumuladores do decoder, feita no loop
+void profileDecoderSnapshot(struct ProfileStage *out) {
+  uint32_t before, after;
+  do {
+    before = __atomic_load_n(&profileDecoderSequence, __ATOMIC_ACQUIRE);
+    memcpy(out, profileDecoderStages, sizeof(profileDecoderStages));
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    after = __atomic_load_n(&profileDecoderSequence, __ATOMIC_RELAXED);
+  } while((before & 1) || before != after);
+  // Zerar ja foi pedido, mas o decoder ainda nao rodou desde entao
+  if(profileDecoderResetWanted != __atomic_load_n(&profileDecoderResetDone, __ATOMIC_ACQUIRE)) {
+    memset(out, 0, sizeof(profileDecoderStages));
+  }
+}
+
+void profileDecoderCall(uint32_t now) {
+  // Depois de um profileReset() o intervalo recomeca a contar nesta chamada
+  if(__atomic_load_n(&profileDecoderResetWanted, __ATOMIC_ACQUIRE) != profileDecoderResetDone) profileHasDecoderCall = false;
+  if(profileHasDecoderCall) profileRecord(PROFILE_STAGE_DECODER_GAP, now - profileLastDecoderCall);
+  profileLastDecoderCall = now;
+  profileHasDecoderCall = true;
+}
+
+void profileLoopEnd() {
+  profileRing[profileRingHead % PROFILE_RING_SIZE] = profileCurrent;
+  profileRingHead++;
+  memset(&profileCurrent, 0, sizeof(profileCurrent));
+  profileLoops++;
+
+  if(PROFILE_DUMP_INTERVAL > 0 && halMillis() - profileWindowStart > PROFILE_DUMP_INTERVAL) {
+    profileDump(false);
+  }
+}
+
+/**
+ * Imprime e zera a janela. O tempo gasto no proprio log nao entra no
+ * intervalo do decoder, que recomeca a contar na proxima chamada.
+ */
+void profileDump(bool withRing) {
+  char line[PROFILE_LINE_SIZE];
+
+  halLogf(
+    "Perfil: %lu voltas em %lu ms, %lu underruns do I2S, buckets ate 2^n us a partir de %u us\n",
+    (unsigned long)profileLoops,
+    (unsigned long)(halMillis() - profileWindowStart),
+    (unsigned long)halDecoderUnderruns(),
+    1 << PROFILE_FIRST_BUCKET_BITS
+  );
+  struct ProfileStage decoderStages[2];
+  profileDecoderSnapshot(decoderStages);
+  for(uint8_t i = 0; i < PROFILE_STAGE_COUNT; i++) {
+    struct ProfileStage *s = &profileStages[i];
+    if(isDecoderStage(i)) s = &decoderStages[i == PROFILE_STAGE_DECODER ? 0 : 1];
+    if(s->count == 0) continue;
+
+    int length = snprintf(
+      line, sizeof(line), " %-11s n %lu, media %lu us, max %lu us |",
+      profileStageNames[i],
+      (unsigned long)s->count,
+      (unsigned long)(s->totalUs / s->count),
+      (unsigned long)s->maxUs
+    );
+    for(uint8_t b = 0; b < PROFILE_BUCKETS && length < (int)sizeof(line); b++) {
+      length += snprintf(line + length, sizeof(line) - length, " %lu", (unsigned long)s->buckets[b]);
+    }
+    halLogf("%s\n", line);
+  }
+
+  if(withRing) {
+    uint32_t count = profileRingHead < PROFILE_RING_SIZE ? profileRingHead : PROFILE_RING_SIZE;
+    int length = snprintf(line, sizeof(line), "Perfil: ultimas %lu voltas, us por etapa:", (unsigned long)count);
+    for(uint8_t i = 0; i < PROFILE_STAGE_COUNT && length < (int)sizeof(line); i++) {
+      if(isDecoderStage(i)) continue;
+      length += snprintf(line + length, sizeof(line) - length, " %s", profileStageNames[i]);
+    }
+    halLogf("%s\n", line);
+    for(uint32_t n = profileRingHead - count; n != profileRingHead; n++) {
+      struct ProfileSample *sample = &profileRing[n % PROFILE_RING_SIZE];
+      length = 0;
+      for(uint8_t i = 0; i < PROFILE_STAGE_COUNT && length < (int)sizeof(line); i++) {
+        if(isDecoderStage(i)) continue;
+        length += snprintf(line + length, sizeof(line) - length, " %u", sample->us[i]);
+      }
+      halLogf("%s\n", line);
+    }
+  }
+
+  profileReset();
+}
+
+// Os acumuladores do decoder sao zerados pela propria tarefa dele, no proximo registro
+void profileReset() {
+  memset(profileStages, 0, sizeof(profileStages));
+  __atomic_fetch_add(&profileDecoderResetWanted, 1, __ATOMIC_RELEASE);
+  profileLoops = 0;
+  profileWindowStart = halMillis();
+}
+
+#else
+
+void profileRecord(uint8_t stage, uint32_t cycles) {}
+void profileDecoderCall(uint32_t now) {}
+void profileLoopEnd() {}
+void profileReset() {}
+
+void profileDump(bool withRing) {
+  halLogf("Perfil: compilado sem PLAYER_PROFILE\n");
+}
+
+#endif
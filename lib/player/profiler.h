@@ -0,0 +1,64 @@
+/**
+ * Profiler do loop principal, ligado com -DPLAYER_PROFILE (env:profile no
+ * platformio.ini). Cada etapa do loop e o loadSD() sao medidos com o contador
+ * de ciclos e vao para um histograma de buckets fixos, junto com o maior
+ * intervalo entre duas chamadas do decoder: se esse intervalo passa do que o
+ * buffer do I2S segura, o audio engasga. As ultimas voltas do loop ficam num
+ * anel estatico para ver o que aconteceu logo antes de um engasgo.
+ *
+ * Na placa o decoder e o intervalo sao medidos na tarefa do decoder: ficam em
+ * acumuladores so dela, que o loop le por uma copia conferida com um contador
+ * de sequencia e zera por pedido, e nao entram no anel do loop.
+ *
+ * O resumo sai no log a cada PROFILE_DUMP_INTERVAL e com o anel pelo comando
+ * PROFILE do radio. Sem a flag as macros ficam vazias e nada e medido.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include "hal.h"
+
+#define PROFILE_STAGE_BUTTONS 0
+#define PROFILE_STAGE_EVENTS 1
+#define PROFILE_STAGE_DISPLAY 2
+#define PROFILE_STAGE_WATCH 3
+#define PROFILE_STAGE_DECODER 4
+#define PROFILE_STAGE_LOAD 5 // Dentro de eventos ou da verificacao de faixa
+#define PROFILE_STAGE_DECODER_GAP 6 // Entre o inicio de duas chamadas do decoder
+#define PROFILE_STAGE_COUNT 7
+
+#define PROFILE_BUCKETS 12 // Bucket i ate 2^(i + 4) us, o ultimo acumula o resto
+#define PROFILE_FIRST_BUCKET_BITS 4
+#define PROFILE_RING_SIZE 64
+#define PROFILE_DUMP_INTERVAL 30000 // ms; 0 so pelo comando PROFILE
+
+struct ProfileStage {
+  uint32_t count;
+  uint64_t totalUs;
+  uint32_t maxUs;
+  uint32_t buckets[PROFILE_BUCKETS];
+};
+
+// Uma volta do loop, em us por etapa (satura em 65535)
+struct ProfileSample {
+  uint16_t us[PROFILE_STAGE_COUNT];
+};
+
+#ifdef PLAYER_PROFILE
+#define PROFILE_BEGIN(stage) uint32_t profileStart_##stage = halCycles()
+#define PROFILE_END(stage) profileRecord(stage, halCycles() - profileStart_##stage)
+#define PROFILE_DECODER_CALL() profileDecoderCall(halCycles())
+#define PROFILE_LOOP_END() profileLoopEnd()
+#else
+#define PROFILE_BEGIN(stage)
+#define PROFILE_END(stage)
+#define PROFILE_DECODER_CALL()
+#define PROFILE_LOOP_END()
+#endif
+
+void profileRecord(uint8_t stage, uint32_t cycles);
+void profileDecoderCall(uint32_t now);
+void profileLoopEnd(void);
+void profileDump(bool withRing);
+void profileReset(void);
@@ -0,0 +1,143 @@
+#include "radio.h"
+#include "events.h"
+#include "telemetry.h"
+#include "hc12.h"
+#include "hal.h"
+#include <string.h>
+
+#define RADIO_COMMAND(text, event) { text, radioLength(text), radioHash(text), event }
+constexpr struct RadioCommand radioCommands[] = {
+  RADIO_COMMAND("NEXT_SONG", NEXT_SONG_EVENT),
+  RADIO_COMMAND("PREVIUS_SONG", PREVIUS_SONG_EVENT),
+  RADIO_COMMAND("VOL_U", VOLUME_UP_EVENT),
+  RADIO_COMMAND("VOL_D", VOLUME_DOWN_EVENT),
+  RADIO_COMMAND("RANDOM_MODE", RANDOM_EVENT),
+  RADIO_COMMAND("PLAY_PAUSE", PLAY_PAUSE_SONG_EVENT),
+  RADIO_COMMAND("MAIN_MENU", MAIN_MENU_EVENT),
+  RADIO_COMMAND("PROFILE", PROFILE_DUMP_EVENT),
+  RADIO_COMMAND("RADIO_SCAN", RADIO_SCAN_EVENT),
+  RADIO_COMMAND("RADIO_BENCH", RADIO_BENCH_EVENT),
+  RADIO_COMMAND("SD_BENCH", CARD_BENCH_EVENT),
+  RADIO_COMMAND("SPECTRUM", SPECTRUM_EVENT),
+  RADIO_COMMAND("EQ", EQ_EVENT),
+};
+#define RADIO_COMMAND_COUNT (sizeof(radioCommands) / sizeof(radioCommands[0]))
+
+struct RadioParser radioParser = { {0}, 0, RADIO_HASH_SEED };
+
+// Le o que chegou do HC-12 e coloca os comandos completos na fila do radio
+void radioPoll() {
+  if(hc12Step()) return; // Bytes da UART sao respostas AT
+  uint8_t event = NO_BTN_EVENT;
+  while(halRadioAvailable() > 0) {
+    event = radioParseByte(&radioParser, halRadioRead(), halMillis());
+    if(event != NO_BTN_EVENT) pushEvent(EVENT_SOURCE_RADIO, event);
+  }
+  event = radioParseIdle(&radioParser, halMillis());
+  if(event != NO_BTN_EVENT) pushEvent(EVENT_SOURCE_RADIO, event);
+}
+
+uint8_t crc8(const uint8_t *data, uint8_t length) {
+  uint8_t crc = 0;
+  for(uint8_t i = 0; i < length; i++) {
+    crc ^= data[i];
+    for(uint8_t bit = 0; bit < 8; bit++) {
+      crc = crc & 0x80 ? (crc << 1) ^ 0x07 : crc << 1;
+    }
+  }
+  return crc;
+}
+
+uint8_t radioMatchText(struct RadioParser *parser) {
+  uint8_t event = NO_BTN_EVENT;
+  if(parser->length > 0 && !parser->overflow) {
+    for(uint8_t i = 0; i < RADIO_COMMAND_COUNT; i++) {
+      if(
+        radioCommands[i].hash == parser->hash &&
+        radioCommands[i].length == parser->length &&
+        memcmp(radioCommands[i].text, parser->text, parser->length) == 0
+      ) {
+        event = radioCommands[i].event;
+        break;
+      }
+    }
+    if(event == NO_BTN_EVENT) parser->badFrames++;
+  }
+  parser->length = 0;
+  parser->hash = RADIO_HASH_SEED;
+  parser->overflow = false;
+  return event;
+}
+
+uint8_t radioMatchBinary(struct RadioParser *parser, uint32_t now) {
+  uint8_t seq = parser->binary[0];
+  uint8_t event = parser->binary[1];
+  parser->binaryLength = 0;
+  parser->inBinary = false;
+
+  bool valid = crc8(parser->binary, 2) == parser->binary[2];
+  if(valid && event == RADIO_TELEMETRY_ACK) {
+    telemetryAcknowledge(seq);
+    return NO_BTN_EVENT;
+  }
+  if(!valid || event == NO_BTN_EVENT || event > MAX_EVENT) {
+    parser->badFrames++;
+    return NO_BTN_EVENT;
+  }
+  // O controle repete o mesmo quadro para garantir a entrega; so o primeiro vale
+  if(parser->hasSeq && seq == parser->lastSeq && now - parser->lastSeqTime < RADIO_DUPLICATE_WINDOW) {
+    parser->duplicates++;
+    return NO_BTN_EVENT;
+  }
+  parser->hasSeq = true;
+  parser->lastSeq = seq;
+  parser->lastSeqTime = now;
+  return event;
+}
+
+/**
+ * Consome um byte vindo do HC-12 e devolve o evento quando um quadro fecha.
+ * Texto: o comando em ASCII terminado por '\n' ou '\r'.
+ * Binario: RADIO_FRAME_START, seq, evento, crc8(seq, evento).
+ */
+uint8_t radioParseByte(struct RadioParser *parser, uint8_t byte, uint32_t now) {
+  parser->lastByteTime = now;
+  parser->bytes++;
+
+  if(parser->inBinary) {
+    parser->binary[parser->binaryLength++] = byte;
+    if(parser->binaryLength == sizeof(parser->binary)) return radioMatchBinary(parser, now);
+    return NO_BTN_EVENT;
+  }
+  if(byte == RADIO_FRAME_START) {
+    uint8_t event = radioMatchText(parser);
+    parser->inBinary = true;
+    parser->binaryLength = 0;
+    return event;
+  }
+  if(byte == '\n' || byte == '\r') return radioMatchText(parser);
+
+  if(parser->length < RADIO_FRAME_MAX) {
+    parser->text[parser->length++] = byte;
+    parser->hash = (parser->hash ^ byte) * RADIO_HASH_PRIME;
+  }
+  else parser->overflow = true;
+  return NO_BTN_EVENT;
+}
+
+// Controles antigos nao mandam delimitador: fecha o quadro depois de um silencio na linha
+uint8_t radioParseIdle(struct RadioParser *parser, uint32_t now) {
+  if(now - parser->lastByteTime < RADIO_FRAME_GAP) return NO_BTN_EVENT;
+  if(parser->inBinary) {
+    parser->badFrames++;
+    parser->inBinary = false;
+    parser->binaryLength = 0;
+    return NO_BTN_EVENT;
+  }
+  return radioMatchText(parser);
+}
+
+// Nada chegando ha gap ms e nenhum quadro pela metade: o HC-12 pode transmitir
+bool radioLineIdle(uint32_t now, uint32_t gap) {
+  return now - radioParser.lastByteTime >= gap && !radioParser.inBinary && radioParser.length == 0;
+}
@@ -0,0 +1,59 @@
+/**
+ * Protocolo do controle remoto. Os comandos em texto sao comparados pelo hash
+ * FNV-1a calculado enquanto os bytes chegam, contra a tabela em radio.cpp
+ * montada em tempo de compilacao; o memcmp final so confirma o candidato.
+ * O caminho de volta (estado da reproducao para o controle) esta em telemetry.h.
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+#define RADIO_FRAME_MAX 16
+#define RADIO_FRAME_START 0xA5
+#define RADIO_FRAME_GAP 20 // ms sem bytes para fechar um quadro sem delimitador
+#define RADIO_DUPLICATE_WINDOW 1000
+#define RADIO_POLL_INTERVAL 5
+#define RADIO_TELEMETRY_ACK 0xAC // Evento do quadro binario que confirma o quadro de telemetria seq
+#define RADIO_HASH_SEED 2166136261u
+#define RADIO_HASH_PRIME 16777619u
+
+constexpr uint32_t radioHash(const char *text, uint32_t hash = RADIO_HASH_SEED) {
+  return *text ? radioHash(text + 1, (hash ^ (uint8_t)*text) * RADIO_HASH_PRIME) : hash;
+}
+constexpr uint8_t radioLength(const char *text) {
+  return *text ? 1 + radioLength(text + 1) : 0;
+}
+
+struct RadioCommand {
+  const char *text;
+  uint8_t length;
+  uint32_t hash;
+  uint8_t event;
+};
+
+struct RadioParser {
+  char text[RADIO_FRAME_MAX];
+  uint8_t length;
+  uint32_t hash;
+  bool overflow;
+  uint8_t binary[3];
+  uint8_t binaryLength;
+  bool inBinary;
+  bool hasSeq;
+  uint8_t lastSeq;
+  uint32_t lastSeqTime;
+  uint32_t lastByteTime;
+  uint32_t bytes;
+  uint32_t badFrames;
+  uint32_t duplicates;
+};
+extern struct RadioParser radioParser;
+
+void radioPoll(void);
+uint8_t crc8(const uint8_t *data, uint8_t length);
+uint8_t radioParseByte(struct RadioParser *parser, uint8_t byte, uint32_t now);
+uint8_t radioParseIdle(struct RadioParser *parser, uint32_t now);
+bool radioLineIdle(uint32_t now, uint32_t gap);
+uint8_t radioMatchText(struct RadioParser *parser);
+uint8_t radioMatchBinary(struct RadioParser *parser, uint32_t now);
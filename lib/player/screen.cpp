@@ -0,0 +1,498 @@
+#include "screen.h"
+#include "player.h"
+#include "hal.h"
+#include <string.h>
+#include <stdio.h>
+
+// 'fill_heart', 8x8px - Música curtida
+const unsigned char bmp_fill_heart [] = {
+	0x66, 0xff, 0xff, 0xff, 0xff, 0x7e, 0x3c, 0x18
+};
+// 'ouline_heart', 8x8px - Música não curtida
+const unsigned char bmp_ouline_heart [] = {
+	0x66, 0x99, 0x81, 0x81, 0x81, 0x42, 0x24, 0x18
+};
+// 'pause', 8x8px - Música parada
+const unsigned char bmp_pause [] = {
+	0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66
+};
+// 'play', 8x8px - Reproduzindo
+const unsigned char bmp_play [] = {
+	0xe0, 0xf8, 0xfe, 0xff, 0xff, 0xfe, 0xf8, 0xe0
+};
+// 'replay', 8x8px - Ao final do numero de música, retorna a primeira musica
+const unsigned char bmp_replay [] = {
+	0x80, 0xc0, 0xff, 0x00, 0x00, 0xff, 0x06, 0x04
+};
+// 'random_all', 8x8px - Aleatória para todas músicas
+const unsigned char bmp_random_all [] = {
+	0xfc, 0x80, 0x86, 0x84, 0x21, 0x61, 0x01, 0x3f
+};
+// 'random_folder', 8x8px - Aleatório dentro de uma pasta
+const unsigned char bmp_random_folder [] = {
+	0xe0, 0x80, 0xc6, 0x84, 0x81, 0x01, 0x01, 0x3f
+};
+// 'repeat', 8x8px - Repete a mesma música
+const unsigned char bmp_repeat [] = {
+	0x18, 0x24, 0x02, 0x01, 0xc1, 0x82, 0x24, 0x18
+};
+
+// Array of all bitmaps for convenience. (Total bytes used to store images = 256)
+const int bmp_allArray_LEN = 8;
+const unsigned char* bmp_allArray[8] = {
+	bmp_fill_heart,
+	bmp_ouline_heart,
+	bmp_pause,
+	bmp_play,
+	bmp_random_all,
+	bmp_random_folder,
+	bmp_repeat,
+	bmp_replay
+};
+
+struct Screen screen;
+uint8_t dirtyStart[DISPLAY_PAGES] = { SCREEN_WIDTH, SCREEN_WIDTH, SCREEN_WIDTH, SCREEN_WIDTH, SCREEN_WIDTH, SCREEN_WIDTH, SCREEN_WIDTH, SCREEN_WIDTH };
+uint8_t dirtyEnd[DISPLAY_PAGES] = { DISPLAY_CLEAN, DISPLAY_CLEAN, DISPLAY_CLEAN, DISPLAY_CLEAN, DISPLAY_CLEAN, DISPLAY_CLEAN, DISPLAY_CLEAN, DISPLAY_CLEAN };
+uint32_t displayBytesSent = 0;
+
+/**
+ * Nome da faixa pre-renderizado: cada byte e uma coluna de 8 pixels, o mesmo
+ * formato das paginas do SSD1306, entao rolar o titulo e so copiar colunas.
+ */
+uint8_t titleStrip[TITLE_STRIP_MAX_WIDTH];
+int16_t titleStripWidth = 0;
+
+uint32_t g_DisplayTime = halMillis();
+uint32_t g_SerialTime = halMillis();
+uint32_t g_DisplayStatsTime = halMillis();
+uint32_t g_TitleTime = halMillis();
+uint32_t g_SpectrumTime = halMillis();
+uint8_t y_offset = 0;
+int16_t xPosName = -SCREEN_WIDTH;
+void updateDisplay(void) {
+  uint32_t crr_DisplayTime = halMillis();
+  uint32_t crr_SerialTime = halMillis();
+
+  if(screen.valid && !spectrumEnabled && titleStripWidth > SCREEN_WIDTH && (crr_DisplayTime - g_TitleTime) > TITLE_SCROLL_INTERVAL) {
+    g_TitleTime = crr_DisplayTime;
+    xPosName = xPosName + TITLE_SCROLL_STEP;
+    if(xPosName > titleStripWidth) xPosName = -SCREEN_WIDTH;
+    blitTitle(xPosName, displayLineThree + TITLE_Y_OFFSET);
+    flushDisplay();
+  }
+
+  // O analisador ocupa as linhas da pasta e do titulo
+  if(screen.valid && spectrumEnabled && screen.spectrumFrame != spectrumFrame && (crr_DisplayTime - g_SpectrumTime) > SPECTRUM_DRAW_INTERVAL) {
+    g_SpectrumTime = crr_DisplayTime;
+    screen.spectrumFrame = spectrumFrame;
+    drawSpectrum();
+    flushDisplay();
+  }
+
+  // O menu ocupa a tela toda; invalidar a tela faz a reproducao voltar inteira ao fechar
+  if(menu.active && (screen.valid || screen.menuVersion != menu.version)) {
+    drawMenu();
+    screen.valid = false;
+    screen.menuVersion = menu.version;
+    flushDisplay();
+  }
+
+  if(!menu.active && (crr_DisplayTime - g_DisplayTime) > 250) {
+    g_DisplayTime = crr_DisplayTime;
+
+    uint16_t audioFileDuration = halDecoderDuration();
+    uint16_t audioCurrentTime = halDecoderCurrentTime();
+
+    bool redrawAll = !screen.valid;
+    bool trackChanged = redrawAll || screen.folder != folderIndex || screen.file != fileIndex;
+    if(trackChanged) screen.tagsDuration = 0;
+    if(redrawAll) {
+      clearDisplayArea(0, 0, SCREEN_WIDTH, SCREEN_HEIGHT);
+      memset(screen.spectrumLevels, 0, sizeof(screen.spectrumLevels));
+      memset(screen.spectrumPeaks, 0, sizeof(screen.spectrumPeaks));
+    }
+    if(trackChanged && !spectrumEnabled) {
+      renderTitle(getFileName(folderIndex, fileIndex));
+      xPosName = titleStripWidth > SCREEN_WIDTH ? -SCREEN_WIDTH : 0;
+      blitTitle(xPosName, displayLineThree + TITLE_Y_OFFSET);
+    }
+
+    if(trackChanged || screen.volume != volume) {
+      char text[24];
+      clearDisplayArea(0, displayLineOne, SCREEN_WIDTH, letterHeight);
+      snprintf(text, sizeof(text), "%d de %d", fileIndex + 1, folders[folderIndex].fileCounter);
+      drawText(0, 0, text);
+      snprintf(text, sizeof(text), "V:%02u  ", volume);
+      int16_t x = drawText(SCREEN_WIDTH - (11 * letterWidth), 0, text);
+      snprintf(text, sizeof(text), " %s ", fileTypeNames[getFileType(folderIndex, fileIndex)]);
+      drawText(x, 0, text, true);
+    }
+
+    if(trackChanged && !spectrumEnabled) {
+      y_offset = 5;
+      clearDisplayArea(0, displayLineTwo + y_offset, SCREEN_WIDTH, letterHeight);
+      int16_t x = drawText(0, displayLineTwo + y_offset, "Pasta: ");
+      drawText(x, displayLineTwo + y_offset, getFolderName(folderIndex));
+    }
+
+    // As tags chegam da tarefa em segundo plano alguns ms depois da troca de faixa
+    struct TrackTags tags;
+    bool tagsShown = screen.tags && !trackChanged;
+    if(!tagsShown && metadataTake(folders[folderIndex].firstFile + fileIndex, &tags)) {
+      tagsShown = true;
+      screen.tagsDuration = tags.duration;
+      if(tags.status == TAG_FOUND && !spectrumEnabled) showTrackTags(&tags);
+    }
+    if(audioFileDuration == 0) audioFileDuration = screen.tagsDuration;
+
+    y_offset = 15;
+    if(redrawAll || screen.currentTime != audioCurrentTime) {
+      char played[9];
+      formatSeconds(played, audioCurrentTime);
+      clearDisplayArea(0, displayLineFor + y_offset, (SCREEN_WIDTH / 2) - 4 - 17, letterHeight);
+      drawText(0, displayLineFor + y_offset, played);
+    }
+
+    if(redrawAll || screen.duration != audioFileDuration) {
+      char total[9];
+      formatSeconds(total, audioFileDuration);
+      clearDisplayArea((SCREEN_WIDTH / 2) + 4 + 17, displayLineFor + y_offset, (SCREEN_WIDTH / 2) - 4 - 17, letterHeight);
+      drawText(SCREEN_WIDTH - ((strlen(total))  * letterWidth), displayLineFor + y_offset, total);
+    }
+
+    if(redrawAll || screen.randomMode != randomMode || screen.playing != pauseResumeStatus) {
+      clearDisplayArea((SCREEN_WIDTH / 2) - 4 - 17, displayLineFor + y_offset, 2 * 17 + 8, letterHeight);
+      if(randomMode == RANDOM_NORMAL)
+        drawBitmap((SCREEN_WIDTH / 2) - 4 - 17, displayLineFor + y_offset, bmp_replay, 8, 8, DISPLAY_WHITE);
+      if(randomMode == RANDOM_IN_FOLDER)
+        drawBitmap((SCREEN_WIDTH / 2) - 4 - 17, displayLineFor + y_offset, bmp_random_folder, 8, 8, DISPLAY_WHITE);
+      if(randomMode == RANDOM_ALL_SONGS)
+        drawBitmap((SCREEN_WIDTH / 2) - 4 - 17, displayLineFor + y_offset, bmp_random_all, 8, 8, DISPLAY_WHITE);
+      if(randomMode == REPEAT_SONG)
+        drawBitmap((SCREEN_WIDTH / 2) - 4 - 17, displayLineFor + y_offset, bmp_repeat, 8, 8, DISPLAY_WHITE);
+
+      if(pauseResumeStatus) {
+        drawBitmap((SCREEN_WIDTH / 2) - 4, displayLineFor + y_offset, bmp_pause, 8, 8, DISPLAY_WHITE);
+      }
+      else {
+        drawBitmap((SCREEN_WIDTH / 2) - 4, displayLineFor + y_offset, bmp_play, 8, 8, DISPLAY_WHITE);
+      }
+
+      drawBitmap((SCREEN_WIDTH / 2) - 4 + 17, displayLineFor + y_offset, bmp_fill_heart, 8, 8, DISPLAY_WHITE);
+    }
+
+    y_offset = 25;
+    uint8_t circleRadius = 4;
+    uint8_t circleXPos = 0;
+    if(audioCurrentTime != 0 && audioFileDuration != 0) {
+      uint8_t maxWidth = SCREEN_WIDTH - (2 * circleRadius);
+      float diff = (float)audioCurrentTime / (float)audioFileDuration;
+      circleXPos = (diff * maxWidth) + circleRadius;
+    }
+    if(redrawAll || screen.progressX != circleXPos) {
+      clearDisplayArea(0, displayLineFive + y_offset - circleRadius, SCREEN_WIDTH, 2 * circleRadius + 1);
+      if(circleXPos) {
+        drawFastHLine(0, displayLineFive + y_offset, 127, DISPLAY_WHITE);
+        fillCircle(circleXPos, displayLineFive + y_offset, circleRadius, DISPLAY_WHITE);
+      }
+    }
+
+    screen.valid = true;
+    screen.folder = folderIndex;
+    screen.file = fileIndex;
+    screen.volume = volume;
+    screen.currentTime = audioCurrentTime;
+    screen.duration = audioFileDuration;
+    screen.randomMode = randomMode;
+    screen.playing = pauseResumeStatus;
+    screen.progressX = circleXPos;
+    screen.tags = tagsShown;
+
+    flushDisplay();
+  }
+  if((crr_SerialTime - g_SerialTime) > 1000) {
+    g_SerialTime = crr_SerialTime;
+    reportSkipLatency();
+    reportEventStats();
+    reportAudioStats();
+    reportTrackGap();
+  }
+  if((crr_SerialTime - g_DisplayStatsTime) > DISPLAY_STATS_INTERVAL) {
+    halLogf(
+      "Display: %lu bytes/s para o painel\n",
+      (unsigned long)(displayBytesSent * 1000 / (crr_SerialTime - g_DisplayStatsTime))
+    );
+    g_DisplayStatsTime = crr_SerialTime;
+    displayBytesSent = 0;
+  }
+}
+
+// Prefixo com a letra candidata invertida, total e uma pagina de resultados
+void drawMenu() {
+  char text[25]; // "selected de count" com os dois uint32_t no maximo
+  clearDisplayArea(0, 0, SCREEN_WIDTH, SCREEN_HEIGHT);
+  int16_t x = drawText(0, displayLineOne, "Busca: ");
+  x = drawText(x, displayLineOne, menu.prefix);
+  if(menu.letter) {
+    text[0] = menu.letter;
+    text[1] = '\0';
+    drawText(x, displayLineOne, text, true);
+  }
+
+  if(menu.count == 0) {
+    drawText(0, displayLineTwo, "Nada encontrado");
+    return;
+  }
+  snprintf(text, sizeof(text), "%lu de %lu", (unsigned long)(menu.selected + 1), (unsigned long)menu.count);
+  drawText(0, displayLineTwo, text);
+
+  uint32_t page = menu.selected - menu.selected % MENU_RESULT_LINES;
+  for(uint8_t i = 0; i < MENU_RESULT_LINES && page + i < menu.count; i++) {
+    uint32_t entry = searchIndex[menu.first + page + i];
+    const char *name = searchIsFolder(entry) ? getFolderName(entry) : searchName(entry);
+    drawText(0, MENU_RESULTS_Y + i * letterHeight, name, page + i == menu.selected);
+  }
+}
+
+/**
+ * Barras do analisador de baixo para cima, com o pico numa linha acima delas.
+ * So as colunas das barras que mudaram vao para o painel.
+ */
+void drawSpectrum() {
+  int16_t bottom = SPECTRUM_Y + SPECTRUM_HEIGHT;
+  for(uint8_t bar = 0; bar < SPECTRUM_BARS; bar++) {
+    uint8_t level = spectrumLevels[bar];
+    uint8_t peak = spectrumPeaks[bar];
+    if(level == screen.spectrumLevels[bar] && peak == screen.spectrumPeaks[bar]) continue;
+    screen.spectrumLevels[bar] = level;
+    screen.spectrumPeaks[bar] = peak;
+
+    int16_t x = bar * SPECTRUM_BAR_WIDTH;
+    clearDisplayArea(x, SPECTRUM_Y, SPECTRUM_BAR_WIDTH - 1, SPECTRUM_HEIGHT);
+    if(level > 0) fillRect(x, bottom - level, SPECTRUM_BAR_WIDTH - 1, level, DISPLAY_WHITE);
+    if(peak > level) drawFastHLine(x, bottom - peak, SPECTRUM_BAR_WIDTH - 1, DISPLAY_WHITE);
+  }
+}
+
+/**
+ * Troca o nome do arquivo por "Artista - Titulo" e a pasta pelo album, quando
+ * as tags tem esses campos.
+ */
+void showTrackTags(const struct TrackTags *tags) {
+  if(tags->title[0] != '\0') {
+    char title[TAG_ARTIST_SIZE + TAG_TITLE_SIZE + 3];
+    if(tags->artist[0] != '\0') snprintf(title, sizeof(title), "%s - %s", tags->artist, tags->title);
+    else snprintf(title, sizeof(title), "%s", tags->title);
+    renderTitle(title);
+    xPosName = titleStripWidth > SCREEN_WIDTH ? -SCREEN_WIDTH : 0;
+    blitTitle(xPosName, displayLineThree + TITLE_Y_OFFSET);
+  }
+
+  if(tags->album[0] != '\0') {
+    uint8_t y = displayLineTwo + 5;
+    clearDisplayArea(0, y, SCREEN_WIDTH, letterHeight);
+    int16_t x = drawText(0, y, "Album: ");
+    drawText(x, y, tags->album);
+  }
+}
+
+// Rasteriza o nome uma vez por troca de faixa, copiando as colunas de cada caractere
+void renderTitle(const char *title) {
+  uint16_t length = strlen(title);
+  if(length > TITLE_STRIP_MAX_WIDTH / letterWidth) length = TITLE_STRIP_MAX_WIDTH / letterWidth;
+  titleStripWidth = length * letterWidth;
+
+  uint8_t *column = titleStrip;
+  for(uint16_t i = 0; i < length; i++) {
+    memcpy(column, halDisplayGlyph((uint8_t)title[i]), HAL_GLYPH_WIDTH);
+    memset(column + HAL_GLYPH_WIDTH, 0, letterWidth - HAL_GLYPH_WIDTH);
+    column += letterWidth;
+  }
+}
+
+/**
+ * Copia as colunas visiveis da faixa para o framebuffer, deslocadas para a
+ * linha y, e marca em cada pagina so o trecho de colunas que mudou: o espaco
+ * antes e depois do nome e as colunas iguais nas pontas nao vao para o I2C.
+ */
+void blitTitle(int16_t offset, int16_t y) {
+  uint8_t *buffer = halDisplayBuffer();
+  uint8_t *top = buffer + (y / 8) * SCREEN_WIDTH;
+  uint8_t *bottom = top + SCREEN_WIDTH;
+  uint8_t shift = y % 8;
+  uint8_t topMask = 0xFF << shift;
+  uint8_t bottomMask = shift ? 0xFF >> (8 - shift) : 0;
+  int16_t topFirst = SCREEN_WIDTH, topLast = -1;
+  int16_t bottomFirst = SCREEN_WIDTH, bottomLast = -1;
+
+  for(int16_t x = 0; x < SCREEN_WIDTH; x++) {
+    int16_t column = x + offset;
+    uint8_t bits = column >= 0 && column < titleStripWidth ? titleStrip[column] : 0;
+    uint8_t value = (top[x] & ~topMask) | (bits << shift);
+    if(value != top[x]) {
+      top[x] = value;
+      if(topFirst == SCREEN_WIDTH) topFirst = x;
+      topLast = x;
+    }
+    if(!shift) continue;
+    value = (bottom[x] & ~bottomMask) | (bits >> (8 - shift));
+    if(value != bottom[x]) {
+      bottom[x] = value;
+      if(bottomFirst == SCREEN_WIDTH) bottomFirst = x;
+      bottomLast = x;
+    }
+  }
+  if(topLast >= 0) markDisplayDirty(topFirst, y & ~7, topLast - topFirst + 1, 1);
+  if(bottomLast >= 0) markDisplayDirty(bottomFirst, (y & ~7) + 8, bottomLast - bottomFirst + 1, 1);
+}
+
+void markDisplayDirty(int16_t x, int16_t y, int16_t w, int16_t h) {
+  if(x < 0) { w += x; x = 0; }
+  if(y < 0) { h += y; y = 0; }
+  if(x + w > SCREEN_WIDTH) w = SCREEN_WIDTH - x;
+  if(y + h > SCREEN_HEIGHT) h = SCREEN_HEIGHT - y;
+  if(w <= 0 || h <= 0) return;
+
+  for(uint8_t page = y / 8; page <= (y + h - 1) / 8; page++) {
+    if(x < dirtyStart[page]) dirtyStart[page] = x;
+    if(x + w - 1 > dirtyEnd[page] || dirtyEnd[page] == DISPLAY_CLEAN) dirtyEnd[page] = x + w - 1;
+  }
+}
+
+void clearDisplayArea(int16_t x, int16_t y, int16_t w, int16_t h) {
+  fillRect(x, y, w, h, DISPLAY_BLACK);
+  markDisplayDirty(x, y, w, h);
+}
+
+/**
+ * Envia para o SSD1306 apenas as colunas marcadas de cada pagina (8 linhas),
+ * em vez do framebuffer inteiro.
+ */
+void flushDisplay() {
+  for(uint8_t page = 0; page < DISPLAY_PAGES; page++) {
+    if(dirtyEnd[page] == DISPLAY_CLEAN) continue;
+    displayBytesSent += halDisplaySend(page, dirtyStart[page], dirtyEnd[page]);
+    dirtyStart[page] = SCREEN_WIDTH;
+    dirtyEnd[page] = DISPLAY_CLEAN;
+  }
+}
+
+void formatSeconds(char *timeBuffer, uint32_t seconds) {
+  uint32_t h, m, s, resto;
+
+  // Acima de 99 horas (so de duracao estimada errada) fica em 99:59:59, que cabe nos 9 bytes
+  if(seconds > 99 * 3600 + 59 * 60 + 59) seconds = 99 * 3600 + 59 * 60 + 59;
+  h = seconds / 3600;
+  resto = seconds % 3600;
+  m = resto / 60;
+  s = resto % 60;
+
+  if(h > 0) snprintf(timeBuffer, 9, "%02lu:%02lu:%02lu", (unsigned long)h, (unsigned long)m, (unsigned long)s);
+  else snprintf(timeBuffer, 9, "%02lu:%02lu", (unsigned long)m, (unsigned long)s);
+}
+
+/**
+ * Primitivas de desenho no framebuffer do HAL, com o mesmo resultado das
+ * chamadas equivalentes da Adafruit_GFX que a tela usava.
+ */
+void drawPixel(int16_t x, int16_t y, uint8_t color) {
+  if(x < 0 || x >= SCREEN_WIDTH || y < 0 || y >= SCREEN_HEIGHT) return;
+  uint8_t *column = halDisplayBuffer() + (y / 8) * SCREEN_WIDTH + x;
+  if(color == DISPLAY_WHITE) *column |= 1 << (y & 7);
+  else *column &= ~(1 << (y & 7));
+}
+
+// Pinta coluna a coluna, com uma mascara por pagina em vez de pixel a pixel
+void fillRect(int16_t x, int16_t y, int16_t w, int16_t h, uint8_t color) {
+  if(x < 0) { w += x; x = 0; }
+  if(y < 0) { h += y; y = 0; }
+  if(x + w > SCREEN_WIDTH) w = SCREEN_WIDTH - x;
+  if(y + h > SCREEN_HEIGHT) h = SCREEN_HEIGHT - y;
+  if(w <= 0 || h <= 0) return;
+
+  uint8_t *buffer = halDisplayBuffer();
+  for(uint8_t page = y / 8; page <= (y + h - 1) / 8; page++) {
+    int16_t top = page * 8 > y ? page * 8 : y;
+    int16_t bottom = page * 8 + 7 < y + h - 1 ? page * 8 + 7 : y + h - 1;
+    uint8_t mask = (0xFF << (top & 7)) & (0xFF >> (7 - (bottom & 7)));
+    uint8_t *column = buffer + page * SCREEN_WIDTH + x;
+    for(int16_t i = 0; i < w; i++) {
+      if(color == DISPLAY_WHITE) column[i] |= mask;
+      else column[i] &= ~mask;
+    }
+  }
+}
+
+void drawFastHLine(int16_t x, int16_t y, int16_t w, uint8_t color) {
+  fillRect(x, y, w, 1, color);
+}
+
+void drawFastVLine(int16_t x, int16_t y, int16_t h, uint8_t color) {
+  fillRect(x, y, 1, h, color);
+}
+
+void fillCircle(int16_t x0, int16_t y0, int16_t r, uint8_t color) {
+  drawFastVLine(x0, y0 - r, 2 * r + 1, color);
+
+  int16_t f = 1 - r;
+  int16_t ddF_x = 1;
+  int16_t ddF_y = -2 * r;
+  int16_t x = 0;
+  int16_t y = r;
+  int16_t px = x;
+  int16_t py = y;
+  while(x < y) {
+    if(f >= 0) {
+      y--;
+      ddF_y += 2;
+      f += ddF_y;
+    }
+    x++;
+    ddF_x += 2;
+    f += ddF_x;
+    if(x < (y + 1)) {
+      drawFastVLine(x0 + x, y0 - y, 2 * y + 1, color);
+      drawFastVLine(x0 - x, y0 - y, 2 * y + 1, color);
+    }
+    if(y != py) {
+      drawFastVLine(x0 + py, y0 - px, 2 * px + 1, color);
+      drawFastVLine(x0 - py, y0 - px, 2 * px + 1, color);
+      py = y;
+    }
+    px = x;
+  }
+}
+
+// Bitmap em linhas, bit mais significativo a esquerda; bits zerados ficam transparentes
+void drawBitmap(int16_t x, int16_t y, const uint8_t *bitmap, int16_t w, int16_t h, uint8_t color) {
+  int16_t byteWidth = (w + 7) / 8;
+  uint8_t b = 0;
+  for(int16_t j = 0; j < h; j++) {
+    for(int16_t i = 0; i < w; i++) {
+      if(i & 7) b <<= 1;
+      else b = bitmap[j * byteWidth + i / 8];
+      if(b & 0x80) drawPixel(x + i, y + j, color);
+    }
+  }
+}
+
+/**
+ * Escreve text a partir de (x, y) em celulas de letterWidth x letterHeight e
+ * devolve o x seguinte. Invertido pinta o fundo da celula e apaga a letra.
+ */
+int16_t drawText(int16_t x, int16_t y, const char *text, bool inverted) {
+  for(; *text; text++) {
+    if(*text == '\n' || *text == '\r') continue;
+    const uint8_t *glyph = halDisplayGlyph((uint8_t)*text);
+    for(uint8_t i = 0; i < letterWidth; i++) {
+      uint8_t bits = i < HAL_GLYPH_WIDTH ? glyph[i] : 0;
+      for(uint8_t j = 0; j < letterHeight; j++) {
+        bool set = bits & (1 << j);
+        if(inverted) drawPixel(x + i, y + j, set ? DISPLAY_BLACK : DISPLAY_WHITE);
+        else if(set) drawPixel(x + i, y + j, DISPLAY_WHITE);
+      }
+    }
+    x += letterWidth;
+  }
+  return x;
+}
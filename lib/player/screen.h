@@ -0,0 +1,81 @@
+/**
+ * Tela de reproducao no SSD1306, desenhada direto no framebuffer do HAL
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include "hal.h"
+#include "metadata.h"
+#include "menu.h"
+#include "spectrum.h"
+
+// Tamanho da tela OLED
+#define SCREEN_WIDTH HAL_DISPLAY_WIDTH
+#define SCREEN_HEIGHT HAL_DISPLAY_HEIGHT
+
+#define letterWidth 6
+#define letterHeight 8
+
+#define displayLineOne 0
+#define displayLineTwo 8
+#define displayLineThree 16
+#define displayLineFor 24
+#define displayLineFive 32
+#define displayLineSix 40
+#define displayLineSeven 48
+#define displayLineEight 56
+
+#define DISPLAY_BLACK 0
+#define DISPLAY_WHITE 1
+#define DISPLAY_PAGES (SCREEN_HEIGHT / 8)
+#define DISPLAY_CLEAN 0xFF
+#define DISPLAY_STATS_INTERVAL 10000
+
+#define TITLE_STRIP_MAX_WIDTH (255 * letterWidth) // Nome longo do FAT
+#define TITLE_Y_OFFSET 10
+#define TITLE_SCROLL_INTERVAL 250 // ms entre quadros do titulo, o passo do letreiro de antes
+#define TITLE_SCROLL_STEP 5 // pixels por quadro
+#define MENU_RESULTS_Y 20
+
+/**
+ * O que esta desenhado na tela agora. updateDisplay() so redesenha os elementos
+ * cujo valor mudou e marca as colunas tocadas de cada pagina do SSD1306.
+ */
+struct Screen {
+  bool valid;
+  int16_t folder;
+  uint16_t file;
+  uint8_t volume;
+  uint16_t currentTime;
+  uint16_t duration;
+  uint8_t randomMode;
+  bool playing;
+  uint8_t progressX;
+  bool tags;          // Tags da faixa ja aplicadas ao titulo
+  uint16_t tagsDuration; // Duracao do cache de tags, para quando o decoder nao sabe
+  uint32_t menuVersion;
+  uint32_t spectrumFrame;
+  uint8_t spectrumLevels[SPECTRUM_BARS];
+  uint8_t spectrumPeaks[SPECTRUM_BARS];
+};
+extern struct Screen screen;
+extern uint32_t displayBytesSent;
+
+void updateDisplay(void);
+void drawMenu(void);
+void drawSpectrum(void);
+void showTrackTags(const struct TrackTags *tags);
+void renderTitle(const char *title);
+void blitTitle(int16_t offset, int16_t y);
+void markDisplayDirty(int16_t x, int16_t y, int16_t w, int16_t h);
+void clearDisplayArea(int16_t x, int16_t y, int16_t w, int16_t h);
+void flushDisplay(void);
+void formatSeconds(char *timeBuffer, uint32_t seconds);
+void drawPixel(int16_t x, int16_t y, uint8_t color);
+void fillRect(int16_t x, int16_t y, int16_t w, int16_t h, uint8_t color);
+void drawFastHLine(int16_t x, int16_t y, int16_t w, uint8_t color);
+void drawFastVLine(int16_t x, int16_t y, int16_t h, uint8_t color);
+void fillCircle(int16_t x0, int16_t y0, int16_t r, uint8_t color);
+void drawBitmap(int16_t x, int16_t y, const uint8_t *bitmap, int16_t w, int16_t h, uint8_t color);
+int16_t drawText(int16_t x, int16_t y, const char *text, bool inverted = false);
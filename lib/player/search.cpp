@@ -0,0 +1,141 @@
+#include "search.h"
+#include <string.h>
+#include <stdlib.h>
+
+uint32_t *searchIndex = NULL; // Dentro da libraryArena
+uint32_t searchCounter = 0;
+
+uint8_t searchFold(char c);
+int searchSortCompare(const void *a, const void *b);
+bool searchable(uint32_t entry);
+
+/**
+ * Ordena todas as entradas no espaco da arena. Pastas vazias e a raiz nao tem
+ * o que tocar: vao para o fim e ficam fora de searchCounter.
+ */
+void buildSearchIndex() {
+  uint32_t startTime = halMillis();
+  uint32_t entries = folderCounter + libraryFileCounter;
+  for(uint32_t i = 0; i < entries; i++) searchIndex[i] = i;
+  qsort(searchIndex, entries, sizeof(uint32_t), searchSortCompare);
+  searchCounter = searchEntryCount();
+
+  halLogf(
+    "Busca: %lu entradas ordenadas em %lu ms (%lu bytes)\n",
+    (unsigned long)searchCounter,
+    (unsigned long)(halMillis() - startTime),
+    (unsigned long)(sizeof(uint32_t) * entries)
+  );
+}
+
+uint32_t searchEntryCount() {
+  uint32_t count = libraryFileCounter;
+  for(uint16_t i = 1; i < folderCounter; i++) {
+    if(folders[i].fileCounter > 0) count++;
+  }
+  return count;
+}
+
+bool searchable(uint32_t entry) {
+  return !searchIsFolder(entry) || (entry != SD_ROOT && folders[entry].fileCounter > 0);
+}
+
+const char* searchName(uint32_t entry) {
+  if(searchIsFolder(entry)) return getFolderName(entry) + 1;
+  return libraryNames + libraryFiles[entry - folderCounter];
+}
+
+bool searchIsFolder(uint32_t entry) {
+  return entry < folderCounter;
+}
+
+// Primeira posicao cujo nome comeca com prefix ou viria depois dele
+uint32_t searchLowerBound(const char *prefix, uint8_t length) {
+  uint32_t low = 0;
+  uint32_t high = searchCounter;
+  while(low < high) {
+    uint32_t mid = low + (high - low) / 2;
+    if(searchCompare(searchName(searchIndex[mid]), prefix, length) < 0) low = mid + 1;
+    else high = mid;
+  }
+  return low;
+}
+
+// Primeira posicao depois de todos os nomes que comecam com prefix
+uint32_t searchUpperBound(const char *prefix, uint8_t length) {
+  uint32_t low = 0;
+  uint32_t high = searchCounter;
+  while(low < high) {
+    uint32_t mid = low + (high - low) / 2;
+    if(searchCompare(searchName(searchIndex[mid]), prefix, length) <= 0) low = mid + 1;
+    else high = mid;
+  }
+  return low;
+}
+
+/**
+ * Proxima (direction = 1) ou anterior (direction = -1) letra que aparece logo
+ * depois de prefix em algum nome, a partir de letter. letter = 0 comeca do
+ * inicio ou do fim. Devolve 0 quando nao ha mais letras nessa direcao.
+ */
+char searchNextLetter(const char *prefix, uint8_t length, char letter, int8_t direction) {
+  if(length >= SEARCH_PREFIX_SIZE - 1) return 0;
+
+  char key[SEARCH_PREFIX_SIZE];
+  memcpy(key, prefix, length);
+  uint32_t position;
+  if(direction > 0) {
+    uint8_t next = letter ? searchFold(letter) + 1 : 1;
+    if(next == 0) return 0;
+    if(next >= 'A' && next <= 'Z') next = 'Z' + 1; // Maiusculas nao existem depois do fold
+    key[length] = next;
+    position = searchLowerBound(key, length + 1);
+  }
+  else {
+    if(letter) {
+      key[length] = searchFold(letter);
+      position = searchLowerBound(key, length + 1);
+    }
+    else position = searchUpperBound(prefix, length);
+    if(position == 0) return 0;
+    position--;
+  }
+  if(position >= searchCounter) return 0;
+
+  const char *name = searchName(searchIndex[position]);
+  if(searchCompare(name, prefix, length) != 0 || name[length] == '\0') return 0;
+  char found = name[length];
+  return found >= 'a' && found <= 'z' ? found - 'a' + 'A' : found;
+}
+
+// Compara so os primeiros length caracteres, sem diferenca de maiusculas
+int searchCompare(const char *name, const char *prefix, uint8_t length) {
+  for(uint8_t i = 0; i < length; i++) {
+    uint8_t a = searchFold(name[i]);
+    uint8_t b = searchFold(prefix[i]);
+    if(a != b) return a - b;
+    if(a == 0) return 0;
+  }
+  return 0;
+}
+
+uint8_t searchFold(char c) {
+  return c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : (uint8_t)c;
+}
+
+// Empate no nome fica pela ordem do id: pastas antes das faixas
+int searchSortCompare(const void *a, const void *b) {
+  uint32_t entryA = *(const uint32_t*)a;
+  uint32_t entryB = *(const uint32_t*)b;
+  bool searchableA = searchable(entryA);
+  if(searchableA != searchable(entryB)) return searchableA ? -1 : 1;
+  const char *nameA = searchName(entryA);
+  const char *nameB = searchName(entryB);
+  for(;; nameA++, nameB++) {
+    uint8_t foldA = searchFold(*nameA);
+    uint8_t foldB = searchFold(*nameB);
+    if(foldA != foldB) return foldA - foldB;
+    if(foldA == 0) break;
+  }
+  return entryA < entryB ? -1 : entryA > entryB;
+}
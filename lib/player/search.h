@@ -0,0 +1,32 @@
+/**
+ * Busca por prefixo nos nomes de pastas e faixas
+ *
+ * searchIndex e um vetor de ids de entrada ordenado pelo nome sem diferenca de
+ * maiusculas: ids abaixo de folderCounter sao pastas (sem a '/' do inicio) e o
+ * resto e folderCounter + faixa global. Os nomes continuam so em libraryNames,
+ * entao o indice custa 4 bytes por entrada dentro da libraryArena. Todas as
+ * entradas com um prefixo sao contiguas, e achar o intervalo e uma busca
+ * binaria: O(log n) comparacoes de no maximo length caracteres.
+ *
+ * mountSdStruct() reordena quando alguma pasta foi varrida; senao a ordem vem
+ * pronta do indice gravado no cartao.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include "library.h"
+
+#define SEARCH_PREFIX_SIZE 16
+
+extern uint32_t *searchIndex;
+extern uint32_t searchCounter;
+
+void buildSearchIndex(void);
+uint32_t searchEntryCount(void);
+const char* searchName(uint32_t entry);
+bool searchIsFolder(uint32_t entry);
+uint32_t searchLowerBound(const char *prefix, uint8_t length);
+uint32_t searchUpperBound(const char *prefix, uint8_t length);
+char searchNextLetter(const char *prefix, uint8_t length, char letter, int8_t direction);
+int searchCompare(const char *name, const char *prefix, uint8_t length);
@@ -0,0 +1,99 @@
+#include "shuffle.h"
+
+uint32_t shuffleSeed = 0;
+uint32_t shufflePass = 0;
+
+void reseedShuffle(uint32_t seed) {
+  shuffleSeed = seed;
+  shufflePass = 0;
+}
+
+uint32_t shuffleKey(uint32_t salt, uint32_t pass) {
+  uint32_t key = shuffleSeed ^ (salt * 0x9E3779B1) ^ (pass * 0x85EBCA77);
+  key ^= key >> 16;
+  key *= 0x7FEB352D;
+  key ^= key >> 15;
+  return key;
+}
+
+uint32_t shuffleRound(uint32_t value, uint32_t key) {
+  value ^= key;
+  value *= 0x846CA68B;
+  value ^= value >> 16;
+  value *= 0x9E3779B1;
+  value ^= value >> 13;
+  return value;
+}
+
+uint8_t shuffleHalfBits(uint32_t n) {
+  uint8_t half = 1;
+  while(half < 16 && ((uint32_t)1 << (2 * half)) < n) half++;
+  return half;
+}
+
+uint32_t shuffleEncrypt(uint32_t value, uint8_t half, uint32_t key) {
+  uint32_t mask = ((uint32_t)1 << half) - 1;
+  uint32_t left = value >> half;
+  uint32_t right = value & mask;
+  for(uint8_t round = 0; round < SHUFFLE_ROUNDS; round++) {
+    uint32_t tmp = right;
+    right = left ^ (shuffleRound(right, key + round * 0x9E3779B9) & mask);
+    left = tmp;
+  }
+  return (left << half) | right;
+}
+
+uint32_t shuffleDecrypt(uint32_t value, uint8_t half, uint32_t key) {
+  uint32_t mask = ((uint32_t)1 << half) - 1;
+  uint32_t left = value >> half;
+  uint32_t right = value & mask;
+  for(uint8_t round = SHUFFLE_ROUNDS; round > 0; round--) {
+    uint32_t tmp = left;
+    left = right ^ (shuffleRound(left, key + (round - 1) * 0x9E3779B9) & mask);
+    right = tmp;
+  }
+  return (left << half) | right;
+}
+
+// Faixa na posicao position da ordem aleatoria. O dominio da rede e no maximo 4n,
+// entao o cycle-walking da em media menos de 4 voltas.
+uint32_t shuffleTrack(uint32_t position, uint32_t n, uint32_t key) {
+  uint8_t half = shuffleHalfBits(n);
+  uint32_t value = position;
+  do value = shuffleEncrypt(value, half, key); while(value >= n);
+  return value;
+}
+
+// Inverso de shuffleTrack: em que posicao da ordem aleatoria a faixa aparece
+uint32_t shufflePosition(uint32_t track, uint32_t n, uint32_t key) {
+  uint8_t half = shuffleHalfBits(n);
+  uint32_t value = track;
+  do value = shuffleDecrypt(value, half, key); while(value >= n);
+  return value;
+}
+
+/**
+ * Proxima (direction = 1) ou anterior (direction = -1) faixa na ordem aleatoria
+ * de n faixas. Ao passar do fim troca para a passada seguinte, com outra ordem;
+ * voltando do inicio retorna para a passada anterior.
+ */
+uint32_t nextShuffleTrack(uint32_t track, uint32_t n, uint32_t salt, int8_t direction, uint32_t *pass) {
+  if(n < 2) return 0;
+  uint32_t position = shufflePosition(track, n, shuffleKey(salt, *pass));
+
+  if(direction > 0) {
+    if(position + 1 < n) position++;
+    else {
+      position = 0;
+      (*pass)++;
+    }
+  }
+  else {
+    if(position > 0) position--;
+    else {
+      position = n - 1;
+      if(*pass > 0) (*pass)--;
+    }
+  }
+  return shuffleTrack(position, n, shuffleKey(salt, *pass));
+}
@@ -0,0 +1,26 @@
+/**
+ * Modo aleatorio sem memoria por faixa: a ordem e uma permutacao de Feistel
+ * com cycle-walking sobre [0, n), entao a posicao da faixa atual e obtida
+ * invertendo a permutacao e a proxima/anterior e so avaliar posicao +/- 1.
+ * Cada passada completa usa uma semente nova derivada de shufflePass.
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+#define SHUFFLE_ROUNDS 8
+#define SHUFFLE_SALT_ALL_SONGS 0
+
+extern uint32_t shuffleSeed;
+extern uint32_t shufflePass;
+
+void reseedShuffle(uint32_t seed);
+uint32_t shuffleKey(uint32_t salt, uint32_t pass);
+uint32_t shuffleRound(uint32_t value, uint32_t key);
+uint8_t shuffleHalfBits(uint32_t n);
+uint32_t shuffleEncrypt(uint32_t value, uint8_t half, uint32_t key);
+uint32_t shuffleDecrypt(uint32_t value, uint8_t half, uint32_t key);
+uint32_t shuffleTrack(uint32_t position, uint32_t n, uint32_t key);
+uint32_t shufflePosition(uint32_t track, uint32_t n, uint32_t key);
+uint32_t nextShuffleTrack(uint32_t track, uint32_t n, uint32_t salt, int8_t direction, uint32_t *pass);
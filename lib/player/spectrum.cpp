@@ -0,0 +1,239 @@
+#include "spectrum.h"
+#include "metadata.h"
+#include "hal.h"
+#include <math.h>
+#include <string.h>
+
+#define SPECTRUM_RING_MASK (SPECTRUM_FFT_SIZE - 1)
+#define SPECTRUM_WINDOW_SHIFT 1 // amostra * janela cabe em Q29, e a soma de dois ramos ainda cabe em int32
+
+volatile bool spectrumEnabled = false;
+volatile uint32_t spectrumFrame = 0;
+uint8_t spectrumLevels[SPECTRUM_BARS];
+uint8_t spectrumPeaks[SPECTRUM_BARS];
+struct SpectrumStats spectrumStats;
+
+// Escritos pela tarefa do decoder
+int16_t spectrumRing[SPECTRUM_FFT_SIZE];
+volatile uint32_t spectrumWritten = 0;
+int32_t spectrumSum = 0;
+uint8_t spectrumPhase = 0;
+
+// Tabelas montadas uma vez no spectrumBegin()
+bool spectrumReady = false;
+int16_t spectrumWindow[SPECTRUM_FFT_SIZE]; // Hann, Q15
+int16_t spectrumCos[SPECTRUM_FFT_SIZE / 2]; // Twiddles, Q15
+int16_t spectrumSin[SPECTRUM_FFT_SIZE / 2];
+uint16_t spectrumReverse[SPECTRUM_FFT_SIZE];
+uint8_t spectrumLow[SPECTRUM_BARS]; // Primeiro bin da banda
+uint8_t spectrumHigh[SPECTRUM_BARS]; // Depois do ultimo
+
+// Daqui para baixo so a analise mexe
+int16_t spectrumSamples[SPECTRUM_FFT_SIZE];
+int32_t spectrumRe[SPECTRUM_FFT_SIZE];
+int32_t spectrumIm[SPECTRUM_FFT_SIZE];
+uint32_t spectrumPeakTime[SPECTRUM_BARS];
+uint32_t spectrumLastWritten = 0;
+uint32_t spectrumTime = 0;
+uint32_t spectrumSkip = 0;
+uint32_t spectrumStatsTime = 0;
+
+void spectrumFft(void);
+uint8_t spectrumBarHeight(int32_t centiDb);
+void updateSpectrumLevels(const uint8_t *heights, uint32_t now);
+void reportSpectrumStats(uint32_t now);
+
+// No playerBegin(); as contas em float ficam aqui, fora do caminho de cada quadro
+void spectrumBegin() {
+  if(spectrumReady) return;
+  for(uint16_t i = 0; i < SPECTRUM_FFT_SIZE; i++) {
+    spectrumWindow[i] = lroundf(32767.0f * (0.5f - 0.5f * cosf(2.0f * (float)M_PI * i / SPECTRUM_FFT_SIZE)));
+    uint16_t reverse = 0;
+    for(uint8_t bit = 0; bit < SPECTRUM_FFT_BITS; bit++) reverse |= ((i >> bit) & 1) << (SPECTRUM_FFT_BITS - 1 - bit);
+    spectrumReverse[i] = reverse;
+  }
+  for(uint16_t k = 0; k < SPECTRUM_FFT_SIZE / 2; k++) {
+    float angle = 2.0f * (float)M_PI * k / SPECTRUM_FFT_SIZE;
+    long c = lroundf(32768.0f * cosf(angle));
+    long s = lroundf(32768.0f * sinf(angle));
+    spectrumCos[k] = c > INT16_MAX ? INT16_MAX : c;
+    spectrumSin[k] = s > INT16_MAX ? INT16_MAX : s;
+  }
+  // Bandas de bin 1 (43 Hz) ate SPECTRUM_LAST_BIN em progressao geometrica
+  for(uint8_t bar = 0; bar < SPECTRUM_BARS; bar++) {
+    float low = powf(SPECTRUM_LAST_BIN, (float)bar / SPECTRUM_BARS);
+    float high = powf(SPECTRUM_LAST_BIN, (float)(bar + 1) / SPECTRUM_BARS);
+    spectrumLow[bar] = (uint8_t)low;
+    spectrumHigh[bar] = (uint8_t)high > spectrumLow[bar] ? (uint8_t)high : spectrumLow[bar] + 1;
+  }
+  spectrumReady = true;
+}
+
+// Do loop, pelo comando do controle
+void spectrumToggle() {
+  memset(spectrumLevels, 0, sizeof(spectrumLevels));
+  memset(spectrumPeaks, 0, sizeof(spectrumPeaks));
+  spectrumEnabled = !spectrumEnabled;
+}
+
+// Na tarefa do decoder, para cada quadro estereo
+void spectrumFeed(const int16_t *frame) {
+  if(!spectrumEnabled) return;
+  spectrumSum += frame[0] + frame[1];
+  if(++spectrumPhase < SPECTRUM_DECIMATION) return;
+  uint32_t written = spectrumWritten;
+  spectrumRing[written & SPECTRUM_RING_MASK] = spectrumSum / (2 * SPECTRUM_DECIMATION);
+  spectrumWritten = written + 1;
+  spectrumSum = 0;
+  spectrumPhase = 0;
+}
+
+/**
+ * Um quadro do analisador. O anel pode ser sobrescrito durante a copia; numa
+ * janela de 23 ms isso so troca umas amostras antigas por novas, entao fica
+ * sem trava. Sem amostra nova (pausa) as barras so caem.
+ */
+void spectrumStep() {
+  uint32_t now = halMillis();
+  reportSpectrumStats(now);
+  if(!spectrumEnabled || now - spectrumTime < SPECTRUM_INTERVAL) return;
+  spectrumTime = now;
+  if(spectrumSkip > 0) {
+    spectrumSkip--;
+    spectrumStats.skipped++;
+    return;
+  }
+
+  uint32_t start = halCycles();
+  uint8_t heights[SPECTRUM_BARS];
+  uint32_t written = spectrumWritten;
+  if(written == spectrumLastWritten) memset(heights, 0, sizeof(heights));
+  else {
+    for(uint16_t i = 0; i < SPECTRUM_FFT_SIZE; i++) spectrumSamples[i] = spectrumRing[(written + i) & SPECTRUM_RING_MASK];
+    spectrumAnalyze(spectrumSamples, heights);
+  }
+  spectrumLastWritten = written;
+  updateSpectrumLevels(heights, now);
+  spectrumFrame++;
+
+  uint32_t elapsed = (halCycles() - start) / halCyclesPerMicro();
+  spectrumStats.frames++;
+  spectrumStats.totalUs += elapsed;
+  if(elapsed > spectrumStats.maxUs) spectrumStats.maxUs = elapsed;
+  if(elapsed > SPECTRUM_BUDGET_US) {
+    spectrumStats.overBudget++;
+    spectrumSkip = elapsed / SPECTRUM_BUDGET_US;
+  }
+}
+
+// Janela, FFT e energia por banda; samples tem SPECTRUM_FFT_SIZE amostras, a mais antiga primeiro
+void spectrumAnalyze(const int16_t *samples, uint8_t *heights) {
+  for(uint16_t i = 0; i < SPECTRUM_FFT_SIZE; i++) {
+    uint16_t j = spectrumReverse[i];
+    spectrumRe[j] = (samples[i] * spectrumWindow[i]) >> SPECTRUM_WINDOW_SHIFT;
+    spectrumIm[j] = 0;
+  }
+  spectrumFft();
+
+  // Parseval: a energia de todos os bins somada nao passa de 2^58
+  for(uint8_t bar = 0; bar < SPECTRUM_BARS; bar++) {
+    uint64_t energy = 0;
+    for(uint16_t bin = spectrumLow[bar]; bin < spectrumHigh[bar]; bin++) {
+      energy += (int64_t)spectrumRe[bin] * spectrumRe[bin] + (int64_t)spectrumIm[bin] * spectrumIm[bin];
+    }
+    if(energy == 0) {
+      heights[bar] = 0;
+      continue;
+    }
+    int32_t centiDb = ((int64_t)fixedLog2(energy) - SPECTRUM_REF_LOG2) * 30103 / 6553600;
+    heights[bar] = spectrumBarHeight(centiDb);
+  }
+}
+
+/**
+ * Radix-2 com decimacao no tempo sobre spectrumRe/spectrumIm ja em ordem de bits
+ * invertidos. Cada estagio divide por 2: a saida e X[k] / N, e o modulo de
+ * qualquer valor nunca passa do maior modulo da entrada.
+ */
+void spectrumFft() {
+  uint16_t step = SPECTRUM_FFT_SIZE / 2;
+  for(uint16_t half = 1; half < SPECTRUM_FFT_SIZE; half <<= 1, step >>= 1) {
+    for(uint16_t start = 0; start < SPECTRUM_FFT_SIZE; start += 2 * half) {
+      for(uint16_t k = 0; k < half; k++) {
+        int32_t wr = spectrumCos[k * step];
+        int32_t wi = -spectrumSin[k * step];
+        uint16_t a = start + k;
+        uint16_t b = a + half;
+        int32_t tr = ((int64_t)spectrumRe[b] * wr - (int64_t)spectrumIm[b] * wi) >> 15;
+        int32_t ti = ((int64_t)spectrumRe[b] * wi + (int64_t)spectrumIm[b] * wr) >> 15;
+        spectrumRe[b] = (spectrumRe[a] - tr) >> 1;
+        spectrumIm[b] = (spectrumIm[a] - ti) >> 1;
+        spectrumRe[a] = (spectrumRe[a] + tr) >> 1;
+        spectrumIm[a] = (spectrumIm[a] + ti) >> 1;
+      }
+    }
+  }
+}
+
+// A mesma analise em double, com DFT direta: referencia para o host, lenta demais para a placa
+void spectrumReference(const int16_t *samples, uint8_t *heights) {
+  spectrumBegin();
+  const double scale = 32767.0 / (1 << SPECTRUM_WINDOW_SHIFT);
+  const double reference = pow(2.0, SPECTRUM_REF_LOG2 / 65536.0);
+  for(uint8_t bar = 0; bar < SPECTRUM_BARS; bar++) {
+    double energy = 0;
+    for(uint16_t bin = spectrumLow[bar]; bin < spectrumHigh[bar]; bin++) {
+      double re = 0;
+      double im = 0;
+      for(uint16_t i = 0; i < SPECTRUM_FFT_SIZE; i++) {
+        double x = samples[i] * scale * (0.5 - 0.5 * cos(2.0 * M_PI * i / SPECTRUM_FFT_SIZE));
+        double angle = 2.0 * M_PI * ((uint32_t)bin * i % SPECTRUM_FFT_SIZE) / SPECTRUM_FFT_SIZE;
+        re += x * cos(angle);
+        im -= x * sin(angle);
+      }
+      re /= SPECTRUM_FFT_SIZE;
+      im /= SPECTRUM_FFT_SIZE;
+      energy += re * re + im * im;
+    }
+    heights[bar] = energy < 1 ? 0 : spectrumBarHeight((int32_t)(1000.0 * log10(energy / reference)));
+  }
+}
+
+uint8_t spectrumBarHeight(int32_t centiDb) {
+  int32_t height = SPECTRUM_HEIGHT + centiDb * SPECTRUM_HEIGHT / SPECTRUM_RANGE;
+  return height < 0 ? 0 : height > SPECTRUM_HEIGHT ? SPECTRUM_HEIGHT : height;
+}
+
+// A barra sobe na hora e cai devagar; o pico espera SPECTRUM_PEAK_HOLD e desce ate a barra
+void updateSpectrumLevels(const uint8_t *heights, uint32_t now) {
+  for(uint8_t bar = 0; bar < SPECTRUM_BARS; bar++) {
+    uint8_t level = spectrumLevels[bar];
+    if(heights[bar] >= level) level = heights[bar];
+    else level = level - heights[bar] > SPECTRUM_BAR_FALL ? level - SPECTRUM_BAR_FALL : heights[bar];
+    spectrumLevels[bar] = level;
+
+    if(level >= spectrumPeaks[bar]) {
+      spectrumPeaks[bar] = level;
+      spectrumPeakTime[bar] = now;
+    }
+    else if(now - spectrumPeakTime[bar] >= SPECTRUM_PEAK_HOLD) {
+      spectrumPeaks[bar] = spectrumPeaks[bar] - level > SPECTRUM_PEAK_FALL ? spectrumPeaks[bar] - SPECTRUM_PEAK_FALL : level;
+    }
+  }
+}
+
+void reportSpectrumStats(uint32_t now) {
+  if(now - spectrumStatsTime < SPECTRUM_STATS_INTERVAL) return;
+  spectrumStatsTime = now;
+  if(spectrumStats.frames == 0) return;
+  halLogf(
+    "Espectro: %lu quadros, %lu pulados, media %lu us, max %lu us, orcamento %u us (%lu acima)\n",
+    (unsigned long)spectrumStats.frames,
+    (unsigned long)spectrumStats.skipped,
+    (unsigned long)(spectrumStats.totalUs / spectrumStats.frames),
+    (unsigned long)spectrumStats.maxUs,
+    SPECTRUM_BUDGET_US,
+    (unsigned long)spectrumStats.overBudget
+  );
+  memset(&spectrumStats, 0, sizeof(spectrumStats));
+}
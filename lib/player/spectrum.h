@@ -0,0 +1,68 @@
+/**
+ * Analisador de espectro na tela de reproducao
+ *
+ * spectrumFeed() roda para cada quadro no gancho do PCM (a tarefa do decoder,
+ * na placa): soma L+R de SPECTRUM_DECIMATION quadros e guarda a media num anel
+ * de SPECTRUM_FFT_SIZE amostras. A 44.1 kHz isso da 22.05 kHz e bins de 43 Hz.
+ * A media de dois quadros e o filtro antes de decimar; o que dobra acima de
+ * 11 kHz so mexe nas ultimas barras.
+ *
+ * spectrumStep() roda no PRO core (tarefa propria na placa, o loop no host) a
+ * cada SPECTRUM_INTERVAL: copia as ultimas amostras, aplica a janela de Hann,
+ * faz a FFT radix-2 em ponto fixo (Q30 em int32, twiddles Q15, metade a cada
+ * estagio, entao nao estoura e sobra resolucao para 90 dB) e soma a energia
+ * dos bins em SPECTRUM_BARS bandas log-espacadas de 43 Hz a 11 kHz. Abaixo de
+ * uns 200 Hz a banda e mais estreita que um bin e barras vizinhas repetem o
+ * mesmo bin, em vez de esticar a escala. O nivel em dB sai do fixedLog2() e
+ * vira altura de barra; a barra cai no maximo SPECTRUM_BAR_FALL pixels por
+ * quadro e o pico fica SPECTRUM_PEAK_HOLD parado antes de cair.
+ * Tudo em buffers estaticos: nada de alocacao por quadro.
+ *
+ * O custo de cada quadro e medido em ciclos e comparado com SPECTRUM_BUDGET_US;
+ * quadro acima do orcamento faz os proximos serem pulados na mesma proporcao,
+ * entao a media fica dentro dele. spectrumReference() e a mesma analise em
+ * double com DFT direta, para conferir a versao em ponto fixo no host.
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+#define SPECTRUM_FFT_BITS 9
+#define SPECTRUM_FFT_SIZE (1 << SPECTRUM_FFT_BITS)
+#define SPECTRUM_DECIMATION 2
+#define SPECTRUM_BARS 32
+#define SPECTRUM_LAST_BIN (SPECTRUM_FFT_SIZE / 2 - 1)
+#define SPECTRUM_BAR_WIDTH 4 // 3 pixels e um vao
+#define SPECTRUM_Y 9 // Entre a primeira linha e os tempos, no lugar da pasta e do titulo
+#define SPECTRUM_HEIGHT 28
+#define SPECTRUM_INTERVAL 33 // ms entre quadros
+#define SPECTRUM_DRAW_INTERVAL 50 // ms entre redesenhos no loop
+#define SPECTRUM_BUDGET_US 2000
+#define SPECTRUM_RANGE 6000 // centi-dB entre a barra vazia e a cheia
+#define SPECTRUM_REF_LOG2 (54 << 16) // Energia no bin de um seno em escala cheia, log2 Q16 (0 dB)
+#define SPECTRUM_BAR_FALL 2
+#define SPECTRUM_PEAK_HOLD 500 // ms
+#define SPECTRUM_PEAK_FALL 1
+#define SPECTRUM_STATS_INTERVAL 30000
+
+struct SpectrumStats {
+  uint32_t frames;
+  uint32_t skipped;
+  uint32_t overBudget;
+  uint32_t totalUs;
+  uint32_t maxUs;
+};
+
+extern volatile bool spectrumEnabled;
+extern volatile uint32_t spectrumFrame; // Muda a cada quadro publicado
+extern uint8_t spectrumLevels[SPECTRUM_BARS];
+extern uint8_t spectrumPeaks[SPECTRUM_BARS];
+extern struct SpectrumStats spectrumStats;
+
+void spectrumBegin(void);
+void spectrumToggle(void);
+void spectrumFeed(const int16_t *frame);
+void spectrumStep(void);
+void spectrumAnalyze(const int16_t *samples, uint8_t *heights);
+void spectrumReference(const int16_t *samples, uint8_t *heights);
@@ -0,0 +1,213 @@
+#include "state.h"
+#include "shuffle.h"
+#include "metadata.h"
+#include "equalizer.h"
+#include "hal.h"
+#include <string.h>
+#include <stddef.h>
+
+#define STATE_CRC_POLY 0xEDB88320
+#define STATE_CRC_SIZE offsetof(struct PlaybackState, crc)
+
+struct PlaybackState savedState; // Ultimo registro gravado ou restaurado
+bool stateSaved = false;
+uint32_t stateSequence = 0;
+uint32_t stateSaveTime = 0;
+uint32_t stateChangeTime = 0;
+bool stateChanged = false;
+
+bool readStateSlot(HalFile &log, uint8_t slot, struct PlaybackState *state);
+bool createStateLog(void);
+
+/**
+ * Primeira coisa do boot, antes da biblioteca: acha o registro mais novo,
+ * restaura volume, modo e EQ e ja abre a faixa na posicao gravada.
+ */
+bool resumePlaybackState() {
+  HalFile log;
+  if(!log.open(STATE_PATH)) return false;
+
+  struct PlaybackState state;
+  bool found = false;
+  for(uint8_t slot = 0; slot < STATE_SLOTS; slot++) {
+    if(!readStateSlot(log, slot, &state)) continue;
+    if(!found || (int32_t)(state.sequence - savedState.sequence) > 0) {
+      savedState = state;
+      found = true;
+    }
+  }
+  log.close();
+  if(!found) return false;
+
+  stateSaved = true;
+  stateSequence = savedState.sequence + 1;
+  volume = savedState.volume <= 21 ? savedState.volume : volume;
+  randomMode = savedState.randomMode <= REPEAT_SONG ? savedState.randomMode : RANDOM_NORMAL;
+  halDecoderSetVolume(volume);
+  eqSelect(savedState.eqPreset);
+  if(!halDecoderOpen(savedState.path)) {
+    halLogf("Estado: nao abriu %s\n", savedState.path);
+    return false;
+  }
+  if(savedState.position > 0) halDecoderSeek(savedState.position);
+  pauseResumeStatus = 1;
+
+  halLogf("Estado: retomando %s em %lu s\n", savedState.path, (unsigned long)savedState.position);
+  return true;
+}
+
+// Depois de montar a biblioteca: acha a faixa que ja esta tocando e volta o aleatorio
+bool locateResumedTrack() {
+  int16_t folder = savedState.folder;
+  uint16_t file = savedState.file;
+  if(!findTrackByPath(savedState.path, &folder, &file)) {
+    halLogf("Estado: %s nao esta mais na biblioteca\n", savedState.path);
+    return false;
+  }
+
+  folderIndex = folder;
+  fileIndex = file;
+  shuffleSeed = savedState.shuffleSeed;
+  shufflePass = savedState.shufflePass;
+  savedState.folder = folder;
+  savedState.file = file;
+  metadataRequest(folders[folderIndex].firstFile + fileIndex);
+  requestPrefetch();
+  return true;
+}
+
+/**
+ * Chamado a cada volta do loop. Mudanca de faixa, volume, modo ou EQ grava depois
+ * de STATE_CHANGE_DELAY; so a posicao andando grava a cada STATE_SAVE_INTERVAL.
+ * Pausado nada muda, entao nada e gravado.
+ */
+void watchPlaybackState() {
+  if(libraryFileCounter == 0) return;
+
+  uint32_t now = halMillis();
+  bool changed = !stateSaved ||
+    folderIndex != savedState.folder ||
+    fileIndex != savedState.file ||
+    volume != savedState.volume ||
+    randomMode != savedState.randomMode ||
+    eqPreset != savedState.eqPreset ||
+    shuffleSeed != savedState.shuffleSeed ||
+    shufflePass != savedState.shufflePass;
+
+  if(changed) {
+    if(!stateChanged) {
+      stateChanged = true;
+      stateChangeTime = now;
+    }
+    if(now - stateChangeTime < STATE_CHANGE_DELAY) return;
+  }
+  else if(now - stateSaveTime < STATE_SAVE_INTERVAL || halDecoderCurrentTime() == savedState.position) return;
+
+  stateChanged = false;
+  savePlaybackState();
+}
+
+bool savePlaybackState() {
+  struct PlaybackState state;
+  memset(&state, 0, sizeof(state)); // Padding zerado para o CRC
+  state.magic = STATE_MAGIC;
+  state.sequence = stateSequence;
+  state.position = halDecoderCurrentTime();
+  state.shuffleSeed = shuffleSeed;
+  state.shufflePass = shufflePass;
+  state.folder = folderIndex;
+  state.file = fileIndex;
+  state.volume = volume;
+  state.randomMode = randomMode;
+  state.eqPreset = eqPreset;
+  if(!buildTrackPath(state.path, sizeof(state.path), folderIndex, fileIndex)) return false;
+  state.crc = crc32((const uint8_t*)&state, STATE_CRC_SIZE);
+
+  stateSaveTime = halMillis();
+  if(!halFsExists(STATE_PATH) && !createStateLog()) return false;
+
+  HalFile log;
+  if(!log.open(STATE_PATH, HAL_FILE_UPDATE)) return false;
+  bool written = log.seek((state.sequence % STATE_SLOTS) * sizeof(state)) &&
+    log.write(&state, sizeof(state)) == sizeof(state);
+  log.close();
+  if(!written) {
+    halLogf("ERR: Nao foi possivel gravar o estado\n");
+    return false;
+  }
+
+  savedState = state;
+  stateSaved = true;
+  stateSequence++;
+  return true;
+}
+
+bool readStateSlot(HalFile &log, uint8_t slot, struct PlaybackState *state) {
+  if(!log.seek(slot * sizeof(struct PlaybackState))) return false;
+  if(log.read(state, sizeof(struct PlaybackState)) != sizeof(struct PlaybackState)) return false;
+  return state->magic == STATE_MAGIC &&
+    state->crc == crc32((const uint8_t*)state, STATE_CRC_SIZE) &&
+    memchr(state->path, '\0', sizeof(state->path)) != NULL;
+}
+
+// Todos os slots de uma vez: depois disso gravar nunca muda o tamanho do arquivo
+bool createStateLog() {
+  if(!halFsExists(LIBRARY_INDEX_DIR)) halFsMkdir(LIBRARY_INDEX_DIR);
+  HalFile log;
+  if(!log.open(STATE_PATH, HAL_FILE_WRITE)) return false;
+
+  struct PlaybackState empty;
+  memset(&empty, 0, sizeof(empty));
+  bool written = true;
+  for(uint8_t slot = 0; written && slot < STATE_SLOTS; slot++) {
+    written = log.write(&empty, sizeof(empty)) == sizeof(empty);
+  }
+  log.close();
+  if(!written) halFsRemove(STATE_PATH);
+  return written;
+}
+
+/**
+ * Procura a faixa pelo caminho. folder/file chegam com o palpite e so se ele
+ * nao bater as pastas e depois as faixas da pasta sao percorridas.
+ */
+bool findTrackByPath(const char *path, int16_t *folder, uint16_t *file) {
+  char built[PREFETCH_PATH_SIZE];
+  if(
+    *folder >= 0 && *folder < folderCounter && *file < folders[*folder].fileCounter &&
+    buildTrackPath(built, sizeof(built), *folder, *file) && strcmp(built, path) == 0
+  ) return true;
+
+  const char *slash = strrchr(path, '/');
+  if(slash == NULL) return false;
+  const char *name = slash + 1;
+  uint32_t folderLength = slash - path;
+
+  for(uint16_t f = 0; f < folderCounter; f++) {
+    const char *folderName = getFolderName(f);
+    bool match = f == SD_ROOT ? folderLength == 0 :
+      strlen(folderName) == folderLength && strncmp(folderName, path, folderLength) == 0;
+    if(!match) continue;
+
+    for(uint16_t i = 0; i < folders[f].fileCounter; i++) {
+      if(strcmp(getFileName(f, i), name) == 0) {
+        *folder = f;
+        *file = i;
+        return true;
+      }
+    }
+    return false;
+  }
+  return false;
+}
+
+uint32_t crc32(const uint8_t *data, uint32_t length) {
+  uint32_t crc = 0xFFFFFFFF;
+  for(uint32_t i = 0; i < length; i++) {
+    crc ^= data[i];
+    for(uint8_t bit = 0; bit < 8; bit++) {
+      crc = crc & 1 ? (crc >> 1) ^ STATE_CRC_POLY : crc >> 1;
+    }
+  }
+  return ~crc;
+}
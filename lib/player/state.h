@@ -0,0 +1,48 @@
+/**
+ * Estado de reproducao gravado no cartao para voltar de onde parou depois de
+ * uma queda de energia
+ *
+ * STATE_PATH tem STATE_SLOTS registros de tamanho fixo, criados de uma vez na
+ * primeira gravacao. Cada gravacao vai para o slot sequence % STATE_SLOTS, entao
+ * o arquivo e um log circular: nenhum setor e regravado mais que os outros e um
+ * registro cortado no meio pela queda so invalida o proprio slot (CRC-32). No
+ * boot vale o registro valido de maior sequence.
+ *
+ * O registro guarda o caminho da faixa, entao o boot abre o decoder e pula
+ * para a posicao antes de montar a biblioteca; folder/file sao so um palpite
+ * conferido contra o caminho depois da montagem.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include "player.h"
+
+#define STATE_PATH "/.player/state.log"
+#define STATE_MAGIC 0x54415453 // "STAT"
+#define STATE_SLOTS 32
+#define STATE_SAVE_INTERVAL 10000 // ms entre gravacoes so da posicao
+#define STATE_CHANGE_DELAY 1000 // ms depois de uma mudanca antes de gravar (volume repetindo)
+
+struct PlaybackState {
+  uint32_t magic;
+  uint32_t sequence;
+  uint32_t position; // Segundos dentro da faixa
+  uint32_t shuffleSeed;
+  uint32_t shufflePass;
+  int16_t folder;
+  uint16_t file;
+  uint8_t volume;
+  uint8_t randomMode;
+  uint8_t eqPreset; // Registros antigos tem 0 aqui: Plano
+  uint8_t reserved;
+  char path[PREFETCH_PATH_SIZE];
+  uint32_t crc; // CRC-32 de todos os campos acima
+};
+
+bool resumePlaybackState(void);
+bool locateResumedTrack(void);
+void watchPlaybackState(void);
+bool savePlaybackState(void);
+bool findTrackByPath(const char *path, int16_t *folder, uint16_t *file);
+uint32_t crc32(const uint8_t *data, uint32_t length);
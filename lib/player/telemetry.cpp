@@ -0,0 +1,166 @@
+#include "telemetry.h"
+#include "radio.h"
+#include "player.h"
+#include "screen.h"
+#include "hc12.h"
+#include "hal.h"
+#include <string.h>
+
+#define TELEMETRY_ACK_VALID 0x100
+
+struct TelemetryStats telemetryStats;
+struct TelemetryState telemetryAcked; // O que o controle ja tem
+struct TelemetryState telemetrySent;
+bool telemetryHasAcked = false;
+bool telemetryWaiting = false;
+bool telemetryUnacked = false; // Controle que nao confirma: cada quadro vale como entregue
+bool telemetryResend = false; // O proximo quadro refaz um que nao foi confirmado
+uint8_t telemetrySeq = 0;
+uint8_t telemetryRetries = 0;
+uint32_t telemetrySendTime = 0;
+uint32_t telemetryKeyTime = 0;
+uint32_t telemetryStatsTime = 0;
+
+// Escrito pela tarefa do radio, consumido pelo loop
+volatile uint16_t telemetryAck = 0;
+
+void readTelemetryState(struct TelemetryState *state);
+void reportTelemetryStats(uint32_t now);
+
+// Chamado a cada volta do loop
+void telemetryStep() {
+  uint32_t now = halMillis();
+  reportTelemetryStats(now);
+  if(libraryFileCounter == 0 || hc12Busy()) return; // Modulo em modo AT ou testando o enlace
+
+  // Sem confirmacao os quadros continuam indo; uma que chegue volta a esperar por elas
+  if((telemetryWaiting || telemetryUnacked) && telemetryTakeAck(telemetrySeq)) {
+    telemetryAcked = telemetrySent;
+    telemetryHasAcked = true;
+    telemetryWaiting = false;
+    telemetryUnacked = false;
+    telemetryResend = false;
+    telemetryRetries = 0;
+    telemetryStats.acks++;
+  }
+
+  if(telemetryWaiting) {
+    if(now - telemetrySendTime < TELEMETRY_ACK_TIMEOUT) return;
+    telemetryWaiting = false;
+    if(telemetryRetries < TELEMETRY_MAX_RETRIES) {
+      telemetryRetries++;
+      telemetryResend = true;
+    }
+    else {
+      telemetryUnacked = true;
+      telemetryAcked = telemetrySent;
+      telemetryHasAcked = true;
+    }
+  }
+
+  struct TelemetryState state;
+  readTelemetryState(&state);
+  bool keyframe = !telemetryHasAcked || now - telemetryKeyTime >= TELEMETRY_KEYFRAME_INTERVAL;
+  uint8_t mask = keyframe ? TELEMETRY_ALL | TELEMETRY_KEYFRAME : telemetryDiff(&state, &telemetryAcked);
+  if(mask == 0) return;
+  if(now - telemetrySendTime < TELEMETRY_MIN_INTERVAL || !radioLineIdle(now, TELEMETRY_IDLE_GAP)) return;
+
+  uint8_t frame[TELEMETRY_FRAME_MAX];
+  uint8_t length = telemetryEncode(frame, ++telemetrySeq, mask, &state);
+  halRadioWrite(frame, length);
+
+  telemetrySent = state;
+  telemetrySendTime = now;
+  if(keyframe) {
+    telemetryKeyTime = now;
+    telemetryStats.keyframes++;
+  }
+  if(telemetryResend) telemetryStats.retransmits++;
+  telemetryResend = false;
+  telemetryStats.frames++;
+  telemetryStats.bytes += length;
+
+  if(telemetryUnacked) telemetryAcked = state;
+  else telemetryWaiting = true;
+}
+
+// Na tarefa do radio, quando chega a confirmacao de um quadro
+void telemetryAcknowledge(uint8_t seq) {
+  __atomic_store_n(&telemetryAck, TELEMETRY_ACK_VALID | seq, __ATOMIC_RELEASE);
+}
+
+// Consome a confirmacao pendente; true se ela for do quadro seq
+bool telemetryTakeAck(uint8_t seq) {
+  uint16_t ack = __atomic_exchange_n(&telemetryAck, 0, __ATOMIC_ACQUIRE);
+  return (ack & TELEMETRY_ACK_VALID) && (uint8_t)ack == seq;
+}
+
+// Quadro completo do estado atual, fora da sequencia da telemetria (teste do enlace)
+uint8_t telemetryKeyframe(uint8_t *frame, uint8_t seq) {
+  struct TelemetryState state;
+  readTelemetryState(&state);
+  return telemetryEncode(frame, seq, TELEMETRY_ALL | TELEMETRY_KEYFRAME, &state);
+}
+
+uint8_t telemetryEncode(uint8_t *frame, uint8_t seq, uint8_t mask, const struct TelemetryState *state) {
+  uint8_t length = 0;
+  frame[length++] = TELEMETRY_FRAME_START;
+  frame[length++] = seq;
+  frame[length++] = mask;
+  if(mask & TELEMETRY_TRACK) {
+    frame[length++] = (uint16_t)state->folder;
+    frame[length++] = (uint16_t)state->folder >> 8;
+    frame[length++] = state->file;
+    frame[length++] = state->file >> 8;
+  }
+  if(mask & TELEMETRY_POSITION) {
+    frame[length++] = state->position;
+    frame[length++] = state->position >> 8;
+  }
+  if(mask & TELEMETRY_DURATION) {
+    frame[length++] = state->duration;
+    frame[length++] = state->duration >> 8;
+  }
+  if(mask & TELEMETRY_VOLUME) frame[length++] = state->volume;
+  if(mask & TELEMETRY_MODE) frame[length++] = state->randomMode;
+  if(mask & TELEMETRY_PLAYING) frame[length++] = state->playing;
+  frame[length] = crc8(frame + 1, length - 1);
+  return length + 1;
+}
+
+uint8_t telemetryDiff(const struct TelemetryState *a, const struct TelemetryState *b) {
+  uint8_t mask = 0;
+  if(a->folder != b->folder || a->file != b->file) mask |= TELEMETRY_TRACK;
+  if(a->position != b->position) mask |= TELEMETRY_POSITION;
+  if(a->duration != b->duration) mask |= TELEMETRY_DURATION;
+  if(a->volume != b->volume) mask |= TELEMETRY_VOLUME;
+  if(a->randomMode != b->randomMode) mask |= TELEMETRY_MODE;
+  if(a->playing != b->playing) mask |= TELEMETRY_PLAYING;
+  return mask;
+}
+
+void readTelemetryState(struct TelemetryState *state) {
+  uint32_t duration = halDecoderDuration();
+  state->folder = folderIndex;
+  state->file = fileIndex;
+  state->position = halDecoderCurrentTime();
+  state->duration = duration ? duration : screen.tagsDuration;
+  state->volume = volume;
+  state->randomMode = randomMode;
+  state->playing = pauseResumeStatus;
+}
+
+void reportTelemetryStats(uint32_t now) {
+  if(now - telemetryStatsTime < TELEMETRY_STATS_INTERVAL) return;
+  telemetryStatsTime = now;
+  if(telemetryStats.frames == 0) return;
+  halLogf(
+    "Telemetria: %lu quadros (%lu completos), %lu bytes, %lu reenvios, %lu confirmados, %lu bytes recebidos\n",
+    (unsigned long)telemetryStats.frames,
+    (unsigned long)telemetryStats.keyframes,
+    (unsigned long)telemetryStats.bytes,
+    (unsigned long)telemetryStats.retransmits,
+    (unsigned long)telemetryStats.acks,
+    (unsigned long)radioParser.bytes
+  );
+}
@@ -0,0 +1,67 @@
+/**
+ * Estado da reproducao enviado de volta ao controle pelo HC-12
+ *
+ * Quadro: TELEMETRY_FRAME_START, seq, mascara, campos na ordem dos bits da
+ * mascara (little endian) e crc8 de seq ate o ultimo campo. So vao os campos
+ * que mudaram desde o ultimo quadro confirmado; a cada TELEMETRY_KEYFRAME_INTERVAL
+ * vai um quadro com tudo e TELEMETRY_KEYFRAME na mascara.
+ *
+ * O controle confirma com um quadro binario de comando (radio.h) com o seq do
+ * quadro e RADIO_TELEMETRY_ACK no lugar do evento. Um quadro por vez fica
+ * esperando a confirmacao; sem ela em TELEMETRY_ACK_TIMEOUT o delta e refeito
+ * contra o ultimo confirmado e reenviado. Depois de TELEMETRY_MAX_RETRIES o
+ * controle e tratado como um que nao confirma (os antigos) e cada quadro passa
+ * a valer como entregue, ate chegar uma confirmacao.
+ *
+ * O HC-12 e half-duplex a 9600 baud: um quadro so sai com a linha parada ha
+ * TELEMETRY_IDLE_GAP, sem comando pela metade no parser, e no maximo um a cada
+ * TELEMETRY_MIN_INTERVAL, entao os comandos do controle nunca esperam.
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+#define TELEMETRY_FRAME_START 0x5A
+#define TELEMETRY_FRAME_MAX 16
+#define TELEMETRY_MIN_INTERVAL 200 // ms entre quadros
+#define TELEMETRY_IDLE_GAP 100 // ms sem bytes chegando antes de transmitir
+#define TELEMETRY_ACK_TIMEOUT 500
+#define TELEMETRY_MAX_RETRIES 3
+#define TELEMETRY_KEYFRAME_INTERVAL 10000
+#define TELEMETRY_STATS_INTERVAL 30000
+
+#define TELEMETRY_TRACK 0x01 // int16 pasta, uint16 faixa
+#define TELEMETRY_POSITION 0x02 // uint16 segundos
+#define TELEMETRY_DURATION 0x04 // uint16 segundos
+#define TELEMETRY_VOLUME 0x08 // uint8
+#define TELEMETRY_MODE 0x10 // uint8 randomMode
+#define TELEMETRY_PLAYING 0x20 // uint8
+#define TELEMETRY_ALL 0x3F
+#define TELEMETRY_KEYFRAME 0x80
+
+struct TelemetryState {
+  int16_t folder;
+  uint16_t file;
+  uint16_t position;
+  uint16_t duration;
+  uint8_t volume;
+  uint8_t randomMode;
+  uint8_t playing;
+};
+
+struct TelemetryStats {
+  uint32_t bytes;
+  uint32_t frames;
+  uint32_t keyframes;
+  uint32_t retransmits;
+  uint32_t acks;
+};
+extern struct TelemetryStats telemetryStats;
+
+void telemetryStep(void);
+void telemetryAcknowledge(uint8_t seq);
+bool telemetryTakeAck(uint8_t seq);
+uint8_t telemetryKeyframe(uint8_t *frame, uint8_t seq);
+uint8_t telemetryEncode(uint8_t *frame, uint8_t seq, uint8_t mask, const struct TelemetryState *state);
+uint8_t telemetryDiff(const struct TelemetryState *a, const struct TelemetryState *b);
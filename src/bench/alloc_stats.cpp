@@ -0,0 +1,109 @@
+/**
+ * Contagem de alocacoes para o benchmark, sem mexer no codigo medido:
+ *  placa: -Wl,--wrap=malloc,free,realloc,calloc (ver env:bench_esp32)
+ *  host:  malloc/free/realloc/calloc interpostos sobre os __libc_* da glibc
+*/
+
+#include "bench.h"
+#include <stddef.h>
+
+#ifdef ARDUINO
+#include <esp_heap_caps.h>
+#define allocatedSize(p) heap_caps_get_allocated_size(p)
+#else
+#include <malloc.h>
+#define allocatedSize(p) malloc_usable_size(p)
+#endif
+
+uint32_t allocCount = 0;
+uint32_t allocBytes = 0;
+uint32_t allocPeak = 0;
+
+void benchAllocReset() {
+  allocCount = 0;
+  allocBytes = 0;
+  allocPeak = 0;
+}
+
+uint32_t benchAllocCount() { return allocCount; }
+uint32_t benchAllocPeak() { return allocPeak; }
+
+// allocBytes e relativo ao reset, entao pode ficar negativo ao liberar algo de antes
+static void allocated(void *p) {
+  if(p == NULL) return;
+  allocCount++;
+  allocBytes += allocatedSize(p);
+  if((int32_t)allocBytes > (int32_t)allocPeak) allocPeak = allocBytes;
+}
+
+static void released(void *p) {
+  if(p != NULL) allocBytes -= allocatedSize(p);
+}
+
+#ifdef ARDUINO
+extern "C" {
+void* __real_malloc(size_t size);
+void __real_free(void *p);
+void* __real_realloc(void *p, size_t size);
+void* __real_calloc(size_t count, size_t size);
+
+void* __wrap_malloc(size_t size) {
+  void *p = __real_malloc(size);
+  allocated(p);
+  return p;
+}
+
+void __wrap_free(void *p) {
+  released(p);
+  __real_free(p);
+}
+
+void* __wrap_realloc(void *p, size_t size) {
+  uint32_t before = p != NULL ? allocatedSize(p) : 0;
+  void *q = __real_realloc(p, size);
+  if(q == NULL) return NULL;
+  allocBytes -= before;
+  allocated(q);
+  return q;
+}
+
+void* __wrap_calloc(size_t count, size_t size) {
+  void *p = __real_calloc(count, size);
+  allocated(p);
+  return p;
+}
+}
+#else
+extern "C" {
+void* __libc_malloc(size_t size);
+void __libc_free(void *p);
+void* __libc_realloc(void *p, size_t size);
+void* __libc_calloc(size_t count, size_t size);
+
+void* malloc(size_t size) {
+  void *p = __libc_malloc(size);
+  allocated(p);
+  return p;
+}
+
+void free(void *p) {
+  released(p);
+  __libc_free(p);
+}
+
+void* realloc(void *p, size_t size) {
+  uint32_t before = p != NULL ? allocatedSize(p) : 0;
+  void *q = __libc_realloc(p, size);
+  if(q == NULL) return NULL;
+  allocBytes -= before;
+  allocated(q);
+  return q;
+}
+
+void* calloc(size_t count, size_t size) {
+  void *p = __libc_calloc(count, size);
+  allocated(p);
+  return p;
+}
+}
+#endif
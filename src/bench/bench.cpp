@@ -0,0 +1,266 @@
+/**
+ * Benchmark da biblioteca sobre bibliotecas sinteticas geradas pelo HAL
+ *
+ * Cada caso vira uma pasta baseDir/t<faixas>_f<pastas>_e<vazias>_n<nome> com
+ * arquivos vazios; a geracao e feita uma vez e marcada com BENCH_READY_PATH.
+ * Para cada caso: varredura a frio (sem indice), carga pelo indice, custo do
+ * primeiro passo do aleatorio, BENCH_NAV_STEPS passos de navegacao em cada
+ * modo, com a direcao sorteada, e BENCH_NAV_STEPS buscas por prefixo. Uma linha CSV por caso; o resto comeca com "#"
+ * ou "Biblioteca:" e pode ser filtrado com grep.
+*/
+
+#include "bench.h"
+#include "hal.h"
+#include "library.h"
+#include "player.h"
+#include "shuffle.h"
+#include "search.h"
+#include <stdio.h>
+#include <string.h>
+
+#define BENCH_READY_PATH "/.ready-probe" // Bibliotecas de antes da leitura do cabecalho tinham arquivos vazios
+#define BENCH_NAV_STEPS 10000
+#define BENCH_SHUFFLE_ROUNDS 1000
+#define BENCH_SEED 0x2545F491
+#define BENCH_PATH_SIZE 320
+#define BENCH_CASE_NAME_SIZE 32
+#define BENCH_SEARCH_PREFIX 6 // "t01234": o mesmo prefixo de ate 10 faixas
+
+struct BenchCase {
+  uint32_t tracks;
+  uint16_t folders;
+  uint16_t emptyFolders; // As ultimas pastas ficam vazias
+  uint8_t nameLength;    // Tamanho do nome do arquivo sem a extensao
+};
+
+// Ate 65535 faixas (fileIndex e Folder::fileCounter sao de 16 bits)
+const struct BenchCase benchCases[] = {
+  {   100,   1,   0,  12 },
+  {  1000,  10,   0,  24 },
+  {  1000, 100,  20,  24 },
+  { 10000, 100,   0,  24 },
+  { 10000, 500, 100,  24 },
+  { 10000, 100,   0, 200 },
+  { 65535, 500,  50,  24 },
+};
+#define BENCH_CASE_COUNT (sizeof(benchCases) / sizeof(benchCases[0]))
+
+struct NavResult {
+  uint32_t avgNs;
+  uint32_t maxUs;
+  uint32_t allocs;
+};
+
+const uint8_t benchTrackHeader[16] = { 0xFF, 0xFB, 0x90, 0x00 }; // MPEG-1 layer III, 128 kbps, 44.1 kHz
+uint32_t benchRandomState = BENCH_SEED;
+
+void benchCaseName(char *name, const struct BenchCase *c);
+bool generateLibrary(const char *caseName, const struct BenchCase *c);
+uint16_t firstFilledFolder(void);
+uint32_t benchShuffle(void);
+struct NavResult benchNavigation(uint8_t mode);
+uint32_t benchSearch(void);
+uint32_t benchRandom(void);
+
+void runBenchmarks(const char *platform, const char *baseDir, uint32_t maxTracks) {
+  char caseName[BENCH_CASE_NAME_SIZE];
+  char caseRoot[BENCH_PATH_SIZE];
+
+  halLogf(
+    "platform,tracks,folders,empty_folders,name_length,status,"
+    "scan_us,index_us,arena_bytes,scan_allocs,scan_peak_bytes,"
+    "shuffle_ns,nav_normal_ns,nav_folder_ns,nav_all_ns,nav_max_us,nav_allocs,search_bytes,search_ns\n"
+  );
+
+  for(uint8_t i = 0; i < BENCH_CASE_COUNT; i++) {
+    const struct BenchCase *c = &benchCases[i];
+    benchCaseName(caseName, c);
+    if(c->tracks > maxTracks) {
+      halLogf("# %s: pulado (limite de %lu faixas)\n", caseName, (unsigned long)maxTracks);
+      continue;
+    }
+
+    halFsSetRoot(baseDir);
+    if(!generateLibrary(caseName, c)) {
+      halLogf("# %s: nao foi possivel gerar a biblioteca\n", caseName);
+      continue;
+    }
+    snprintf(caseRoot, sizeof(caseRoot), "%s/%s", baseDir, caseName);
+    halFsSetRoot(caseRoot);
+
+    // Varredura a frio: sem biblioteca na memoria e sem indice no cartao
+    clearLibrary();
+    halFsRemove(LIBRARY_INDEX_PATH);
+    benchAllocReset();
+    uint32_t start = halMicros();
+    mountSdStruct();
+    uint32_t scanUs = halMicros() - start;
+    uint32_t scanAllocs = benchAllocCount();
+    uint32_t scanPeak = benchAllocPeak();
+
+    const char *status = "ok";
+    if(libraryArena == NULL) status = "oom";
+    else if(libraryFileCounter != c->tracks || folderCounter != c->folders + 1) status = "mismatch";
+
+    uint32_t indexUs = 0;
+    if(libraryArena != NULL) {
+      clearLibrary();
+      start = halMicros();
+      mountSdStruct();
+      indexUs = halMicros() - start;
+    }
+
+    if(strcmp(status, "ok") != 0) {
+      halLogf(
+        "%s,%lu,%u,%u,%u,%s,%lu,%lu,%lu,%lu,%lu,,,,,,,,\n",
+        platform, (unsigned long)c->tracks, c->folders, c->emptyFolders, c->nameLength, status,
+        (unsigned long)scanUs, (unsigned long)indexUs, (unsigned long)libraryArenaSize,
+        (unsigned long)scanAllocs, (unsigned long)scanPeak
+      );
+      continue;
+    }
+
+    uint32_t shuffleNs = benchShuffle();
+    struct NavResult normal = benchNavigation(RANDOM_NORMAL);
+    struct NavResult inFolder = benchNavigation(RANDOM_IN_FOLDER);
+    struct NavResult allSongs = benchNavigation(RANDOM_ALL_SONGS);
+    uint32_t navMax = normal.maxUs;
+    if(inFolder.maxUs > navMax) navMax = inFolder.maxUs;
+    if(allSongs.maxUs > navMax) navMax = allSongs.maxUs;
+    uint32_t searchNs = benchSearch();
+
+    halLogf(
+      "%s,%lu,%u,%u,%u,%s,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu\n",
+      platform, (unsigned long)c->tracks, c->folders, c->emptyFolders, c->nameLength, status,
+      (unsigned long)scanUs, (unsigned long)indexUs, (unsigned long)libraryArenaSize,
+      (unsigned long)scanAllocs, (unsigned long)scanPeak, (unsigned long)shuffleNs,
+      (unsigned long)normal.avgNs, (unsigned long)inFolder.avgNs, (unsigned long)allSongs.avgNs,
+      (unsigned long)navMax, (unsigned long)(normal.allocs + inFolder.allocs + allSongs.allocs),
+      (unsigned long)(sizeof(uint32_t) * searchCounter), (unsigned long)searchNs
+    );
+  }
+
+  clearLibrary();
+  halFsSetRoot("/");
+}
+
+void benchCaseName(char *name, const struct BenchCase *c) {
+  snprintf(
+    name, BENCH_CASE_NAME_SIZE, "t%lu_f%u_e%u_n%u",
+    (unsigned long)c->tracks, c->folders, c->emptyFolders, c->nameLength
+  );
+}
+
+/**
+ * Cria as pastas f000..fNNN e distribui as faixas entre as pastas nao vazias.
+ * Cada arquivo e so um cabecalho de quadro MP3, o que a varredura le para
+ * confirmar o tipo.
+ */
+bool generateLibrary(const char *caseName, const struct BenchCase *c) {
+  char path[BENCH_PATH_SIZE];
+  snprintf(path, sizeof(path), "/%s%s", caseName, BENCH_READY_PATH);
+  if(halFsExists(path)) return true;
+
+  halLogf("# %s: gerando biblioteca\n", caseName);
+  snprintf(path, sizeof(path), "/%s", caseName);
+  halFsMkdir(path);
+
+  uint16_t filled = c->folders - c->emptyFolders;
+  uint32_t track = 0;
+  HalFile file;
+  for(uint16_t f = 0; f < c->folders; f++) {
+    snprintf(path, sizeof(path), "/%s/f%03u", caseName, f);
+    if(!halFsExists(path) && !halFsMkdir(path)) return false;
+    if(f >= filled) continue;
+
+    uint32_t count = c->tracks / filled + (f < c->tracks % filled ? 1 : 0);
+    for(uint32_t i = 0; i < count; i++, track++) {
+      int length = snprintf(path, sizeof(path), "/%s/f%03u/t%05lu_", caseName, f, (unsigned long)track);
+      int nameStart = length - 7; // "t00000_"
+      while(length - nameStart < c->nameLength && length < BENCH_PATH_SIZE - 5) path[length++] = 'x';
+      strcpy(path + length, ".mp3");
+      if(!file.open(path, HAL_FILE_WRITE)) return false;
+      file.write(benchTrackHeader, sizeof(benchTrackHeader));
+      file.close();
+    }
+  }
+
+  snprintf(path, sizeof(path), "/%s%s", caseName, BENCH_READY_PATH);
+  if(!file.open(path, HAL_FILE_WRITE)) return false;
+  file.close();
+  return true;
+}
+
+uint16_t firstFilledFolder() {
+  for(uint16_t f = 0; f < folderCounter; f++) {
+    if(folders[f].fileCounter > 0) return f;
+  }
+  return 0;
+}
+
+/**
+ * O aleatorio nao tem mais passo de montagem (a permutacao e calculada na hora),
+ * entao o custo medido e nova semente + primeiro passo sobre todas as faixas.
+ */
+uint32_t benchShuffle() {
+  uint32_t track = 0;
+  uint32_t pass = 0;
+  uint32_t start = halMicros();
+  for(uint32_t i = 0; i < BENCH_SHUFFLE_ROUNDS; i++) {
+    reseedShuffle(BENCH_SEED + i);
+    track = nextShuffleTrack(track, libraryFileCounter, SHUFFLE_SALT_ALL_SONGS, 1, &pass);
+  }
+  uint32_t elapsed = halMicros() - start;
+  return (uint32_t)((uint64_t)elapsed * 1000 / BENCH_SHUFFLE_ROUNDS);
+}
+
+struct NavResult benchNavigation(uint8_t mode) {
+  struct NavResult result = { 0, 0, 0 };
+  int16_t folder = firstFilledFolder();
+  uint16_t file = 0;
+  uint32_t pass = 0;
+  uint64_t total = 0;
+
+  randomMode = mode;
+  reseedShuffle(BENCH_SEED);
+  benchRandomState = BENCH_SEED;
+  benchAllocReset();
+  for(uint32_t i = 0; i < BENCH_NAV_STEPS; i++) {
+    int8_t direction = (benchRandom() & 1) ? 1 : -1;
+    uint32_t start = halMicros();
+    resolveSong(direction, &folder, &file, &pass);
+    uint32_t elapsed = halMicros() - start;
+    total += elapsed;
+    if(elapsed > result.maxUs) result.maxUs = elapsed;
+  }
+  result.allocs = benchAllocCount();
+  result.avgNs = (uint32_t)(total * 1000 / BENCH_NAV_STEPS);
+  randomMode = RANDOM_NORMAL;
+  return result;
+}
+
+// Intervalo de resultados (as duas buscas binarias) para o prefixo de uma faixa sorteada
+uint32_t benchSearch() {
+  char prefix[BENCH_SEARCH_PREFIX];
+  uint32_t found = 0;
+  uint64_t total = 0;
+
+  benchRandomState = BENCH_SEED;
+  for(uint32_t i = 0; i < BENCH_NAV_STEPS; i++) {
+    uint32_t track = benchRandom() % libraryFileCounter;
+    memcpy(prefix, libraryNames + libraryFiles[track], BENCH_SEARCH_PREFIX);
+    uint32_t start = halMicros();
+    found += searchUpperBound(prefix, BENCH_SEARCH_PREFIX) - searchLowerBound(prefix, BENCH_SEARCH_PREFIX);
+    total += halMicros() - start;
+  }
+  if(found < BENCH_NAV_STEPS) halLogf("# busca: %lu resultados para %u prefixos\n", (unsigned long)found, BENCH_NAV_STEPS);
+  return (uint32_t)(total * 1000 / BENCH_NAV_STEPS);
+}
+
+// xorshift32: sequencia de direcoes igual em todas as execucoes
+uint32_t benchRandom() {
+  benchRandomState ^= benchRandomState << 13;
+  benchRandomState ^= benchRandomState >> 17;
+  benchRandomState ^= benchRandomState << 5;
+  return benchRandomState;
+}
@@ -0,0 +1,17 @@
+/**
+ * Benchmark da biblioteca: varredura, aleatorio e navegacao sobre bibliotecas
+ * sinteticas, com saida em CSV. Roda no host (bench_native) e na placa (bench_esp32).
+ * O processamento de audio tem o proprio CSV, em dsp.cpp.
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+// Contadores de alocacao, implementados em alloc_stats.cpp para cada plataforma
+void benchAllocReset(void);
+uint32_t benchAllocCount(void);
+uint32_t benchAllocPeak(void); // Maior uso do heap acima do nivel do ultimo reset
+
+void runBenchmarks(const char *platform, const char *baseDir, uint32_t maxTracks);
+uint32_t runDspBenchmarks(const char *platform); // dsp.cpp; devolve os casos fora da tolerancia
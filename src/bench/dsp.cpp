@@ -0,0 +1,233 @@
+/**
+ * Benchmark do processamento de audio sobre sinais sinteticos
+ *
+ * Espectro: cada sinal passa pela analise em ponto fixo (spectrumAnalyze) e
+ * pela referencia em double (spectrumReference); a linha traz a maior
+ * diferenca de altura entre as duas, em pixels, e o custo medio de um quadro
+ * contra o orcamento. Saida em CSV como o benchmark da biblioteca.
+ *
+ * EQ: cada preset processa ruido estereo um quadro por chamada, como o gancho
+ * da Audio chama eqProcess(); a linha traz a maior diferenca para a
+ * mesma cascata em double, em LSB, os ciclos por quadro e a parte de um core
+ * que isso toma a 44.1 kHz. O resto do core e do decoder, e o MP3 de 320 kbps
+ * e o caso mais pesado dele. O crossfade roda duas cascatas e aparece a parte.
+*/
+
+#include "bench.h"
+#include "hal.h"
+#include "spectrum.h"
+#include "equalizer.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DSP_ROUNDS 200
+#define DSP_SAMPLE_RATE (44100 / SPECTRUM_DECIMATION)
+#define DSP_SEED 0x2545F491
+#define DSP_EQ_FRAMES 4096
+#define DSP_EQ_ROUNDS 20
+#define DSP_EQ_RATE 44100
+
+struct DspSignal {
+  const char *name;
+  float frequency[2]; // Hz; 0 = sem o tom
+  float level[2]; // dBFS de cada tom
+  float noise; // dBFS do ruido branco; 0 = sem ruido
+};
+
+const struct DspSignal dspSignals[] = {
+  { "silencio", { 0, 0 }, { 0, 0 }, 0 },
+  { "seno_1k_0db", { 1000, 0 }, { 0, 0 }, 0 },
+  { "seno_100_-20db", { 100, 0 }, { -20, 0 }, 0 },
+  { "seno_3k_-50db", { 3000, 0 }, { -50, 0 }, 0 },
+  { "tons_440_5k_-6db", { 440, 5000 }, { -6, -6 }, 0 },
+  { "ruido_-12db", { 0, 0 }, { 0, 0 }, -12 },
+  { "seno_60_ruido_-40db", { 60, 0 }, { -3, 0 }, -40 },
+};
+#define DSP_SIGNAL_COUNT (sizeof(dspSignals) / sizeof(dspSignals[0]))
+
+// Cascata em double de um preset: coeficientes do eqDesign() e estado por banda e canal
+struct EqReference {
+  double coefficients[EQ_BANDS][EQ_COEFFICIENTS];
+  double state[EQ_BANDS][2][4];
+};
+
+int16_t dspSamples[SPECTRUM_FFT_SIZE];
+int16_t eqInput[DSP_EQ_FRAMES * 2];
+int16_t eqFixed[DSP_EQ_FRAMES * 2];
+uint32_t dspRandomState = DSP_SEED;
+
+void generateSignal(const struct DspSignal *signal);
+uint32_t runEqBenchmarks(const char *platform);
+bool runEqCase(const char *platform, const char *name, uint8_t from, uint8_t to);
+uint32_t eqTimed(uint8_t from, uint8_t to);
+void eqSettle(uint8_t preset);
+void eqReferenceBegin(struct EqReference *reference, uint8_t preset);
+double eqReferenceStep(struct EqReference *reference, uint8_t channel, double x);
+uint32_t dspRandom(void);
+
+// Devolve quantos casos ficaram longe da referencia
+uint32_t runDspBenchmarks(const char *platform) {
+  uint32_t failures = 0;
+  spectrumBegin();
+  halLogf("platform,dsp,signal,max_error_px,max_height,ns_per_frame,budget_us\n");
+
+  for(uint8_t s = 0; s < DSP_SIGNAL_COUNT; s++) {
+    generateSignal(&dspSignals[s]);
+    uint8_t fixed[SPECTRUM_BARS];
+    uint8_t reference[SPECTRUM_BARS];
+    spectrumReference(dspSamples, reference);
+
+    uint32_t start = halMicros();
+    for(uint16_t i = 0; i < DSP_ROUNDS; i++) spectrumAnalyze(dspSamples, fixed);
+    uint32_t elapsed = halMicros() - start;
+
+    uint8_t maxError = 0;
+    uint8_t maxHeight = 0;
+    for(uint8_t bar = 0; bar < SPECTRUM_BARS; bar++) {
+      uint8_t error = abs(fixed[bar] - reference[bar]);
+      if(error > maxError) maxError = error;
+      if(fixed[bar] > maxHeight) maxHeight = fixed[bar];
+    }
+    halLogf(
+      "%s,spectrum,%s,%u,%u,%lu,%u\n",
+      platform, dspSignals[s].name, maxError, maxHeight,
+      (unsigned long)((uint64_t)elapsed * 1000 / DSP_ROUNDS), SPECTRUM_BUDGET_US
+    );
+    if(maxError > 1) {
+      halLogf("# %s: ponto fixo longe da referencia\n", dspSignals[s].name);
+      failures++;
+    }
+  }
+
+  failures += runEqBenchmarks(platform);
+  return failures;
+}
+
+uint32_t runEqBenchmarks(const char *platform) {
+  uint32_t failures = 0;
+  eqBegin();
+  eqSetRate(DSP_EQ_RATE);
+  // Ruido a -12 dBFS com um seno de 80 Hz a -6 dBFS no L: os reforcos de grave chegam perto da escala cheia
+  dspRandomState = DSP_SEED;
+  for(uint32_t i = 0; i < DSP_EQ_FRAMES; i++) {
+    float noise = ((int32_t)(dspRandom() >> 16) - 32768) / 4.0f;
+    eqInput[2 * i] = lroundf(noise + 16384 * sinf(2 * (float)M_PI * 80 * i / DSP_EQ_RATE));
+    eqInput[2 * i + 1] = ((int32_t)(dspRandom() >> 16) - 32768) / 4;
+  }
+
+  halLogf("platform,dsp,case,max_error_lsb,cycles_per_frame,cpu_permille_44k\n");
+  for(uint8_t preset = 0; preset < eqPresetCount; preset++) {
+    if(!runEqCase(platform, eqPresets[preset].name, preset, preset)) failures++;
+  }
+  if(!runEqCase(platform, "crossfade", 4, 5)) failures++;
+  eqSettle(0);
+  return failures;
+}
+
+// De from para to; com from == to e o preset parado, senao so os quadros do crossfade. False se passou de 1 LSB
+bool runEqCase(const char *platform, const char *name, uint8_t from, uint8_t to) {
+  uint32_t frames = from == to ? DSP_EQ_FRAMES : EQ_CROSSFADE_FRAMES;
+  eqSettle(from);
+  memcpy(eqFixed, eqInput, frames * 2 * sizeof(int16_t));
+  eqSelect(to);
+  for(uint32_t i = 0; i < frames; i++) eqProcess(eqFixed + 2 * i, 1);
+
+  // Referencia: as duas cascatas e o mesmo peso do crossfade, em double
+  struct EqReference reference[2];
+  eqReferenceBegin(&reference[0], from);
+  eqReferenceBegin(&reference[1], to);
+  uint32_t maxError = 0;
+  for(uint32_t i = 0; i < frames; i++) {
+    double weight = from == to ? 0 : (double)(i << (15 - EQ_CROSSFADE_BITS)) / 32768;
+    for(uint8_t channel = 0; channel < 2; channel++) {
+      double x = eqInput[2 * i + channel];
+      double old = eqReferenceStep(&reference[0], channel, x);
+      double fresh = from == to ? old : eqReferenceStep(&reference[1], channel, x);
+      double y = lround(old * (1 - weight) + fresh * weight);
+      y = y > 32767 ? 32767 : y < -32768 ? -32768 : y;
+      uint32_t error = fabs(y - eqFixed[2 * i + channel]);
+      if(error > maxError) maxError = error;
+    }
+  }
+
+  uint64_t cycles = 0;
+  for(uint8_t round = 0; round < DSP_EQ_ROUNDS; round++) cycles += eqTimed(from, to);
+  uint32_t perFrame = cycles / ((uint64_t)DSP_EQ_ROUNDS * frames);
+  halLogf(
+    "%s,eq,%s,%lu,%lu,%lu\n",
+    platform, name, (unsigned long)maxError, (unsigned long)perFrame,
+    (unsigned long)((uint64_t)perFrame * DSP_EQ_RATE / halCyclesPerMicro() / 1000)
+  );
+  if(maxError > 1) {
+    halLogf("# %s: ponto fixo longe da referencia\n", name);
+    return false;
+  }
+  return true;
+}
+
+uint32_t eqTimed(uint8_t from, uint8_t to) {
+  uint32_t frames = from == to ? DSP_EQ_FRAMES : EQ_CROSSFADE_FRAMES;
+  eqSettle(from);
+  memcpy(eqFixed, eqInput, frames * 2 * sizeof(int16_t));
+  eqSelect(to);
+  uint32_t start = halCycles();
+  for(uint32_t i = 0; i < frames; i++) eqProcess(eqFixed + 2 * i, 1);
+  return halCycles() - start;
+}
+
+/**
+ * Deixa o preset ativo no decoder com o estado zerado. So a troca zera o
+ * estado, entao passa por outro preset antes; cada troca termina com um
+ * crossfade inteiro de silencio (o preset que sai ainda solta a cauda, entao
+ * o buffer e zerado de novo a cada bloco).
+ */
+void eqSettle(uint8_t preset) {
+  uint8_t presets[2] = { (uint8_t)(preset == 0 ? 1 : 0), preset };
+  for(uint8_t i = 0; i < 4; i++) {
+    if(i % 2 == 0) eqSelect(presets[i / 2]);
+    memset(eqFixed, 0, sizeof(int16_t) * 2 * EQ_CROSSFADE_FRAMES);
+    eqProcess(eqFixed, EQ_CROSSFADE_FRAMES);
+  }
+}
+
+void eqReferenceBegin(struct EqReference *reference, uint8_t preset) {
+  memset(reference, 0, sizeof(*reference));
+  for(uint8_t band = 0; band < EQ_BANDS; band++) eqDesign(preset, band, DSP_EQ_RATE, reference->coefficients[band]);
+}
+
+double eqReferenceStep(struct EqReference *reference, uint8_t channel, double x) {
+  for(uint8_t band = 0; band < EQ_BANDS; band++) {
+    const double *c = reference->coefficients[band];
+    double *s = reference->state[band][channel];
+    double y = c[0] * x + c[1] * s[0] + c[2] * s[1] - c[3] * s[2] - c[4] * s[3];
+    s[1] = s[0]; s[0] = x;
+    s[3] = s[2]; s[2] = y;
+    x = y;
+  }
+  return x;
+}
+
+// Mono ja decimado, como sai do anel do spectrumFeed()
+void generateSignal(const struct DspSignal *signal) {
+  dspRandomState = DSP_SEED;
+  for(uint16_t i = 0; i < SPECTRUM_FFT_SIZE; i++) {
+    float value = 0;
+    for(uint8_t tone = 0; tone < 2; tone++) {
+      if(signal->frequency[tone] == 0) continue;
+      value += powf(10, signal->level[tone] / 20) * sinf(2 * (float)M_PI * signal->frequency[tone] * i / DSP_SAMPLE_RATE);
+    }
+    // Uniforme em [-1, 1) tem RMS de 1/sqrt(3); o nivel e o do pico
+    if(signal->noise != 0) value += powf(10, signal->noise / 20) * ((int32_t)(dspRandom() >> 16) - 32768) / 32768.0f;
+    float sample = value * 32767;
+    dspSamples[i] = sample > 32767 ? 32767 : sample < -32768 ? -32768 : (int16_t)lroundf(sample);
+  }
+}
+
+// xorshift32, o mesmo do benchmark da biblioteca: ruido igual em todas as execucoes
+uint32_t dspRandom() {
+  dspRandomState ^= dspRandomState << 13;
+  dspRandomState ^= dspRandomState >> 17;
+  dspRandomState ^= dspRandomState << 5;
+  return dspRandomState;
+}
@@ -0,0 +1,32 @@
+/**
+ * Benchmark da biblioteca na placa. Use um cartao de rascunho: as bibliotecas
+ * sinteticas ficam em BENCH_DIR e a geracao do maior caso leva varios minutos.
+*/
+
+#include <Arduino.h>
+#include "hal_esp32.h"
+#include "bench.h"
+
+#define BENCH_DIR "/bench"
+
+// Limite de faixas dos casos; a arena do maior caso nao cabe no heap da placa
+#ifndef BENCH_MAX_TRACKS
+#define BENCH_MAX_TRACKS 10000
+#endif
+
+void setup() {
+  Serial.begin(9600);
+  if(!sdMount()) {
+    Serial.println("ERR: Cartao nao montado!");
+    return;
+  }
+  if(!SD_CARD.exists(BENCH_DIR)) SD_CARD.mkdir(BENCH_DIR);
+  runBenchmarks("esp32", BENCH_DIR, BENCH_MAX_TRACKS);
+  uint32_t failures = runDspBenchmarks("esp32");
+  if(failures > 0) Serial.printf("ERR: %lu casos de DSP longe da referencia\n", (unsigned long)failures);
+  Serial.println("# fim");
+}
+
+void loop() {
+  delay(1000);
+}
@@ -0,0 +1,53 @@
+/**
+ * Benchmark da biblioteca no host
+ * Uso: program [pasta-de-trabalho] [--max-tracks N] [--dsp-only]
+ * Sai com 1 se algum caso do DSP ficar fora da tolerancia.
+ * As bibliotecas sinteticas ficam na pasta de trabalho e sao reaproveitadas
+ * entre execucoes; apague a pasta para gerar de novo.
+*/
+
+#include "bench.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#define BENCH_DEFAULT_DIR "/tmp/mp3-player-bench"
+#define BENCH_DEFAULT_MAX_TRACKS 65535
+
+int checkDsp(uint32_t failures);
+
+int main(int argc, char **argv) {
+  const char *baseDir = BENCH_DEFAULT_DIR;
+  uint32_t maxTracks = BENCH_DEFAULT_MAX_TRACKS;
+  bool dspOnly = false;
+
+  for(int i = 1; i < argc; i++) {
+    if(strcmp(argv[i], "--max-tracks") == 0 && i + 1 < argc) maxTracks = strtoul(argv[++i], NULL, 10);
+    else if(strcmp(argv[i], "--dsp-only") == 0) dspOnly = true;
+    else if(argv[i][0] != '-') baseDir = argv[i];
+    else {
+      fprintf(stderr, "uso: %s [pasta-de-trabalho] [--max-tracks N] [--dsp-only]\n", argv[0]);
+      return 2;
+    }
+  }
+
+  if(dspOnly) return checkDsp(runDspBenchmarks("native"));
+
+  mkdir(baseDir, 0755);
+  struct stat info;
+  if(stat(baseDir, &info) != 0 || !S_ISDIR(info.st_mode)) {
+    fprintf(stderr, "pasta de trabalho invalida: %s\n", baseDir);
+    return 2;
+  }
+
+  runBenchmarks("native", baseDir, maxTracks);
+  return checkDsp(runDspBenchmarks("native"));
+}
+
+// Status de saida: 1 se o ponto fixo do DSP se afastou da referencia
+int checkDsp(uint32_t failures) {
+  if(failures == 0) return 0;
+  fprintf(stderr, "ERR: %lu casos de DSP longe da referencia\n", (unsigned long)failures);
+  return 1;
+}
@@ -0,0 +1,262 @@
+/**
+ * Preparo do cartao no host: o mesmo codigo de lib/player que roda na placa
+ *
+ * Uso: program build|verify <pasta-do-cartao>
+ *
+ *  build   varre o cartao como o boot faria (pastas, faixas, tipos conferidos
+ *          pelo cabecalho e ordem da busca) e le as tags e duracoes de todas as
+ *          faixas. A impressao das pastas sai igual a que a placa tira, entao
+ *          o primeiro boot carrega o indice numa leitura sem varrer nada.
+ *          As faixas mp3/aac/m4a sem REPLAYGAIN_TRACK_GAIN sao decodificadas
+ *          pelo ffmpeg do host (CARDTOOL_DECODER troca o programa) e ganham o
+ *          nivel medido com a mesma conta do wav; sem o decodificador elas
+ *          ficam sem ganho, com um aviso.
+ *  verify  refaz tudo numa pasta temporaria (o LIBRARY_INDEX_DIR e desviado
+ *          para ela) e compara com o indice e o cache de tags do cartao, que
+ *          so e lido. As flags do indice nao entram na comparacao: dependem
+ *          de quem gravou. Sai com 1 se algo for diferente ou se a varredura
+ *          nao puder ser gravada.
+*/
+
+#include "hal.h"
+#include "native/hal_native.h"
+#include "library.h"
+#include "metadata.h"
+#include "player.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define DECODER_DEFAULT "ffmpeg"
+#define DECODER_READ_SIZE 8192
+
+struct CardFile {
+  uint8_t *data;
+  uint32_t size;
+};
+
+bool buildCard(void);
+uint32_t measureHostGains(void);
+bool measureHostGain(const char *path, int16_t *gain);
+bool readCardFile(const char *path, struct CardFile *file);
+uint32_t compareIndex(const struct CardFile *card, const struct CardFile *built);
+uint32_t compareTags(const struct CardFile *card, const struct CardFile *built);
+
+int main(int argc, char **argv) {
+  if(argc != 3 || (strcmp(argv[1], "build") != 0 && strcmp(argv[1], "verify") != 0)) {
+    fprintf(stderr, "Uso: %s build|verify <pasta-do-cartao>\n", argv[0]);
+    return 2;
+  }
+  halFsSetRoot(argv[2]);
+
+  if(strcmp(argv[1], "build") == 0) {
+    if(!buildCard()) {
+      fprintf(stderr, "ERR: Nao foi possivel gravar o indice e as tags no cartao\n");
+      return 1;
+    }
+    printf("Cartao pronto: %u pastas, %lu faixas\n", folderCounter, (unsigned long)libraryFileCounter);
+    return 0;
+  }
+
+  struct CardFile cardIndex, cardTags, builtIndex, builtTags;
+  if(!readCardFile(LIBRARY_INDEX_PATH, &cardIndex) || !readCardFile(TAGS_PATH, &cardTags)) {
+    fprintf(stderr, "ERR: O cartao nao tem %s e %s\n", LIBRARY_INDEX_PATH, TAGS_PATH);
+    return 1;
+  }
+
+  char scratch[] = "/tmp/cardtool.XXXXXX";
+  if(mkdtemp(scratch) == NULL) {
+    fprintf(stderr, "ERR: Nao foi possivel criar a pasta temporaria\n");
+    return 1;
+  }
+  nativeSetScratch(LIBRARY_INDEX_DIR, scratch);
+  bool built = buildCard() && readCardFile(LIBRARY_INDEX_PATH, &builtIndex) && readCardFile(TAGS_PATH, &builtTags);
+  halFsRemove(LIBRARY_INDEX_PATH);
+  halFsRemove(TAGS_PATH);
+  nativeSetScratch(NULL, NULL);
+  rmdir(scratch);
+  if(!built) {
+    fprintf(stderr, "ERR: Nao foi possivel refazer o indice e as tags\n");
+    return 1;
+  }
+
+  uint32_t differences = compareIndex(&cardIndex, &builtIndex) + compareTags(&cardTags, &builtTags);
+  free(cardIndex.data);
+  free(cardTags.data);
+  free(builtIndex.data);
+  free(builtTags.data);
+  if(differences > 0) {
+    printf("Cartao diferente da varredura: %lu diferencas\n", (unsigned long)differences);
+    return 1;
+  }
+  printf("Cartao confere: %u pastas, %lu faixas\n", folderCounter, (unsigned long)libraryFileCounter);
+  return 0;
+}
+
+// Sem indice nem cache o mountSdStruct() varre tudo, como no primeiro boot da placa
+bool buildCard() {
+  halFsRemove(LIBRARY_INDEX_PATH);
+  halFsRemove(TAGS_PATH);
+  mountSdStruct();
+  while(metadataStep());
+  uint32_t missing = measureHostGains();
+  metadataClose();
+  if(missing > 0) {
+    fprintf(stderr, "Aviso: %lu faixas sem ganho (o decodificador do host nao rodou)\n", (unsigned long)missing);
+  }
+
+  libraryIndexFlags = LIBRARY_INDEX_OFFLINE;
+  return saveLibraryIndex() && halFsExists(TAGS_PATH);
+}
+
+/**
+ * Ganho das faixas comprimidas sem tag: a placa so tem o decoder da reproducao,
+ * entao o nivel delas so pode ser medido aqui. Devolve quantas ficaram sem.
+ */
+uint32_t measureHostGains() {
+  uint32_t missing = 0;
+  for(uint16_t folder = 0; folder < folderCounter; folder++) {
+    for(uint16_t file = 0; file < folders[folder].fileCounter; file++) {
+      uint32_t track = folders[folder].firstFile + file;
+      struct TrackTags tags;
+      if(getFileType(folder, file) == FILE_TYPE_WAV || !metadataRecord(track, &tags) || tags.gain != 0) continue;
+
+      char path[PREFETCH_PATH_SIZE];
+      int16_t gain;
+      if(!buildTrackPath(path, sizeof(path), folder, file) || !measureHostGain(path, &gain)) {
+        missing++;
+        continue;
+      }
+      if(gain != 0) metadataStoreGain(track, gain);
+    }
+  }
+  return missing;
+}
+
+// PCM mono de 16 bits do decodificador por um pipe, sem passar o caminho pelo shell
+bool measureHostGain(const char *path, int16_t *gain) {
+  const char *decoder = getenv("CARDTOOL_DECODER");
+  if(decoder == NULL || decoder[0] == '\0') decoder = DECODER_DEFAULT;
+  char *full = nativeHostPath(path);
+  int output[2];
+  if(pipe(output) != 0) {
+    free(full);
+    return false;
+  }
+
+  pid_t child = fork();
+  if(child == 0) {
+    dup2(output[1], STDOUT_FILENO);
+    close(output[0]);
+    close(output[1]);
+    execlp(decoder, decoder, "-nostdin", "-v", "quiet", "-i", full, "-f", "s16le", "-ac", "1", "-", (char*)NULL);
+    _exit(127);
+  }
+  free(full);
+  close(output[1]);
+  if(child < 0) {
+    close(output[0]);
+    return false;
+  }
+
+  uint8_t buffer[DECODER_READ_SIZE];
+  uint64_t sum = 0;
+  uint64_t samples = 0;
+  ssize_t carry = 0; // O pipe pode cortar um sample no meio
+  ssize_t length;
+  while((length = read(output[0], buffer + carry, sizeof(buffer) - carry)) > 0) {
+    length += carry;
+    for(ssize_t i = 0; i + 1 < length; i += 2) {
+      int32_t sample = (int16_t)(buffer[i] | buffer[i + 1] << 8);
+      sum += sample * sample;
+    }
+    samples += length / 2;
+    carry = length & 1;
+    if(carry) buffer[0] = buffer[length - 1];
+  }
+  close(output[0]);
+
+  int status;
+  if(waitpid(child, &status, 0) != child || !WIFEXITED(status) || WEXITSTATUS(status) != 0) return false;
+  *gain = replayGainFromPower(sum, samples);
+  return true;
+}
+
+bool readCardFile(const char *path, struct CardFile *file) {
+  HalFile input;
+  if(!input.open(path)) return false;
+  file->size = input.size();
+  file->data = (uint8_t*)malloc(file->size > 0 ? file->size : 1);
+  bool read = file->data != NULL && input.read(file->data, file->size) == file->size;
+  input.close();
+  return read;
+}
+
+/**
+ * Cabecalho sem as flags, pastas campo a campo (com a impressao) e o resto da
+ * arena (faixas, ordem da busca, tipos e nomes) byte a byte.
+ */
+uint32_t compareIndex(const struct CardFile *card, const struct CardFile *built) {
+  struct LibraryIndexHeader cardHeader, builtHeader;
+  if(card->size < sizeof(cardHeader) || card->size != built->size) {
+    printf("Indice: %lu bytes no cartao, %lu na varredura\n", (unsigned long)card->size, (unsigned long)built->size);
+    return 1;
+  }
+  memcpy(&cardHeader, card->data, sizeof(cardHeader));
+  memcpy(&builtHeader, built->data, sizeof(builtHeader));
+  cardHeader.flags = builtHeader.flags;
+  if(memcmp(&cardHeader, &builtHeader, sizeof(cardHeader)) != 0) {
+    printf("Indice: cabecalho diferente (%u pastas e %lu faixas no cartao)\n", cardHeader.folderCounter, (unsigned long)cardHeader.fileCounter);
+    return 1;
+  }
+
+  uint32_t differences = 0;
+  const struct Folder *cardFolders = (const struct Folder*)(card->data + sizeof(cardHeader));
+  for(uint16_t i = 0; i < folderCounter; i++) {
+    if(
+      cardFolders[i].name != folders[i].name ||
+      cardFolders[i].firstFile != folders[i].firstFile ||
+      cardFolders[i].fileCounter != folders[i].fileCounter ||
+      cardFolders[i].nameHash != folders[i].nameHash ||
+      cardFolders[i].entryCounter != folders[i].entryCounter
+    ) {
+      printf("Indice: pasta %s diferente\n", getFolderName(i));
+      differences++;
+    }
+  }
+
+  uint32_t rest = sizeof(cardHeader) + sizeof(struct Folder) * folderCounter;
+  for(uint32_t i = rest; i < card->size; i++) {
+    if(card->data[i] != built->data[i]) {
+      printf("Indice: arena diferente a partir do byte %lu\n", (unsigned long)(i - sizeof(cardHeader)));
+      return differences + 1;
+    }
+  }
+  return differences;
+}
+
+uint32_t compareTags(const struct CardFile *card, const struct CardFile *built) {
+  if(card->size != built->size) {
+    printf("Tags: %lu bytes no cartao, %lu na varredura\n", (unsigned long)card->size, (unsigned long)built->size);
+    return 1;
+  }
+  // A tabela de pastas vem da biblioteca, que compareIndex() ja conferiu
+  uint32_t base = sizeof(struct TagsHeader) + folderCounter * sizeof(struct TagsFolder);
+  uint32_t differences = 0;
+  if(card->size < base || memcmp(card->data, built->data, base) != 0) {
+    printf("Tags: cabecalho ou tabela de pastas diferente\n");
+    return 1;
+  }
+  for(uint32_t track = 0; base + (track + 1) * sizeof(struct TrackTags) <= card->size; track++) {
+    uint32_t offset = base + track * sizeof(struct TrackTags);
+    if(memcmp(card->data + offset, built->data + offset, sizeof(struct TrackTags)) != 0) {
+      uint16_t folder = findFolderByTrack(track);
+      printf("Tags: %s/%s diferente\n", getFolderName(folder), getFileName(folder, track - folders[folder].firstFile));
+      differences++;
+    }
+  }
+  return differences;
+}
@@ -0,0 +1,652 @@
+/**
+ * Implementacao do HAL para a placa: SD, ESP32-audioI2S, SSD1306 no Wire e
+ * HC-12 na Serial2
+*/
+
+#include "hal_esp32.h"
+#include "hal.h"
+#include "player.h"
+#include "profiler.h"
+#include <FSImpl.h>
+#include <dirent.h>
+#include <new>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#define LOG_BUFFER_SIZE 256
+#define FS_ROOT_SIZE 48
+#define FS_PATH_SIZE 320
+#define SD_SECTOR_SIZE 512
+
+// I2C a 400 kHz tambem fora do display(), ja que o halDisplaySend() fala direto com o Wire
+Adafruit_SSD1306 display(HAL_DISPLAY_WIDTH, HAL_DISPLAY_HEIGHT, &Wire, OLED_RESET, 400000UL, 400000UL);
+Audio audio;
+HardwareSerial HC12 = Serial2;
+TaskHandle_t prefetchTaskHandler = NULL;
+TaskHandle_t audioTaskHandler = NULL;
+QueueHandle_t decoderQueue = NULL;
+
+// Publicados pela tarefa do decoder para o loop()
+volatile uint32_t decoderCurrentTime = 0;
+volatile uint32_t decoderDuration = 0;
+volatile uint32_t decoderSampleRate = 0;
+volatile uint32_t i2sFrames = 0;
+volatile uint32_t i2sUnderruns = 0;
+bool decoderSeekPending = false;
+uint32_t decoderSeekTarget = 0;
+bool i2sLedgerValid = false;
+uint32_t i2sLedgerStart = 0;
+uint32_t i2sLedgerFrames = 0;
+int32_t i2sLedgerFill = 0; // Quadros estimados no DMA em i2sLedgerStart
+
+/**
+ * Fonte 5x7 da Adafruit_GFX extraida uma vez no boot, desenhando cada
+ * caractere numa tela de colunas, para que a tela continue igual a de antes.
+ */
+class GlyphCanvas : public Adafruit_GFX {
+  public:
+    uint8_t columns[HAL_GLYPH_WIDTH];
+    GlyphCanvas() : Adafruit_GFX(HAL_GLYPH_WIDTH, 8) {}
+    void drawPixel(int16_t x, int16_t y, uint16_t color) {
+      if(x < 0 || x >= HAL_GLYPH_WIDTH || y < 0 || y >= 8) return;
+      if(color == SSD1306_WHITE) columns[x] |= 1 << y;
+      else columns[x] &= ~(1 << y);
+    }
+};
+uint8_t displayGlyphs[256][HAL_GLYPH_WIDTH];
+char fsRoot[FS_ROOT_SIZE] = "";
+
+// Estado de um HalDir aberto: o caminho no VFS fica para o stat() das entradas
+struct VfsDir {
+  DIR *dir;
+  char path[FS_PATH_SIZE + sizeof(SD_MOUNT_POINT)];
+};
+uint32_t sdClock = 0;
+
+// Da mais rapida para a mais lenta; a montagem comeca na primeira que nao passa do limite
+#ifdef SD_USE_MMC
+const uint32_t sdFrequencies[] = { SDMMC_FREQ_HIGHSPEED * 1000, SDMMC_FREQ_DEFAULT * 1000 };
+#else
+const uint32_t sdFrequencies[] = { 40000000, 26000000, 20000000, 10000000, 4000000 };
+#endif
+#define SD_FREQUENCY_COUNT (sizeof(sdFrequencies) / sizeof(sdFrequencies[0]))
+
+static_assert(sizeof(File) <= HAL_FILE_STORAGE, "HAL_FILE_STORAGE menor que fs::File");
+#define FILE_OF(storage) (reinterpret_cast<File*>(storage))
+
+uint32_t halMillis() { return millis(); }
+uint32_t halMicros() { return micros(); }
+uint32_t halRandom() { return esp_random(); }
+uint32_t halCycles() { return ESP.getCycleCount(); }
+uint32_t halCyclesPerMicro() { return ESP.getCpuFreqMHz(); }
+uint32_t halFreeHeap() { return ESP.getFreeHeap(); }
+uint32_t halMaxAllocHeap() { return ESP.getMaxAllocHeap(); }
+
+void halLogf(const char *format, ...) {
+  char buffer[LOG_BUFFER_SIZE];
+  va_list args;
+  va_start(args, format);
+  int length = vsnprintf(buffer, sizeof(buffer), format, args);
+  va_end(args);
+  if(length < (int)sizeof(buffer)) {
+    Serial.print(buffer);
+    return;
+  }
+
+  char *line = (char*)malloc(length + 1);
+  if(line == NULL) return;
+  va_start(args, format);
+  vsnprintf(line, length + 1, format, args);
+  va_end(args);
+  Serial.print(line);
+  free(line);
+}
+
+int halRadioAvailable() { return HC12.available(); }
+int halRadioRead() { return HC12.read(); }
+size_t halRadioWrite(const uint8_t *data, size_t length) { return HC12.write(data, length); }
+void halRadioSetCommandMode(bool command) { digitalWrite(HC12_SET_PIN, command ? LOW : HIGH); }
+void halRadioSetBaud(uint32_t baud) { HC12.updateBaudRate(baud); }
+
+// Caminho no cartao com a raiz de halFsSetRoot() na frente; sem raiz usa path direto
+const char* rootedPath(const char *path, char *buffer) {
+  if(fsRoot[0] == '\0') return path;
+  if(strcmp(path, "/") == 0) return fsRoot;
+  snprintf(buffer, FS_PATH_SIZE, "%s%s", fsRoot, path);
+  return buffer;
+}
+
+bool HalFile::open(const char *path, uint8_t mode) {
+  char buffer[FS_PATH_SIZE];
+  close();
+  const char *fileMode = mode == HAL_FILE_WRITE ? FILE_WRITE : mode == HAL_FILE_UPDATE ? "r+" : FILE_READ;
+  File file = SD_CARD.open(rootedPath(path, buffer), fileMode);
+  if(!file) return false;
+  new (storage) File(file);
+  opened = true;
+  return true;
+}
+
+bool HalFile::openNext(HalFile &entry) {
+  entry.close();
+  if(!opened) return false;
+  File file = FILE_OF(storage)->openNextFile();
+  if(!file) return false;
+  new (entry.storage) File(file);
+  entry.opened = true;
+  return true;
+}
+
+void HalFile::rewind() {
+  if(opened) FILE_OF(storage)->rewindDirectory();
+}
+
+// readdir() do VFS: o FAT do IDF preenche d_type, entao nada e aberto
+bool HalDir::open(const char *path) {
+  char buffer[FS_PATH_SIZE];
+  close();
+  struct VfsDir *vfs = (struct VfsDir*)malloc(sizeof(struct VfsDir));
+  if(vfs == NULL) return false;
+  snprintf(vfs->path, sizeof(vfs->path), "%s%s", SD_MOUNT_POINT, rootedPath(path, buffer));
+  vfs->dir = opendir(vfs->path);
+  if(vfs->dir == NULL) {
+    free(vfs);
+    return false;
+  }
+  handle = vfs;
+  return true;
+}
+
+// O dirent do VFS nao traz o tamanho: so os arquivos pagam um stat()
+bool HalDir::next(const char **name, bool *isDirectory, uint32_t *size) {
+  if(handle == NULL) return false;
+  struct VfsDir *vfs = (struct VfsDir*)handle;
+  struct dirent *entry;
+  while((entry = readdir(vfs->dir)) != NULL) {
+    if(strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
+    *name = entry->d_name;
+    *isDirectory = entry->d_type == DT_DIR;
+    *size = 0;
+    if(!*isDirectory) {
+      char full[sizeof(vfs->path) + 1 + maxFileNameSize];
+      struct stat info;
+      bool slash = vfs->path[strlen(vfs->path) - 1] == '/'; // A raiz ja termina em "/"
+      snprintf(full, sizeof(full), "%s%s%s", vfs->path, slash ? "" : "/", entry->d_name);
+      if(stat(full, &info) == 0) *size = info.st_size;
+    }
+    return true;
+  }
+  return false;
+}
+
+void HalDir::close() {
+  if(handle == NULL) return;
+  closedir(((struct VfsDir*)handle)->dir);
+  free(handle);
+  handle = NULL;
+}
+
+void HalFile::close() {
+  if(!opened) return;
+  FILE_OF(storage)->close();
+  FILE_OF(storage)->~File();
+  opened = false;
+}
+
+bool HalFile::isDirectory() { return opened && FILE_OF(storage)->isDirectory(); }
+const char* HalFile::name() { return opened ? FILE_OF(storage)->name() : ""; }
+uint32_t HalFile::lastWrite() { return opened ? (uint32_t)FILE_OF(storage)->getLastWrite() : 0; }
+uint32_t HalFile::size() { return opened ? FILE_OF(storage)->size() : 0; }
+bool HalFile::seek(uint32_t position) { return opened && FILE_OF(storage)->seek(position); }
+
+size_t HalFile::read(void *buffer, size_t length) {
+  return opened ? FILE_OF(storage)->read((uint8_t*)buffer, length) : 0;
+}
+
+size_t HalFile::write(const void *buffer, size_t length) {
+  return opened ? FILE_OF(storage)->write((const uint8_t*)buffer, length) : 0;
+}
+
+void halFsSetRoot(const char *path) {
+  strlcpy(fsRoot, strcmp(path, "/") == 0 ? "" : path, FS_ROOT_SIZE);
+}
+
+bool halFsExists(const char *path) {
+  char buffer[FS_PATH_SIZE];
+  return SD_CARD.exists(rootedPath(path, buffer));
+}
+
+bool halFsMkdir(const char *path) {
+  char buffer[FS_PATH_SIZE];
+  return SD_CARD.mkdir(rootedPath(path, buffer));
+}
+
+bool halFsRemove(const char *path) {
+  char buffer[FS_PATH_SIZE];
+  return SD_CARD.remove(rootedPath(path, buffer));
+}
+
+bool halFsRename(const char *from, const char *to) {
+  char fromBuffer[FS_PATH_SIZE];
+  char toBuffer[FS_PATH_SIZE];
+  return SD_CARD.rename(rootedPath(from, fromBuffer), rootedPath(to, toBuffer));
+}
+
+uint32_t halFsClock() { return sdClock; }
+
+#ifndef SD_USE_MMC
+// O setor 0 (MBR ou boot do FAT) lido SD_PROBE_READS vezes, sempre igual e com a assinatura
+bool sdProbe() {
+  uint8_t *first = (uint8_t*)malloc(SD_SECTOR_SIZE * 2);
+  if(first == NULL) return true;
+  uint8_t *again = first + SD_SECTOR_SIZE;
+  bool stable = SD.readRAW(first, 0) && first[510] == 0x55 && first[511] == 0xAA;
+  for(uint8_t i = 1; stable && i < SD_PROBE_READS; i++) {
+    stable = SD.readRAW(again, 0) && memcmp(first, again, SD_SECTOR_SIZE) == 0;
+  }
+  free(first);
+  return stable;
+}
+#endif
+
+/**
+ * Monta o cartao na frequencia mais alta que passa na leitura de teste. No SPI
+ * um erro de CRC faz o readRAW() falhar, e um bit trocado que passe pelo CRC
+ * aparece como setor diferente entre as leituras; as duas coisas descem a
+ * frequencia. No SD_MMC o driver ja negocia o barramento, entao vale a montagem.
+ */
+bool sdMount() {
+#ifndef SD_USE_MMC
+  uint32_t tried = 0; // SD_SPI_FREQUENCY abaixo de varias da lista vira uma tentativa so
+#endif
+  for(uint8_t i = 0; i < SD_FREQUENCY_COUNT; i++) {
+    uint32_t frequency = sdFrequencies[i];
+#ifdef SD_USE_MMC
+    if(!SD_MMC.begin(SD_MOUNT_POINT, false, false, frequency / 1000)) continue;
+    if(SD_MMC.cardType() == CARD_NONE) {
+      SD_MMC.end();
+      continue;
+    }
+#else
+    if(frequency > SD_SPI_FREQUENCY) frequency = SD_SPI_FREQUENCY;
+    if(frequency == tried) continue;
+    tried = frequency;
+    if(!SD.begin(SD_CS_PIN, SPI, frequency, SD_MOUNT_POINT)) continue;
+    if(!sdProbe()) {
+      halLogf("Cartao: leitura instavel a %lu kHz, descendo\n", (unsigned long)(frequency / 1000));
+      SD.end();
+      continue;
+    }
+#endif
+    sdClock = frequency;
+    halLogf("Cartao: %lu kHz\n", (unsigned long)(frequency / 1000));
+    return true;
+  }
+  return false;
+}
+
+/**
+ * Prefetch na placa: halDecoderPrefetch() abre a proxima faixa na tarefa do
+ * PRO core e le o comeco dela num buffer reservado. O DECODER_OPEN do mesmo
+ * caminho entrega esse File a Audio por prefetchFs, um FS que so sabe abrir
+ * o arquivo do slot da vez: a Audio le primeiro do buffer e depois do File ja
+ * aberto, sem a busca no diretorio nem a primeira leitura do cartao.
+ *
+ * Um slot toca, um pode estar pedido numa abertura ainda na fila e outro
+ * enche; o buffer do slot que toca so volta a ser usado depois que a Audio
+ * fechou o arquivo dele na abertura seguinte.
+ */
+struct PrefetchSlot {
+  File file;
+  char path[DECODER_PATH_SIZE];
+  uint32_t filled;
+  uint8_t state;
+};
+
+class PrefetchFile : public fs::FileImpl {
+  public:
+    PrefetchFile(File file, const uint8_t *buffer, uint32_t filled) :
+      file(file), buffer(buffer), filled(filled), fileSize(file.size()), pos(0) {}
+
+    size_t read(uint8_t *data, size_t size) {
+      size_t done = 0;
+      if(pos < filled) {
+        done = size < filled - pos ? size : filled - pos;
+        memcpy(data, buffer + pos, done);
+        pos += done;
+      }
+      if(done < size && file) {
+        if(file.position() != pos && !file.seek(pos)) return done;
+        size_t read = file.read(data + done, size - done);
+        pos += read;
+        done += read;
+      }
+      return done;
+    }
+
+    bool seek(uint32_t offset, SeekMode mode) {
+      int64_t target = mode == SeekSet ? (int64_t)offset : (mode == SeekCur ? pos : fileSize) + (int32_t)offset;
+      if(target < 0 || target > fileSize) return false;
+      pos = target;
+      return true;
+    }
+
+    // A Audio fecha na abertura seguinte; dali em diante o buffer e de outro prefetch
+    void close() {
+      file.close();
+      filled = 0;
+    }
+
+    size_t position() const { return pos; }
+    size_t size() const { return fileSize; }
+    size_t write(const uint8_t *data, size_t size) { return 0; }
+    void flush() {}
+    bool setBufferSize(size_t size) { return false; }
+    time_t getLastWrite() { return file.getLastWrite(); }
+    const char* path() const { return file.path(); }
+    const char* name() const { return file.name(); }
+    boolean isDirectory(void) { return false; }
+    fs::FileImplPtr openNextFile(const char *mode) { return fs::FileImplPtr(); }
+    boolean seekDir(long position) { return false; }
+    String getNextFileName(void) { return String(); }
+    String getNextFileName(bool *isDir) { return String(); }
+    void rewindDirectory(void) {}
+    operator bool() { return (bool)file; }
+
+  private:
+    File file;
+    const uint8_t *buffer;
+    uint32_t filled;
+    uint32_t fileSize;
+    uint32_t pos;
+};
+
+uint8_t prefetchBuffers[PREFETCH_SLOTS][PREFETCH_BUFFER_SIZE];
+struct PrefetchSlot prefetchSlots[PREFETCH_SLOTS];
+portMUX_TYPE prefetchMux = portMUX_INITIALIZER_UNLOCKED;
+int8_t prefetchPlaying = -1; // Slot da faixa aberta; so a tarefa do decoder mexe
+int8_t prefetchHandoff = -1; // Slot que o prefetchFs entrega durante o connecttoFS()
+
+class PrefetchFs : public fs::FSImpl {
+  public:
+    fs::FileImplPtr open(const char *path, const char *mode, const bool create) {
+      if(prefetchHandoff < 0 || !prefetchSlots[prefetchHandoff].file) return fs::FileImplPtr();
+      struct PrefetchSlot *slot = &prefetchSlots[prefetchHandoff];
+      fs::FileImplPtr file = std::make_shared<PrefetchFile>(slot->file, prefetchBuffers[prefetchHandoff], slot->filled);
+      slot->file = File(); // A Audio fica com o unico dono do arquivo
+      return file;
+    }
+    fs::FileImplPtr open(const char *path, const char *mode) { return open(path, mode, false); }
+    bool exists(const char *path) { return prefetchHandoff >= 0; }
+    bool rename(const char *from, const char *to) { return false; }
+    bool remove(const char *path) { return false; }
+    bool mkdir(const char *path) { return false; }
+    bool rmdir(const char *path) { return false; }
+};
+
+fs::FS prefetchFs(fs::FSImplPtr(new PrefetchFs()));
+
+// Na tarefa do prefetch: ocupa um slot livre ou com um prefetch que ninguem pediu
+bool halDecoderPrefetch(const char *path) {
+  int8_t index = -1;
+  portENTER_CRITICAL(&prefetchMux);
+  for(int8_t i = 0; i < PREFETCH_SLOTS; i++) {
+    uint8_t state = prefetchSlots[i].state;
+    if(state == PREFETCH_READY || (state == PREFETCH_FREE && index < 0)) index = i;
+  }
+  if(index >= 0) prefetchSlots[index].state = PREFETCH_FILLING;
+  portEXIT_CRITICAL(&prefetchMux);
+  if(index < 0) return false;
+
+  char buffer[FS_PATH_SIZE];
+  struct PrefetchSlot *slot = &prefetchSlots[index];
+  slot->file.close();
+  strlcpy(slot->path, path, sizeof(slot->path));
+  slot->file = SD_CARD.open(rootedPath(path, buffer));
+  bool ready = (bool)slot->file;
+  slot->filled = ready ? slot->file.read(prefetchBuffers[index], PREFETCH_BUFFER_SIZE) : 0;
+
+  portENTER_CRITICAL(&prefetchMux);
+  slot->state = ready ? PREFETCH_READY : PREFETCH_FREE;
+  portEXIT_CRITICAL(&prefetchMux);
+  return ready;
+}
+
+// No loop, ao enfileirar a abertura: -1 se path nao esta pronto em nenhum slot
+int8_t claimPrefetch(const char *path) {
+  int8_t index = -1;
+  portENTER_CRITICAL(&prefetchMux);
+  for(int8_t i = 0; i < PREFETCH_SLOTS && index < 0; i++) {
+    if(prefetchSlots[i].state == PREFETCH_READY && strcmp(prefetchSlots[i].path, path) == 0) index = i;
+  }
+  if(index >= 0) prefetchSlots[index].state = PREFETCH_CLAIMED;
+  portEXIT_CRITICAL(&prefetchMux);
+  return index;
+}
+
+void setPrefetchState(int8_t index, uint8_t state) {
+  portENTER_CRITICAL(&prefetchMux);
+  prefetchSlots[index].state = state;
+  portEXIT_CRITICAL(&prefetchMux);
+}
+
+/**
+ * Na tarefa do decoder, depois do connecttoFS(): a Audio ja fechou o arquivo
+ * anterior, entao o slot dele fica livre; o slot pedido passa a tocar se a
+ * Audio ficou com o arquivo dele.
+ */
+void playPrefetch(int8_t index, bool warm) {
+  if(prefetchPlaying >= 0) setPrefetchState(prefetchPlaying, PREFETCH_FREE);
+  prefetchPlaying = -1;
+  if(index < 0) return;
+  if(warm) {
+    prefetchPlaying = index;
+    setPrefetchState(index, PREFETCH_PLAYING);
+    return;
+  }
+  prefetchSlots[index].file.close();
+  setPrefetchState(index, PREFETCH_FREE);
+}
+
+bool sendDecoderCommand(struct DecoderCommand *command) {
+  if(xQueueSend(decoderQueue, command, pdMS_TO_TICKS(DECODER_QUEUE_TIMEOUT)) == pdTRUE) return true;
+  halLogf("ERR: Fila do decoder cheia\n");
+  return false;
+}
+
+// Devolve true se o pedido entrou na fila; a abertura acontece na tarefa do decoder
+bool halDecoderOpen(const char *path) {
+  struct DecoderCommand command;
+  command.type = DECODER_OPEN;
+  if(strlcpy(command.path, path, sizeof(command.path)) >= sizeof(command.path)) return false;
+  command.slot = claimPrefetch(path);
+  decoderCurrentTime = 0;
+  decoderDuration = 0;
+  if(sendDecoderCommand(&command)) return true;
+  if(command.slot >= 0) setPrefetchState(command.slot, PREFETCH_READY);
+  return false;
+}
+
+void halDecoderLoop() {}
+
+void halDecoderPauseResume() {
+  struct DecoderCommand command;
+  command.type = DECODER_PAUSE_RESUME;
+  sendDecoderCommand(&command);
+}
+
+void halDecoderSetVolume(uint8_t volume) {
+  struct DecoderCommand command;
+  command.type = DECODER_SET_VOLUME;
+  command.volume = volume;
+  sendDecoderCommand(&command);
+}
+
+bool halDecoderSeek(uint32_t seconds) {
+  struct DecoderCommand command;
+  command.type = DECODER_SEEK;
+  command.seconds = seconds;
+  return sendDecoderCommand(&command);
+}
+
+uint32_t halDecoderCurrentTime() { return decoderCurrentTime; }
+uint32_t halDecoderDuration() { return decoderDuration; }
+uint32_t halDecoderUnderruns() { return i2sUnderruns; }
+uint32_t halDecoderSampleRate() { return decoderSampleRate; }
+
+// A proxima checkI2sUnderrun() espera o primeiro quadro entregue a partir daqui
+void resetI2sLedger() {
+  i2sLedgerValid = false;
+  i2sLedgerFrames = i2sFrames;
+}
+
+// O amplificador fica desligado enquanto a Audio abre o arquivo, para nao estalar
+void runDecoderCommand(struct DecoderCommand *command) {
+  char buffer[FS_PATH_SIZE];
+  switch(command->type) {
+    case DECODER_OPEN: {
+      const char *path = rootedPath(command->path, buffer);
+      bool warm = false;
+      digitalWrite(AMP_REM_PIN, LOW);
+      if(command->slot >= 0) {
+        prefetchHandoff = command->slot;
+        warm = audio.connecttoFS(prefetchFs, path);
+        prefetchHandoff = -1;
+      }
+      // Sem prefetch, ou se a Audio nao aceitou o arquivo dele, abre do cartao
+      if(!warm && !audio.connecttoFS(SD_CARD, path)) halLogf("ERR: Decoder nao abriu %s\n", command->path);
+      playPrefetch(command->slot, warm);
+      digitalWrite(AMP_REM_PIN, HIGH);
+      decoderSeekPending = false;
+      resetI2sLedger();
+      break;
+    }
+    case DECODER_PAUSE_RESUME: { audio.pauseResume(); resetI2sLedger(); break; }
+    case DECODER_SET_VOLUME: { audio.setVolume(command->volume); break; }
+    case DECODER_SEEK: { decoderSeekTarget = command->seconds; decoderSeekPending = true; break; }
+  }
+}
+
+/**
+ * Contabilidade do DMA do I2S: audio_process_i2s() conta os quadros entregues
+ * e o I2S consome getSampleRate() quadros por segundo, entao a diferenca da
+ * quantos quadros estao no DMA. A conta comeca no primeiro quadro depois de
+ * abertura, pausa ou pulo, com o DMA tendo so o que foi entregue desde entao.
+ * A estimativa nunca passa de I2S_DMA_FRAMES, porque i2s_write() bloqueia com
+ * o DMA cheio: o que passaria disso e deriva entre micros() e o clock do I2S,
+ * descartada no rebase. Abaixo de -I2S_UNDERRUN_SLACK o DMA esvaziou e o I2S
+ * tocou silencio no meio da faixa.
+ */
+void checkI2sUnderrun() {
+  uint32_t rate = audio.getSampleRate();
+  uint32_t now = micros();
+  if(!audio.isRunning() || rate == 0) {
+    resetI2sLedger();
+    return;
+  }
+  if(!i2sLedgerValid) {
+    uint32_t delivered = i2sFrames - i2sLedgerFrames;
+    if(delivered == 0) return;
+    i2sLedgerStart = now;
+    i2sLedgerFrames = i2sFrames;
+    i2sLedgerFill = delivered > I2S_DMA_FRAMES ? I2S_DMA_FRAMES : delivered;
+    i2sLedgerValid = true;
+    return;
+  }
+
+  uint32_t elapsed = now - i2sLedgerStart;
+  int32_t consumed = (uint64_t)elapsed * rate / 1000000;
+  int32_t fill = i2sLedgerFill + (int32_t)(i2sFrames - i2sLedgerFrames) - consumed;
+  if(fill < -I2S_UNDERRUN_SLACK) {
+    i2sUnderruns++;
+    fill = 0;
+  }
+  else if(elapsed < I2S_LEDGER_REBASE && fill <= I2S_DMA_FRAMES) return;
+  i2sLedgerStart = now;
+  i2sLedgerFrames = i2sFrames;
+  i2sLedgerFill = fill > I2S_DMA_FRAMES ? I2S_DMA_FRAMES : fill;
+}
+
+// Uma volta da tarefa do decoder: comandos pendentes, decodificacao e publicacao do estado
+void decoderStep() {
+  struct DecoderCommand command;
+  while(xQueueReceive(decoderQueue, &command, 0) == pdTRUE) runDecoderCommand(&command);
+
+  PROFILE_DECODER_CALL();
+  PROFILE_BEGIN(PROFILE_STAGE_DECODER);
+  audio.loop();
+  PROFILE_END(PROFILE_STAGE_DECODER);
+
+  decoderCurrentTime = audio.getAudioCurrentTime();
+  decoderDuration = audio.getAudioFileDuration();
+  decoderSampleRate = audio.getSampleRate();
+  // A Audio so sabe pular depois de ler o cabecalho e conhecer a duracao
+  if(decoderSeekPending && decoderDuration > 0) {
+    decoderSeekPending = false;
+    audio.setAudioPlayPosition(decoderSeekTarget);
+    resetI2sLedger();
+  }
+  checkI2sUnderrun();
+}
+
+// Chamado pela Audio, na tarefa do decoder, para cada sample antes do I2S
+void audio_process_i2s(uint32_t* sample, bool *continueI2S) {
+  i2sFrames++;
+  playerAudioFrame((int16_t*)sample);
+  *continueI2S = true;
+}
+
+// Chamado pela Audio no fim de qualquer arquivo local, nao so de mp3
+void audio_eof_mp3(const char *info) {
+  playerTrackEnded();
+}
+
+uint8_t* halDisplayBuffer() { return display.getBuffer(); }
+const uint8_t* halDisplayGlyph(uint8_t c) { return displayGlyphs[c]; }
+
+void setUpDisplayGlyphs() {
+  GlyphCanvas canvas;
+  for(uint16_t c = 0; c < 256; c++) {
+    memset(canvas.columns, 0, sizeof(canvas.columns));
+    canvas.drawChar(0, 0, c, SSD1306_WHITE, SSD1306_WHITE, 1);
+    memcpy(displayGlyphs[c], canvas.columns, HAL_GLYPH_WIDTH);
+  }
+}
+
+// Enderecamento da pagina e das colunas e depois os dados em blocos de DISPLAY_CHUNK_SIZE
+uint16_t halDisplaySend(uint8_t page, uint8_t start, uint8_t end) {
+  uint8_t *buffer = display.getBuffer();
+  uint16_t sent = 8;
+
+  Wire.beginTransmission(SCREEN_ADDRESS);
+  Wire.write((uint8_t)0x00); // Sequencia de comandos
+  Wire.write((uint8_t)SSD1306_PAGEADDR);
+  Wire.write(page);
+  Wire.write(page);
+  Wire.write((uint8_t)SSD1306_COLUMNADDR);
+  Wire.write(start);
+  Wire.write(end);
+  Wire.endTransmission();
+
+  for(uint16_t col = start; col <= end; col += DISPLAY_CHUNK_SIZE) {
+    uint16_t length = end - col + 1;
+    if(length > DISPLAY_CHUNK_SIZE) length = DISPLAY_CHUNK_SIZE;
+    Wire.beginTransmission(SCREEN_ADDRESS);
+    Wire.write((uint8_t)0x40); // Dados
+    Wire.write(buffer + page * HAL_DISPLAY_WIDTH + col, length);
+    Wire.endTransmission();
+    sent += length + 2;
+  }
+  return sent;
+}
+
+void halWakePrefetch() {
+  if(prefetchTaskHandler != NULL) xTaskNotifyGive(prefetchTaskHandler);
+}
+
+void halWakeTags() {
+  if(tagsTaskHandler != NULL) xTaskNotifyGive(tagsTaskHandler);
+}
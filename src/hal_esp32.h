@@ -0,0 +1,95 @@
+/**
+ * Objetos de hardware da placa usados pelo HAL e pelo boot em main.cpp
+*/
+
+#pragma once
+
+#include <Arduino.h>
+#include <Wire.h>
+#include <Adafruit_SSD1306.h>
+#include <Audio.h>
+
+/**
+ * Cartao SD: SPI no VSPI com o CS no 5 ou, com -DSD_USE_MMC, o SD_MMC em 4
+ * bits. O SD_MMC usa os GPIO 2, 4, 12, 13, 14 e 15, os mesmos de quatro
+ * botoes, entao so serve numa placa com os botoes remapeados. sdMount() tenta
+ * a frequencia configurada e desce pela lista ate o cartao ler certo.
+ */
+#ifdef SD_USE_MMC
+#include <SD_MMC.h>
+#define SD_CARD SD_MMC
+#define SD_MOUNT_POINT "/sdcard" // No VFS, para o readdir() do HalDir
+#else
+#include <SD.h>
+#define SD_CARD SD
+#define SD_MOUNT_POINT "/sd"
+#endif
+
+#define OLED_RESET -1 // Pino de reset da tela OLED
+#define SCREEN_ADDRESS 0x3C // Endereço do protocolo SPI para tela OLED
+#define DISPLAY_CHUNK_SIZE 64 // Bytes de dados por transmissao I2C
+
+#define AMP_REM_PIN 33
+#define SD_CS_PIN 5
+#ifndef SD_SPI_FREQUENCY
+#define SD_SPI_FREQUENCY 40000000 // Hz, a mais alta tentada na montagem
+#endif
+#define SD_PROBE_READS 8 // Leituras do setor 0 que precisam bater para aceitar a frequencia
+#define HC12_SET_PIN 32
+
+// Tarefa do decoder no APP core, acima do loop() que cuida de tela, botoes e navegacao
+#define AUDIO_TASK_STACK 8192
+#define AUDIO_TASK_PRIORITY (configMAX_PRIORITIES - 1)
+#define AUDIO_TASK_DELAY 1 // Tick cedido ao loop() a cada volta
+#define DECODER_QUEUE_SIZE 4
+#define DECODER_QUEUE_TIMEOUT 100 // ms esperando vaga na fila
+#define DECODER_OPEN 0
+#define DECODER_PAUSE_RESUME 1
+#define DECODER_SET_VOLUME 2
+#define DECODER_SEEK 3
+#define DECODER_PATH_SIZE 260
+#define I2S_UNDERRUN_SLACK 64 // Quadros de folga para o jitter entre micros() e o clock do I2S
+#define I2S_DMA_FRAMES 8192 // dma_buf_count * dma_buf_len que a ESP32-audioI2S instala
+#define I2S_LEDGER_REBASE 1000000 // us entre cada rebase da contabilidade do DMA
+
+// Leitura das tags em segundo plano no PRO core, abaixo de tudo
+#define TAGS_TASK_STACK 4096
+#define TAGS_STEP_DELAY 10 // ms entre faixas, para nao disputar o SD com o decoder
+#define TAGS_IDLE_DELAY 500 // ms entre consultas quando ja leu tudo
+
+// Parser dos comandos, telemetria e o motor AT do HC-12 (snprintf e halLogf na pilha)
+#define RADIO_TASK_STACK 3072
+
+// Analisador de espectro no PRO core; as tabelas e buffers da FFT sao estaticos
+#define SPECTRUM_TASK_STACK 3072
+#define SPECTRUM_TASK_DELAY 5 // ms entre consultas com o analisador ligado
+#define SPECTRUM_IDLE_DELAY 200 // ms entre consultas com ele desligado
+
+// Prefetch: buffers reservados para o comeco das proximas faixas (a que toca, uma na fila e a que enche)
+#define PREFETCH_SLOTS 3
+#define PREFETCH_BUFFER_SIZE 4096
+#define PREFETCH_FREE 0
+#define PREFETCH_FILLING 1
+#define PREFETCH_READY 2
+#define PREFETCH_CLAIMED 3 // Numa abertura ainda na fila do decoder
+#define PREFETCH_PLAYING 4
+
+struct DecoderCommand {
+  uint8_t type;
+  uint8_t volume;
+  int8_t slot; // DECODER_OPEN: slot do prefetch com o arquivo ja aberto, -1 se nenhum
+  uint32_t seconds;
+  char path[DECODER_PATH_SIZE];
+};
+
+extern Adafruit_SSD1306 display;
+extern Audio audio;
+extern HardwareSerial HC12;
+extern TaskHandle_t prefetchTaskHandler;
+extern TaskHandle_t audioTaskHandler;
+extern TaskHandle_t tagsTaskHandler;
+extern QueueHandle_t decoderQueue;
+
+bool sdMount(void);
+void setUpDisplayGlyphs(void);
+void decoderStep(void);
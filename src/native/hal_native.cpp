@@ -0,0 +1,679 @@
+/**
+ * Implementacao do HAL para Linux: o cartao e um diretorio do host, o decoder
+ * so conta o tempo da faixa, o display e um framebuffer em memoria e o radio
+ * le e escreve em pipes (a entrada padrao por default)
+ *
+ * Com nativeSetRadioSim() o HC-12 e simulado: responde os comandos AT com o
+ * SET baixo, so no baud em que esta, com o tempo dos bytes na UART mais um
+ * processamento com jitter, e o controle confirma os quadros de telemetria
+ * quando os dois estao na mesma FU e taxa no ar. Sem a simulacao os bytes do
+ * modo de comando sao descartados, como se o modulo nao estivesse la.
+*/
+
+#include "hal_native.h"
+#include "hal.h"
+#include "player.h"
+#include "profiler.h"
+#include "radio.h"
+#include "telemetry.h"
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+#define DISPLAY_CHUNK_SIZE 64 // Mesmos blocos do I2C da placa, para os bytes/s baterem
+#define RADIO_BUFFER_SIZE 64
+#define SIM_QUEUE_SIZE 128 // Potencia de 2
+#define SIM_ENTER_TIME 40000 // us ate o modulo aceitar comandos depois do SET baixo
+#define SIM_EXIT_TIME 80000 // us ate voltar ao modo transparente
+#define SIM_PROCESS_MIN 1500 // us de processamento de um comando AT
+#define SIM_PROCESS_JITTER 3000
+#define SIM_REMOTE_TIME 4000 // us do controle entre receber o quadro e confirmar
+#define DECODER_MP3_BYTES_PER_SECOND 16000 // 128 kbps
+#define DECODER_WAV_BYTES_PER_SECOND 176400 // 44.1 kHz, 16 bits, estereo
+#define PREFETCH_BUFFER_SIZE 4096
+#define PREFETCH_PATH_MAX 260 // Como DECODER_PATH_SIZE na placa
+
+/**
+ * Estado de um HalFile aberto. As pastas sao listadas em ordem alfabetica,
+ * para que duas execucoes sobre o mesmo diretorio vejam a mesma biblioteca.
+ */
+struct NativeFile {
+  FILE *file;
+  struct dirent **entries;
+  int entryCounter;
+  int nextEntry;
+  char *path; // Caminho no cartao, a partir de "/"
+  const char *name;
+  struct stat info;
+};
+// O storage do HalFile guarda so o ponteiro; no host a alocacao nao pesa
+#define NATIVE_FILE(storage) (*reinterpret_cast<NativeFile**>(storage))
+
+// HalDir: o caminho fica para o stat() de quem o readdir nao diz o tipo
+struct NativeDir {
+  DIR *dir;
+  char *full;
+};
+
+char *nativeRoot = NULL;
+char *scratchPrefix = NULL; // Caminhos dentro dele vao para scratchDir, fora da raiz
+char *scratchDir = NULL;
+bool fastClock = false;
+uint64_t clockMicros = 0;
+uint64_t clockStart = 0;
+
+int radioIn = STDIN_FILENO;
+int radioOut = -1;
+uint8_t radioBuffer[RADIO_BUFFER_SIZE];
+uint8_t radioHead = 0;
+uint8_t radioTail = 0;
+
+// HC-12 simulado: o modulo comeca no padrao de fabrica
+struct SimByte {
+  uint8_t value;
+  uint64_t readyAt;
+};
+bool simPresent = false;
+uint8_t simFu = 3;
+uint32_t simBaud = 9600;
+uint8_t simRemoteFu = 3;
+uint32_t simRemoteBaud = 9600;
+bool simCommand = false;
+uint64_t simModeTime = 0;
+uint32_t simUartBaud = 9600;
+uint32_t simRandom = 12345;
+struct SimByte simQueue[SIM_QUEUE_SIZE];
+uint32_t simHead = 0;
+uint32_t simTail = 0;
+
+bool decoderOpen = false;
+bool decoderPlaying = false;
+uint32_t decoderLastMs = 0;
+uint32_t decoderPlayedMs = 0;
+uint32_t decoderDurationMs = 0;
+
+// Um slot de prefetch so: o decoder falso so precisa do tamanho do arquivo
+uint8_t prefetchBuffer[PREFETCH_BUFFER_SIZE];
+char prefetchSlotPath[PREFETCH_PATH_MAX];
+uint32_t prefetchSlotSize = 0;
+bool prefetchSlotReady = false;
+
+uint8_t displayBuffer[HAL_DISPLAY_WIDTH * HAL_DISPLAY_HEIGHT / 8];
+uint8_t displayPanel[HAL_DISPLAY_WIDTH * HAL_DISPLAY_HEIGHT / 8]; // O que o SSD1306 teria recebido
+uint8_t displayGlyph[HAL_GLYPH_WIDTH];
+
+volatile bool prefetchWake = false;
+
+char* hostPath(const char *path) {
+  const char *base = nativeRoot;
+  size_t prefix = scratchPrefix != NULL ? strlen(scratchPrefix) : 0;
+  if(prefix > 0 && strncmp(path, scratchPrefix, prefix) == 0 && (path[prefix] == '\0' || path[prefix] == '/')) {
+    base = scratchDir;
+    path += prefix;
+  }
+  if(path[0] == '\0' || strcmp(path, "/") == 0) return strdup(base);
+  char *full = (char*)malloc(strlen(base) + strlen(path) + 1);
+  strcpy(full, base);
+  strcat(full, path);
+  return full;
+}
+
+uint64_t monotonicMicros() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+void nativeSetFastClock(bool fast) {
+  fastClock = fast;
+}
+
+// Relogio rapido: cada volta do loop vale step us sem esperar; senao dorme de verdade
+void nativeClockTick(uint32_t us) {
+  if(fastClock) clockMicros += us;
+  else usleep(us);
+}
+
+bool nativeSetRadio(const char *inPath, const char *outPath) {
+  if(inPath != NULL) {
+    radioIn = open(inPath, O_RDONLY | O_NONBLOCK);
+    if(radioIn < 0) return false;
+  }
+  else fcntl(radioIn, F_SETFL, fcntl(radioIn, F_GETFL) | O_NONBLOCK);
+
+  if(outPath != NULL) {
+    radioOut = open(outPath, O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if(radioOut < 0) return false;
+  }
+  return true;
+}
+
+void nativeSetRadioSim(uint8_t remoteFu, uint32_t remoteBaud) {
+  simPresent = true;
+  simRemoteFu = remoteFu;
+  simRemoteBaud = remoteBaud;
+}
+
+// prefix NULL desfaz o desvio
+void nativeSetScratch(const char *prefix, const char *dir) {
+  free(scratchPrefix);
+  free(scratchDir);
+  scratchPrefix = prefix != NULL ? strdup(prefix) : NULL;
+  scratchDir = prefix != NULL ? strdup(dir) : NULL;
+}
+
+char* nativeHostPath(const char *path) {
+  return hostPath(path);
+}
+
+bool nativeTakePrefetchWake() {
+  if(!prefetchWake) return false;
+  prefetchWake = false;
+  return true;
+}
+
+bool nativePanelMatchesBuffer() {
+  return memcmp(displayPanel, displayBuffer, sizeof(displayBuffer)) == 0;
+}
+
+// Desenha o painel em texto, um caractere por pixel
+void nativeDumpDisplay(FILE *out) {
+  for(uint8_t y = 0; y < HAL_DISPLAY_HEIGHT; y++) {
+    for(uint8_t x = 0; x < HAL_DISPLAY_WIDTH; x++) {
+      bool set = displayPanel[(y / 8) * HAL_DISPLAY_WIDTH + x] & (1 << (y & 7));
+      fputc(set ? '#' : '.', out);
+    }
+    fputc('\n', out);
+  }
+}
+
+// Sem a volta dos 32 bits, para as filas do HC-12 simulado
+uint64_t nativeMicros() {
+  if(fastClock) return clockMicros;
+  if(clockStart == 0) clockStart = monotonicMicros();
+  return monotonicMicros() - clockStart;
+}
+
+uint32_t halMillis() { return halMicros() / 1000; }
+
+uint32_t halMicros() { return (uint32_t)nativeMicros(); }
+
+// Nanossegundos reais mesmo com o relogio rapido: o profiler mede o custo de verdade
+uint32_t halCycles() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint32_t)((uint64_t)now.tv_sec * 1000000000 + now.tv_nsec);
+}
+
+uint32_t halCyclesPerMicro() { return 1000; }
+
+uint32_t halRandom() {
+  uint32_t value = 0;
+  int fd = open("/dev/urandom", O_RDONLY);
+  if(fd >= 0) {
+    if(read(fd, &value, sizeof(value)) != sizeof(value)) value = 0;
+    close(fd);
+  }
+  return value;
+}
+
+// No host o heap cresce sob demanda; o que sobra e o livre dentro da arena do malloc
+uint32_t halFreeHeap() {
+#ifdef __GLIBC__
+  return (uint32_t)mallinfo2().fordblks;
+#else
+  return 0;
+#endif
+}
+
+uint32_t halMaxAllocHeap() {
+  return halFreeHeap();
+}
+
+void halLogf(const char *format, ...) {
+  va_list args;
+  va_start(args, format);
+  vfprintf(stdout, format, args);
+  va_end(args);
+  fflush(stdout);
+}
+
+uint32_t simJitter(uint32_t range) {
+  simRandom = simRandom * 1103515245 + 12345;
+  return (simRandom >> 16) % range;
+}
+
+// Taxa no ar da FU3 pelo baud; FU2 e FU4 tem uma so
+uint32_t simAirRate(uint8_t fu, uint32_t baud) {
+  if(fu == 2) return 250000;
+  if(fu == 4) return 500;
+  if(baud <= 2400) return 5000;
+  if(baud <= 9600) return 15000;
+  if(baud <= 38400) return 58000;
+  return 236000;
+}
+
+// Bytes que chegam na UART a partir de at, um a cada tempo de byte
+void simSend(const char *data, uint8_t length, uint64_t at, uint32_t baud) {
+  uint32_t byteTime = 10000000 / baud;
+  if(simHead - simTail > 0 && simQueue[(simHead - 1) & (SIM_QUEUE_SIZE - 1)].readyAt > at) {
+    at = simQueue[(simHead - 1) & (SIM_QUEUE_SIZE - 1)].readyAt;
+  }
+  for(uint8_t i = 0; i < length && simHead - simTail < SIM_QUEUE_SIZE; i++) {
+    at += byteTime;
+    simQueue[simHead & (SIM_QUEUE_SIZE - 1)].value = data[i];
+    simQueue[simHead & (SIM_QUEUE_SIZE - 1)].readyAt = at;
+    simHead++;
+  }
+}
+
+// Um comando AT por escrita, como o hc12.cpp manda
+void simCommandWrite(const uint8_t *data, size_t length) {
+  uint64_t now = nativeMicros();
+  if(simUartBaud != simBaud || now - simModeTime < SIM_ENTER_TIME) return; // Lixo para o modulo
+  char command[24];
+  if(length >= sizeof(command)) return;
+  memcpy(command, data, length);
+  command[length] = '\0';
+
+  char response[80];
+  uint32_t baud = simBaud; // A resposta sai no baud antigo
+  if(strcmp(command, "AT") == 0) strcpy(response, "OK\r\n");
+  else if(strncmp(command, "AT+B", 4) == 0) {
+    uint32_t value = strtoul(command + 4, NULL, 10);
+    if(value < 1200 || value > 115200 || (simFu == 2 && value > 4800) || (simFu == 4 && value != 1200)) strcpy(response, "ERROR\r\n");
+    else {
+      snprintf(response, sizeof(response), "OK+B%lu\r\n", (unsigned long)value);
+      simBaud = value;
+    }
+  }
+  else if(strncmp(command, "AT+FU", 5) == 0) {
+    uint8_t value = command[5] - '0';
+    if(value < 1 || value > 4) strcpy(response, "ERROR\r\n");
+    else {
+      snprintf(response, sizeof(response), "OK+FU%u\r\n", value);
+      simFu = value;
+      if(value == 2 && simBaud > 4800) simBaud = 4800; // O modulo ajusta sozinho
+      if(value == 4) simBaud = 1200;
+    }
+  }
+  else if(strcmp(command, "AT+RX") == 0) {
+    snprintf(response, sizeof(response), "OK+B%lu\r\nOK+RC001\r\nOK+RP:+20dBm\r\nOK+FU%u\r\n", (unsigned long)simBaud, simFu);
+  }
+  else strcpy(response, "ERROR\r\n");
+
+  uint64_t at = now + length * (10000000 / simUartBaud) + SIM_PROCESS_MIN + simJitter(SIM_PROCESS_JITTER);
+  simSend(response, strlen(response), at, baud);
+}
+
+// O controle confirma um quadro de telemetria se ouvir o modulo
+void simTransparentWrite(const uint8_t *data, size_t length) {
+  uint64_t now = nativeMicros();
+  if(simCommand || now - simModeTime < SIM_EXIT_TIME || simUartBaud != simBaud) return;
+  if(length < 3 || data[0] != TELEMETRY_FRAME_START) return;
+  if(simFu != simRemoteFu || simAirRate(simFu, simBaud) != simAirRate(simRemoteFu, simRemoteBaud)) return;
+
+  uint32_t air = simAirRate(simFu, simBaud);
+  uint64_t at = now + length * (10000000 / simUartBaud) + (length + 4) * 10000000ull / air + SIM_REMOTE_TIME + simJitter(SIM_PROCESS_JITTER);
+  char ack[4] = { (char)RADIO_FRAME_START, (char)data[1], (char)RADIO_TELEMETRY_ACK, 0 };
+  ack[3] = crc8((const uint8_t*)ack + 1, 2);
+  simSend(ack, sizeof(ack), at + sizeof(ack) * 10000000ull / air, simBaud);
+}
+
+int simAvailable() {
+  uint64_t now = nativeMicros();
+  uint32_t count = 0;
+  while(simTail + count != simHead && simQueue[(simTail + count) & (SIM_QUEUE_SIZE - 1)].readyAt <= now) count++;
+  return count;
+}
+
+int halRadioAvailable() {
+  if(simPresent && simHead != simTail) return simAvailable();
+  if(simCommand) return 0; // Com o SET baixo nada passa do ar para a UART
+  if(radioHead == radioTail && radioIn >= 0) {
+    ssize_t length = read(radioIn, radioBuffer, RADIO_BUFFER_SIZE);
+    if(length == 0) radioIn = -1; // Pipe fechado
+    radioHead = 0;
+    radioTail = length > 0 ? length : 0;
+  }
+  return radioTail - radioHead;
+}
+
+int halRadioRead() {
+  if(halRadioAvailable() == 0) return -1;
+  if(simPresent && simHead != simTail) return simQueue[simTail++ & (SIM_QUEUE_SIZE - 1)].value;
+  return radioBuffer[radioHead++];
+}
+
+size_t halRadioWrite(const uint8_t *data, size_t length) {
+  if(simPresent) {
+    if(simCommand) simCommandWrite(data, length);
+    else simTransparentWrite(data, length);
+  }
+  if(simCommand) return length;
+  if(radioOut < 0) return length;
+  ssize_t written = write(radioOut, data, length);
+  return written > 0 ? written : 0;
+}
+
+void halRadioSetCommandMode(bool command) {
+  if(command == simCommand) return;
+  simCommand = command;
+  simModeTime = nativeMicros();
+}
+
+void halRadioSetBaud(uint32_t baud) {
+  simUartBaud = baud;
+}
+
+int visibleEntry(const struct dirent *entry) {
+  return strcmp(entry->d_name, ".") != 0 && strcmp(entry->d_name, "..") != 0;
+}
+
+bool HalFile::open(const char *path, uint8_t mode) {
+  close();
+  char *full = hostPath(path);
+  NativeFile *file = (NativeFile*)calloc(1, sizeof(NativeFile));
+  bool found = stat(full, &file->info) == 0;
+
+  if(mode == HAL_FILE_WRITE || mode == HAL_FILE_UPDATE) {
+    file->file = fopen(full, mode == HAL_FILE_WRITE ? "wb" : "r+b");
+    found = file->file != NULL && fstat(fileno(file->file), &file->info) == 0;
+  }
+  else if(found && S_ISDIR(file->info.st_mode)) {
+    // Sem ordenar, como o FAT: a ordem da biblioteca sai do library.cpp
+    file->entryCounter = scandir(full, &file->entries, visibleEntry, NULL);
+    found = file->entryCounter >= 0;
+  }
+  else if(found) {
+    file->file = fopen(full, "rb");
+    found = file->file != NULL;
+  }
+  free(full);
+
+  if(!found) {
+    if(file->file != NULL) fclose(file->file);
+    free(file);
+    return false;
+  }
+  file->path = strdup(path);
+  const char *slash = strrchr(file->path, '/');
+  file->name = slash != NULL && slash[1] != '\0' ? slash + 1 : file->path;
+  NATIVE_FILE(storage) = file;
+  opened = true;
+  return true;
+}
+
+bool HalFile::openNext(HalFile &entry) {
+  entry.close();
+  if(!opened) return false;
+  NativeFile *dir = NATIVE_FILE(storage);
+
+  while(dir->nextEntry < dir->entryCounter) {
+    const char *name = dir->entries[dir->nextEntry++]->d_name;
+    char *path = (char*)malloc(strlen(dir->path) + strlen(name) + 2);
+    strcpy(path, dir->path);
+    if(strcmp(dir->path, "/") != 0) strcat(path, "/");
+    strcat(path, name);
+    bool found = entry.open(path);
+    free(path);
+    if(found) return true;
+  }
+  return false;
+}
+
+void HalFile::rewind() {
+  if(opened) NATIVE_FILE(storage)->nextEntry = 0;
+}
+
+bool HalDir::open(const char *path) {
+  close();
+  char *full = hostPath(path);
+  DIR *dir = opendir(full);
+  if(dir == NULL) {
+    free(full);
+    return false;
+  }
+  NativeDir *native = (NativeDir*)malloc(sizeof(NativeDir));
+  native->dir = dir;
+  native->full = full;
+  handle = native;
+  return true;
+}
+
+bool HalDir::next(const char **name, bool *isDirectory, uint32_t *size) {
+  if(handle == NULL) return false;
+  NativeDir *native = (NativeDir*)handle;
+  struct dirent *entry;
+  while((entry = readdir(native->dir)) != NULL) {
+    if(strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
+    size_t length = strlen(native->full) + strlen(entry->d_name) + 2;
+    char *path = (char*)malloc(length);
+    snprintf(path, length, "%s/%s", native->full, entry->d_name);
+    struct stat info;
+    bool found = stat(path, &info) == 0;
+    free(path);
+    *isDirectory = entry->d_type == DT_UNKNOWN ? found && S_ISDIR(info.st_mode) : entry->d_type == DT_DIR;
+    // Como no FAT: pasta tem tamanho 0
+    *size = found && !*isDirectory ? (uint32_t)info.st_size : 0;
+    *name = entry->d_name;
+    return true;
+  }
+  return false;
+}
+
+void HalDir::close() {
+  if(handle == NULL) return;
+  NativeDir *native = (NativeDir*)handle;
+  closedir(native->dir);
+  free(native->full);
+  free(native);
+  handle = NULL;
+}
+
+void HalFile::close() {
+  if(!opened) return;
+  NativeFile *file = NATIVE_FILE(storage);
+  if(file->file != NULL) fclose(file->file);
+  for(int i = 0; i < file->entryCounter; i++) free(file->entries[i]);
+  free(file->entries);
+  free(file->path);
+  free(file);
+  opened = false;
+}
+
+bool HalFile::isDirectory() { return opened && S_ISDIR(NATIVE_FILE(storage)->info.st_mode); }
+const char* HalFile::name() { return opened ? NATIVE_FILE(storage)->name : ""; }
+uint32_t HalFile::lastWrite() { return opened ? (uint32_t)NATIVE_FILE(storage)->info.st_mtime : 0; }
+
+uint32_t HalFile::size() {
+  if(!opened) return 0;
+  NativeFile *file = NATIVE_FILE(storage);
+  if(file->file != NULL) fstat(fileno(file->file), &file->info);
+  return (uint32_t)file->info.st_size;
+}
+
+bool HalFile::seek(uint32_t position) {
+  if(!opened || NATIVE_FILE(storage)->file == NULL) return false;
+  return fseek(NATIVE_FILE(storage)->file, position, SEEK_SET) == 0;
+}
+
+size_t HalFile::read(void *buffer, size_t length) {
+  if(!opened || NATIVE_FILE(storage)->file == NULL) return 0;
+  return fread(buffer, 1, length, NATIVE_FILE(storage)->file);
+}
+
+size_t HalFile::write(const void *buffer, size_t length) {
+  if(!opened || NATIVE_FILE(storage)->file == NULL) return 0;
+  size_t written = fwrite(buffer, 1, length, NATIVE_FILE(storage)->file);
+  fflush(NATIVE_FILE(storage)->file);
+  return written;
+}
+
+void halFsSetRoot(const char *path) {
+  free(nativeRoot);
+  nativeRoot = strdup(path);
+  size_t length = strlen(nativeRoot);
+  while(length > 1 && nativeRoot[length - 1] == '/') nativeRoot[--length] = '\0';
+}
+
+bool halFsExists(const char *path) {
+  struct stat info;
+  char *full = hostPath(path);
+  bool found = stat(full, &info) == 0;
+  free(full);
+  return found;
+}
+
+bool halFsMkdir(const char *path) {
+  char *full = hostPath(path);
+  bool done = mkdir(full, 0755) == 0;
+  free(full);
+  return done;
+}
+
+bool halFsRemove(const char *path) {
+  char *full = hostPath(path);
+  bool done = remove(full) == 0;
+  free(full);
+  return done;
+}
+
+bool halFsRename(const char *from, const char *to) {
+  char *fullFrom = hostPath(from);
+  char *fullTo = hostPath(to);
+  bool done = rename(fullFrom, fullTo) == 0;
+  free(fullFrom);
+  free(fullTo);
+  return done;
+}
+
+uint32_t halFsClock() { return 0; }
+
+/**
+ * Decoder falso: a duracao sai do tamanho do arquivo com bitrate fixo e o
+ * tempo corre com o relogio enquanto toca. No fim o tempo para, como a Audio
+ * faz no fim do arquivo.
+ */
+bool halDecoderPrefetch(const char *path) {
+  HalFile track;
+  prefetchSlotReady = false;
+  if(strlen(path) >= sizeof(prefetchSlotPath) || !track.open(path)) return false;
+  track.read(prefetchBuffer, sizeof(prefetchBuffer));
+  strcpy(prefetchSlotPath, path);
+  prefetchSlotSize = track.size();
+  prefetchSlotReady = true;
+  track.close();
+  return true;
+}
+
+uint32_t decoderBytesPerSecond(const char *path) {
+  const char *dot = strrchr(path, '.');
+  return dot != NULL && strcasecmp(dot, ".wav") == 0 ? DECODER_WAV_BYTES_PER_SECOND : DECODER_MP3_BYTES_PER_SECOND;
+}
+
+bool halDecoderOpen(const char *path) {
+  decoderPlayedMs = 0;
+  decoderLastMs = halMillis();
+  if(prefetchSlotReady && strcmp(prefetchSlotPath, path) == 0) {
+    prefetchSlotReady = false;
+    decoderOpen = true;
+    decoderPlaying = true;
+    decoderDurationMs = (uint64_t)prefetchSlotSize * 1000 / decoderBytesPerSecond(path);
+    return true;
+  }
+
+  HalFile track;
+  decoderOpen = track.open(path);
+  decoderPlaying = decoderOpen;
+  decoderPlayedMs = 0;
+  decoderDurationMs = 0;
+  decoderLastMs = halMillis();
+  if(!decoderOpen) return false;
+
+  decoderDurationMs = (uint64_t)track.size() * 1000 / decoderBytesPerSecond(path);
+  track.close();
+  return true;
+}
+
+// Um quadro de silencio por chamada enquanto toca
+void halDecoderLoop() {
+  PROFILE_DECODER_CALL();
+  PROFILE_BEGIN(PROFILE_STAGE_DECODER);
+  uint32_t now = halMillis();
+  if(decoderPlaying) {
+    decoderPlayedMs += now - decoderLastMs;
+    int16_t frame[2] = { 0, 0 };
+    playerAudioFrame(frame);
+    if(decoderPlayedMs >= decoderDurationMs) {
+      decoderPlayedMs = decoderDurationMs;
+      decoderPlaying = false;
+      playerTrackEnded();
+    }
+  }
+  decoderLastMs = now;
+  PROFILE_END(PROFILE_STAGE_DECODER);
+}
+
+void halDecoderPauseResume() {
+  if(!decoderOpen || decoderPlayedMs >= decoderDurationMs) return;
+  decoderPlaying = !decoderPlaying;
+  decoderLastMs = halMillis();
+}
+
+void halDecoderSetVolume(uint8_t volume) {}
+
+bool halDecoderSeek(uint32_t seconds) {
+  if(!decoderOpen || seconds * 1000 >= decoderDurationMs) return false;
+  decoderPlayedMs = seconds * 1000;
+  return true;
+}
+uint32_t halDecoderCurrentTime() { return decoderPlayedMs / 1000; }
+uint32_t halDecoderDuration() { return decoderDurationMs / 1000; }
+uint32_t halDecoderUnderruns() { return 0; } // Sem I2S no host
+uint32_t halDecoderSampleRate() { return 44100; }
+
+uint8_t* halDisplayBuffer() { return displayBuffer; }
+
+// Sem a fonte da Adafruit_GFX no host: cada caractere vira uma caixa com o codigo em binario
+const uint8_t* halDisplayGlyph(uint8_t c) {
+  if(c == ' ') {
+    memset(displayGlyph, 0, HAL_GLYPH_WIDTH);
+    return displayGlyph;
+  }
+  displayGlyph[0] = 0x7F;
+  displayGlyph[1] = 0x41 | ((c & 0x1F) << 1);
+  displayGlyph[2] = 0x41 | ((c >> 5) << 1);
+  displayGlyph[3] = 0x41;
+  displayGlyph[4] = 0x7F;
+  return displayGlyph;
+}
+
+uint16_t halDisplaySend(uint8_t page, uint8_t start, uint8_t end) {
+  uint16_t offset = page * HAL_DISPLAY_WIDTH + start;
+  memcpy(displayPanel + offset, displayBuffer + offset, end - start + 1);
+
+  uint16_t sent = 8;
+  for(uint16_t col = start; col <= end; col += DISPLAY_CHUNK_SIZE) {
+    uint16_t length = end - col + 1;
+    if(length > DISPLAY_CHUNK_SIZE) length = DISPLAY_CHUNK_SIZE;
+    sent += length + 2;
+  }
+  return sent;
+}
+
+void halWakePrefetch() {
+  prefetchWake = true;
+}
+
+// O main do host ja chama metadataStep() a cada volta
+void halWakeTags() {}
@@ -0,0 +1,20 @@
+/**
+ * Controle do backend native usado pelos programas do host
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+
+#define NATIVE_LOOP_STEP_US 1000 // Avanco do relogio por volta do loop
+
+void nativeSetFastClock(bool fast);
+void nativeClockTick(uint32_t us);
+bool nativeSetRadio(const char *inPath, const char *outPath);
+void nativeSetRadioSim(uint8_t remoteFu, uint32_t remoteBaud);
+void nativeSetScratch(const char *prefix, const char *dir); // Desvia a pasta prefix do cartao para dir
+char* nativeHostPath(const char *path); // Caminho no host, alocado: quem chama libera
+bool nativeTakePrefetchWake(void);
+bool nativePanelMatchesBuffer(void);
+void nativeDumpDisplay(FILE *out);
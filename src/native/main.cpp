@@ -0,0 +1,92 @@
+/**
+ * Player no host: a mesma logica de lib/player rodando sobre o backend native
+ *
+ * Uso: program <pasta-do-cartao> [--fast] [--run-ms N] [--radio-in caminho]
+ *              [--radio-out caminho] [--radio-sim FU,BAUD] [--dump-display]
+ *
+ *  --fast          o relogio anda NATIVE_LOOP_STEP_US por volta sem dormir
+ *  --run-ms N      encerra depois de N ms no relogio do player
+ *  --radio-in      pipe com os bytes do HC-12 (default: entrada padrao, ex.: NEXT_SONG)
+ *  --radio-out     arquivo ou pipe que recebe o que o player manda pelo HC-12
+ *  --radio-sim     simula o HC-12 (comeca em FU3, 9600) e um controle em FU,BAUD
+ *                  que confirma os quadros de telemetria
+ *  --dump-display  desenha o painel na saida ao encerrar
+ *
+ * Sai com erro se o painel terminar diferente do framebuffer, ou seja, se
+ * alguma area desenhada nao foi marcada para o flushDisplay().
+*/
+
+#include "hal_native.h"
+#include "hal.h"
+#include "player.h"
+#include "radio.h"
+#include "metadata.h"
+#include "hc12.h"
+#include "spectrum.h"
+#include <stdlib.h>
+#include <string.h>
+
+int main(int argc, char **argv) {
+  const char *root = NULL;
+  const char *radioInPath = NULL;
+  const char *radioOutPath = NULL;
+  uint32_t runMs = 0;
+  bool dumpDisplay = false;
+
+  for(int i = 1; i < argc; i++) {
+    if(strcmp(argv[i], "--fast") == 0) nativeSetFastClock(true);
+    else if(strcmp(argv[i], "--run-ms") == 0 && i + 1 < argc) runMs = strtoul(argv[++i], NULL, 10);
+    else if(strcmp(argv[i], "--radio-in") == 0 && i + 1 < argc) radioInPath = argv[++i];
+    else if(strcmp(argv[i], "--radio-out") == 0 && i + 1 < argc) radioOutPath = argv[++i];
+    else if(strcmp(argv[i], "--radio-sim") == 0 && i + 1 < argc) {
+      char *end;
+      uint8_t fu = strtoul(argv[++i], &end, 10);
+      uint32_t baud = *end == ',' ? strtoul(end + 1, NULL, 10) : 0;
+      if(baud == 0) {
+        fprintf(stderr, "--radio-sim espera FU,BAUD\n");
+        return 2;
+      }
+      nativeSetRadioSim(fu, baud);
+    }
+    else if(strcmp(argv[i], "--dump-display") == 0) dumpDisplay = true;
+    else if(root == NULL && argv[i][0] != '-') root = argv[i];
+    else {
+      fprintf(stderr, "Opcao desconhecida: %s\n", argv[i]);
+      return 2;
+    }
+  }
+  if(root == NULL) {
+    fprintf(stderr, "Uso: %s <pasta-do-cartao> [--fast] [--run-ms N] [--radio-in caminho] [--radio-out caminho] [--radio-sim FU,BAUD] [--dump-display]\n", argv[0]);
+    return 2;
+  }
+
+  halFsSetRoot(root);
+  if(!nativeSetRadio(radioInPath, radioOutPath)) {
+    fprintf(stderr, "ERR: Nao foi possivel abrir o pipe do radio\n");
+    return 1;
+  }
+
+  playerBegin();
+
+  uint32_t startTime = halMillis();
+  uint32_t radioTime = startTime;
+  while(runMs == 0 || halMillis() - startTime < runMs) {
+    // Como na placa, a tarefa do radio roda a cada volta enquanto ha trabalho AT
+    if(hc12Busy() || halMillis() - radioTime >= RADIO_POLL_INTERVAL) {
+      radioTime = halMillis();
+      radioPoll();
+    }
+    if(nativeTakePrefetchWake()) prefetchRun();
+    metadataStep();
+    spectrumStep();
+    playerLoop();
+    nativeClockTick(NATIVE_LOOP_STEP_US);
+  }
+
+  if(dumpDisplay) nativeDumpDisplay(stdout);
+  if(!nativePanelMatchesBuffer()) {
+    halLogf("ERR: Painel diferente do framebuffer, faltou marcar alguma area\n");
+    return 1;
+  }
+  return 0;
+}